@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "context.h"
+#include "lexer.h"
+#include "mnemonic.h"
+
+/*
+  Microbenchmark for mnemonic dispatch.
+  "chain" replays the old consume_instruction strategy: try consume_keyword for
+  every mnemonic in table order until one matches. "hash" scans the token once
+  and resolves it with lookup_mnemonic.
+*/
+
+enum {
+  kLines = 1 << 16,
+  kRounds = 64,
+};
+
+static double now_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(void){
+  size_t count;
+  const struct MnemonicDescriptor* table = mnemonic_table(&count);
+
+  // one mnemonic per line, cycling through the whole table
+  size_t line_len = kMnemonicMaxLen + 2;
+  char* text = malloc(kLines * line_len + 2);
+  char** lines = malloc(kLines * sizeof(char*));
+  text[0] = '\0';
+  char* cursor = text + 1;
+  for (size_t i = 0; i < kLines; ++i){
+    lines[i] = cursor;
+    cursor += sprintf(cursor, "%s\n", table[i % count].name);
+  }
+  struct AssemblerContext* ctx = create_assembler_context();
+  set_current_buffer(ctx, text);
+
+  unsigned long checksum = 0;
+
+  double start = now_seconds();
+  for (int round = 0; round < kRounds; ++round){
+    for (size_t i = 0; i < kLines; ++i){
+      ctx->current = lines[i];
+      for (size_t j = 0; j < count; ++j){
+        if (consume_keyword(ctx, table[j].name)){
+          checksum += j;
+          break;
+        }
+      }
+    }
+  }
+  double chain_ns = (now_seconds() - start) * 1e9 / ((double)kLines * kRounds);
+
+  start = now_seconds();
+  for (int round = 0; round < kRounds; ++round){
+    for (size_t i = 0; i < kLines; ++i){
+      const char* line = lines[i];
+      size_t len = 0;
+      while (line[len] != '\n') len++;
+      const struct MnemonicDescriptor* desc = lookup_mnemonic(line, len);
+      checksum += (unsigned long)(desc - table);
+    }
+  }
+  double hash_ns = (now_seconds() - start) * 1e9 / ((double)kLines * kRounds);
+
+  printf("mnemonic dispatch over %zu mnemonics (checksum %lu)\n", count, checksum);
+  printf("  keyword chain: %8.2f ns/line\n", chain_ns);
+  printf("  perfect hash:  %8.2f ns/line\n", hash_ns);
+
+  destroy_assembler_context(ctx);
+  free(lines);
+  free(text);
+  return 0;
+}
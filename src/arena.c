@@ -0,0 +1,79 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/*
+  Arena allocator.
+  Memory is carved from large blocks by bumping a pointer, so an allocation
+  is a compare and an add, and teardown is one free per block no matter how
+  many objects were handed out.
+*/
+
+struct ArenaBlock {
+  struct ArenaBlock* next;
+  alignas(max_align_t) char data[];
+};
+
+struct Arena* create_arena(size_t block_size){
+  struct Arena* arena = malloc(sizeof(struct Arena));
+  arena->blocks = NULL;
+  arena->next = NULL;
+  arena->end = NULL;
+  arena->block_size = block_size;
+  arena->reserved = 0;
+  return arena;
+}
+
+// start a block that can hold at least size bytes and make it current
+static void add_block(struct Arena* arena, size_t size){
+  size_t capacity = size > arena->block_size ? size : arena->block_size;
+  struct ArenaBlock* block = malloc(sizeof(struct ArenaBlock) + capacity);
+  block->next = arena->blocks;
+  arena->blocks = block;
+  arena->next = block->data;
+  arena->end = block->data + capacity;
+  arena->reserved += sizeof(struct ArenaBlock) + capacity;
+}
+
+// align is a power of two no larger than max_align_t
+static void* bump(struct Arena* arena, size_t size, size_t align){
+  uintptr_t start = ((uintptr_t)arena->next + align - 1) & ~(uintptr_t)(align - 1);
+  if (arena->next == NULL || start + size > (uintptr_t)arena->end){
+    add_block(arena, size);
+    start = (uintptr_t)arena->next;
+  }
+  arena->next = (char*)(start + size);
+  return (void*)start;
+}
+
+void* arena_alloc(struct Arena* arena, size_t size){
+  return bump(arena, size, alignof(max_align_t));
+}
+
+char* arena_strndup(struct Arena* arena, char const* text, size_t len){
+  // text needs no alignment, so short names pack tightly
+  char* copy = bump(arena, len + 1, 1);
+  memcpy(copy, text, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+size_t arena_footprint(const struct Arena* arena){
+  if (arena == NULL) return 0;
+  return sizeof(struct Arena) + arena->reserved;
+}
+
+void destroy_arena(struct Arena* arena){
+  if (arena == NULL) return;
+  struct ArenaBlock* block = arena->blocks;
+  while (block != NULL){
+    struct ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(arena);
+}
@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// chunks of arena memory, newest first
+struct ArenaBlock;
+
+// Purpose: Bump-pointer allocator for objects that all die together.
+// Invariants/Assumptions: Allocations are never freed one by one and never
+//                         move; destroy_arena releases all of them at once.
+struct Arena {
+  struct ArenaBlock* blocks;
+  char* next;             // first free byte of the newest block
+  char* end;              // one past the newest block
+  size_t block_size;
+  size_t reserved;        // bytes held by all blocks
+};
+
+// Purpose: Create an empty arena.
+// Inputs: block_size is the size of each chunk; larger requests get their own.
+struct Arena* create_arena(size_t block_size);
+
+// Purpose: Allocate size bytes aligned for any object.
+// Outputs: Returns uninitialized memory that lives until destroy_arena.
+void* arena_alloc(struct Arena* arena, size_t size);
+
+// Purpose: Copy len bytes of text into the arena and NUL terminate them.
+char* arena_strndup(struct Arena* arena, char const* text, size_t len);
+
+// Purpose: Bytes held by the arena, including the unused end of each block.
+size_t arena_footprint(const struct Arena* arena);
+
+void destroy_arena(struct Arena* arena);
+
+#endif  // ARENA_H
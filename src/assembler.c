@@ -2,63 +2,39 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <assert.h>
 #include <string.h>
 
 #include "slice.h"
 #include "assembler.h"
+#include "char_class.h"
+#include "context.h"
 #include "hashmap.h"
 #include "instruction_array.h"
 #include "label_list.h"
+#include "mem_stats.h"
 #include "preprocessor.h"
 #include "elf.h"
 #include "debug.h"
+#include "diagnostic.h"
+#include "directive.h"
+#include "mnemonic.h"
+#include "lexer.h"
+#include "token_array.h"
+#include "fixup_array.h"
+#include "scope.h"
+#include "symbol.h"
 
 /*
   Two-pass assembler.
+  Each preprocessed file is lexed once into a token array.
   First pass calculates addresses of labels
-  Second pass converts to text into binary
-*/
+  Second pass converts the same tokens into binary
 
-char const * current;
-char const * current_buffer_start = NULL;
-unsigned line_count = 1;
-unsigned long pc = 0;
-unsigned entry_point = 0;
-
-enum UserSection current_section = -1;
-struct InstructionArray* text_instruction_array = NULL;
-struct InstructionArray* rodata_instruction_array = NULL;
-struct InstructionArray* data_instruction_array = NULL;
-static struct InstructionArray* section_arrays[SECTION_COUNT];
-unsigned bss_size = 0;
-static uint32_t section_offsets[SECTION_COUNT];
-static uint32_t section_sizes[SECTION_COUNT];
-static uint32_t section_bases[SECTION_COUNT];
-static uint32_t section_load_bases[SECTION_COUNT];
-static bool section_load_set[SECTION_COUNT];
-
-static struct DebugInfoList* debug_info_list = NULL;
-
-// does the file wish to use pivileges instructions?
-bool is_kernel = false;
-
-char const * current_file;
-int current_file_index;
-int pass_number = 1;
-
-// Map labels/defines to their addresses or values.
-// local_labels: per-file label table used for local resolution and duplicate checks.
-// local_defines: per-file .define table to resolve constants without polluting globals.
-// local_globals: per-file set of labels declared with .global (used to validate global duplication).
-// global_labels: shared table of labels exported across files via .global.
-static struct HashMap** local_labels;
-static struct HashMap** local_defines;
-static struct HashMap** local_globals;
-static struct HashMap* global_labels;
-static int cli_define_count = 0;
-static const char* const* cli_defines = NULL;
+  Single-pass mode skips the first pass: labels are recorded as they are
+  reached, every label immediate is emitted as zero with a fixup, and the
+  fixups are patched once section sizes (and so addresses) are known.
+*/
 
 // Byte sizing for directive accounting and output packing.
 static const uint32_t kWordBytes = 4;
@@ -69,14 +45,14 @@ static const uint32_t kByteBytes = 1;
 #define SECTION_ALIGN 0x1000u
 static const uint32_t kKernelSectionAlign = 512;
 
-static void reset_section_offsets(void) {
-  for (int i = 0; i < SECTION_COUNT; ++i) section_offsets[i] = 0;
+static void reset_section_offsets(struct AssemblerContext* ctx) {
+  for (int i = 0; i < SECTION_COUNT; ++i) ctx->section_offsets[i] = 0;
 }
 
-static void reset_section_load_bases(void) {
+static void reset_section_load_bases(struct AssemblerContext* ctx) {
   for (int i = 0; i < SECTION_COUNT; ++i) {
-    section_load_bases[i] = 0;
-    section_load_set[i] = false;
+    ctx->section_load_bases[i] = 0;
+    ctx->section_load_set[i] = false;
   }
 }
 
@@ -86,27 +62,55 @@ static uint32_t align_up(uint32_t value, uint32_t align) {
   return value + (align - rem);
 }
 
+static uint64_t encode_section_offset(enum UserSection section, uint32_t offset) {
+  // Pack section + offset for pass 1; resolved to absolute addresses after layout.
+  return ((uint64_t)section << 32) | offset;
+}
+
+// Purpose: Convert a packed section offset into an absolute address.
+// Inputs: raw is a value produced by encode_section_offset.
+// Outputs: Returns the runtime address.
+// Invariants/Assumptions: finalize_section_load_bases has run.
+static uint32_t resolve_section_offset(struct AssemblerContext* ctx, uint64_t raw) {
+  enum UserSection section = (enum UserSection)(raw >> 32);
+  uint32_t offset = (uint32_t)(raw & 0xFFFFFFFFu);
+  return ctx->section_load_bases[section] + offset;
+}
+
 // Purpose: Return the base address used for pc-relative computations.
 // Inputs: section selects the active section.
 // Outputs: Returns the runtime base for the section.
-// Invariants/Assumptions: section_load_bases is initialized before pass 2.
-static uint32_t section_pc_base(enum UserSection section){
-  return section_load_bases[section];
+// Invariants/Assumptions: section_load_bases is initialized before pass 2. The
+//                         single-pass walk runs before layout, so there pc
+//                         holds a packed section offset instead.
+static uint64_t section_pc_base(struct AssemblerContext* ctx, enum UserSection section){
+  if (ctx->single_pass && ctx->pass_number == 1) return encode_section_offset(section, 0);
+  return ctx->section_load_bases[section];
 }
 
 // Purpose: Check whether a section index is valid for the active mode.
 // Inputs: section is the current section index.
 // Outputs: Returns true when section is usable in the current mode.
 // Invariants/Assumptions: Kernel mode allows the implicit section; user mode does not.
-static bool is_section_in_range(enum UserSection section){
-  if (is_kernel){
+static bool is_section_in_range(struct AssemblerContext* ctx, enum UserSection section){
+  if (ctx->is_kernel){
     return section >= TEXT_SECTION && section <= IMPLICIT_SECTION;
   }
   return section >= TEXT_SECTION && section <= BSS_SECTION;
 }
 
 // Forward declaration for alignment parsing helpers.
-static long consume_define_or_literal(enum ConsumeResult* result, const char* context);
+static long consume_define_or_literal(struct AssemblerContext* ctx, enum ConsumeResult* result, const char* context);
+
+// Forward declaration for instruction encoders that accept label immediates.
+static int encode_immediate(struct AssemblerContext* ctx, enum FixupKind kind, long imm, bool* success);
+
+// Bits each fixup kind occupies in its instruction word.
+static const uint32_t kFixupFieldMasks[FIXUP_KIND_COUNT] = {
+#define X(kind, mask, encoder) [FIXUP_##kind] = mask,
+  ISA_IMMEDIATE_FIELDS(X)
+#undef X
+};
 
 // Purpose: Check whether a value is a power-of-two alignment.
 // Inputs: value is the candidate alignment in bytes.
@@ -120,25 +124,25 @@ static bool is_power_of_two_u32(uint32_t value){
 // Inputs: result is filled with FOUND/NOT_FOUND/ERROR; directive labels errors.
 // Outputs: Returns true on success and fills alignment_out.
 // Invariants/Assumptions: alignment_out is non-NULL.
-static bool parse_alignment(enum ConsumeResult* result, const char* directive,
+static bool parse_alignment(struct AssemblerContext* ctx, enum ConsumeResult* result, const char* directive,
                             uint32_t* alignment_out){
-  long imm = consume_define_or_literal(result, directive);
+  long imm = consume_define_or_literal(ctx, result, directive);
   if (*result != FOUND){
     if (*result == NOT_FOUND){
-      print_error();
-      fprintf(stderr, "Invalid %s value; expected integer literal or .define constant\n", directive);
+      print_error(ctx);
+      error_printf(ctx, "Invalid %s value; expected integer literal or .define constant\n", directive);
     }
     return false;
   }
   if (imm <= 0 || imm >= ((long)1 << 32)){
-    print_error();
-    fprintf(stderr, "%s value must be a positive 32-bit integer\n", directive);
+    print_error(ctx);
+    error_printf(ctx, "%s value must be a positive 32-bit integer\n", directive);
     return false;
   }
   uint32_t alignment = (uint32_t)imm;
   if (!is_power_of_two_u32(alignment)){
-    print_error();
-    fprintf(stderr, "%s value must be a power of two\n", directive);
+    print_error(ctx);
+    error_printf(ctx, "%s value must be a power of two\n", directive);
     return false;
   }
   *alignment_out = alignment;
@@ -149,50 +153,50 @@ static bool parse_alignment(enum ConsumeResult* result, const char* directive,
 // Inputs: section is the target section; directive is the directive name.
 // Outputs: Returns true on success; updates section_load_bases during pass 1.
 // Invariants/Assumptions: section_offsets reflect content emitted so far.
-static bool parse_section_load_directive(enum UserSection section, const char* directive){
-  if (!is_kernel){
-    print_error();
-    fprintf(stderr, "%s can only be used in kernel mode\n", directive);
+static bool parse_section_load_directive(struct AssemblerContext* ctx, enum UserSection section, const char* directive){
+  if (!ctx->is_kernel){
+    print_error(ctx);
+    error_printf(ctx, "%s can only be used in kernel mode\n", directive);
     return false;
   }
   enum ConsumeResult result;
-  long imm = consume_define_or_literal(&result, directive);
+  long imm = consume_define_or_literal(ctx, &result, directive);
   if (result != FOUND){
     if (result == NOT_FOUND){
-      print_error();
-      fprintf(stderr, "Invalid %s value; expected integer literal or .define constant\n", directive);
+      print_error(ctx);
+      error_printf(ctx, "Invalid %s value; expected integer literal or .define constant\n", directive);
     }
     return false;
   }
   if (imm < 0 || imm >= ((long)1 << 32)){
-    print_error();
-    fprintf(stderr, "%s address must be a 32-bit unsigned integer\n", directive);
+    print_error(ctx);
+    error_printf(ctx, "%s address must be a 32-bit unsigned integer\n", directive);
     return false;
   }
   uint32_t addr = (uint32_t)imm;
   if ((addr % kWordBytes) != 0){
-    print_error();
-    fprintf(stderr, "%s address must be %u-byte aligned\n", directive, kWordBytes);
+    print_error(ctx);
+    error_printf(ctx, "%s address must be %u-byte aligned\n", directive, kWordBytes);
     return false;
   }
 
-  if (pass_number == 1){
-    if (section_offsets[section] != 0){
-      print_error();
-      fprintf(stderr, "%s must appear before any content in that section\n", directive);
+  if (ctx->pass_number == 1){
+    if (ctx->section_offsets[section] != 0){
+      print_error(ctx);
+      error_printf(ctx, "%s must appear before any content in that section\n", directive);
       return false;
     }
-    if (section_load_set[section] && section_load_bases[section] != addr){
-      print_error();
-      fprintf(stderr, "%s specified multiple times with different values\n", directive);
+    if (ctx->section_load_set[section] && ctx->section_load_bases[section] != addr){
+      print_error(ctx);
+      error_printf(ctx, "%s specified multiple times with different values\n", directive);
       return false;
     }
-    section_load_bases[section] = addr;
-    section_load_set[section] = true;
+    ctx->section_load_bases[section] = addr;
+    ctx->section_load_set[section] = true;
   } else {
-    if (section_load_set[section] && section_load_bases[section] != addr){
-      print_error();
-      fprintf(stderr, "%s value does not match first pass\n", directive);
+    if (ctx->section_load_set[section] && ctx->section_load_bases[section] != addr){
+      print_error(ctx);
+      error_printf(ctx, "%s value does not match first pass\n", directive);
       return false;
     }
   }
@@ -213,631 +217,500 @@ static void encode_value_bytes(uint32_t value, uint8_t* out, uint32_t count){
 // Inputs: arr is the destination array; bytes/count describe the payload; section selects base/offset.
 // Outputs: section_offsets and pc are incremented by count bytes.
 // Invariants/Assumptions: section_bases are initialized and aligned.
-static void append_bytes_user(struct InstructionArray* arr, const uint8_t* bytes, uint32_t count,
+static void append_bytes_user(struct AssemblerContext* ctx, struct InstructionArray* arr,
+                              const uint8_t* bytes, uint32_t count,
                               enum UserSection section){
   for (uint32_t i = 0; i < count; ++i){
-    uint32_t abs_pc = section_bases[section] + section_offsets[section];
+    uint32_t abs_pc = ctx->section_bases[section] + ctx->section_offsets[section];
     instruction_array_append_byte(arr, bytes[i], (int)abs_pc);
-    section_offsets[section] += kByteBytes;
+    ctx->section_offsets[section] += kByteBytes;
   }
-  pc = section_pc_base(section) + section_offsets[section];
+  ctx->pc = section_pc_base(ctx, section) + ctx->section_offsets[section];
 }
 
 // Purpose: Append zero bytes into a section array and advance offsets.
 // Inputs: arr is the destination array; count is the number of zero bytes; section selects base/offset.
 // Outputs: section_offsets and pc are incremented by count bytes.
 // Invariants/Assumptions: section_bases are initialized and aligned.
-static void append_zero_bytes_user(struct InstructionArray* arr, uint32_t count, enum UserSection section){
+static void append_zero_bytes_user(struct AssemblerContext* ctx, struct InstructionArray* arr,
+                                   uint32_t count, enum UserSection section){
   for (uint32_t i = 0; i < count; ++i){
-    uint32_t abs_pc = section_bases[section] + section_offsets[section];
+    uint32_t abs_pc = ctx->section_bases[section] + ctx->section_offsets[section];
     instruction_array_append_byte(arr, 0, (int)abs_pc);
-    section_offsets[section] += kByteBytes;
+    ctx->section_offsets[section] += kByteBytes;
   }
-  pc = section_pc_base(section) + section_offsets[section];
+  ctx->pc = section_pc_base(ctx, section) + ctx->section_offsets[section];
 }
 
 // Purpose: Report misaligned instruction addresses with context.
 // Inputs: address is the misaligned byte address or section offset; label describes the address.
 // Outputs: Returns false after emitting an error.
 // Invariants/Assumptions: print_error has access to current file/line context.
-static bool report_instruction_alignment_error(uint32_t address, const char* label){
-  print_error();
-  fprintf(stderr, "Instruction address must be %u-byte aligned; %s is 0x%08X\n",
+static bool report_instruction_alignment_error(struct AssemblerContext* ctx, uint32_t address, const char* label){
+  print_error(ctx);
+  error_printf(ctx, "Instruction address must be %u-byte aligned; %s is 0x%08X\n",
           kWordBytes, label, address);
   return false;
 }
 
-static void compute_section_bases(void) {
-  section_bases[TEXT_SECTION] = USER_BASE_ADDR;
-  section_bases[RODATA_SECTION] = align_up(section_bases[TEXT_SECTION] + section_sizes[TEXT_SECTION], SECTION_ALIGN);
-  section_bases[DATA_SECTION] = align_up(section_bases[RODATA_SECTION] + section_sizes[RODATA_SECTION], SECTION_ALIGN);
-  section_bases[BSS_SECTION] = section_bases[DATA_SECTION] + section_sizes[DATA_SECTION];
+static void compute_section_bases(struct AssemblerContext* ctx) {
+  ctx->section_bases[TEXT_SECTION] = USER_BASE_ADDR;
+  ctx->section_bases[RODATA_SECTION] =
+    align_up(ctx->section_bases[TEXT_SECTION] + ctx->section_sizes[TEXT_SECTION], SECTION_ALIGN);
+  ctx->section_bases[DATA_SECTION] =
+    align_up(ctx->section_bases[RODATA_SECTION] + ctx->section_sizes[RODATA_SECTION], SECTION_ALIGN);
+  ctx->section_bases[BSS_SECTION] = ctx->section_bases[DATA_SECTION] + ctx->section_sizes[DATA_SECTION];
 }
 
 // Purpose: Compute kernel section bases with 512-byte padding between sections.
-// Inputs: None.
+// Inputs: ctx is the assembly being built.
 // Outputs: section_bases is filled for kernel sections, with implicit section first.
 // Invariants/Assumptions: section_sizes contains byte sizes for each section.
-static void compute_kernel_section_bases(void){
+static void compute_kernel_section_bases(struct AssemblerContext* ctx){
   uint32_t cursor = 0;
-  section_bases[IMPLICIT_SECTION] = cursor;
-  cursor += align_up(section_sizes[IMPLICIT_SECTION], kKernelSectionAlign);
+  ctx->section_bases[IMPLICIT_SECTION] = cursor;
+  cursor += align_up(ctx->section_sizes[IMPLICIT_SECTION], kKernelSectionAlign);
 
-  section_bases[TEXT_SECTION] = cursor;
-  cursor += align_up(section_sizes[TEXT_SECTION], kKernelSectionAlign);
+  ctx->section_bases[TEXT_SECTION] = cursor;
+  cursor += align_up(ctx->section_sizes[TEXT_SECTION], kKernelSectionAlign);
 
-  section_bases[RODATA_SECTION] = cursor;
-  cursor += align_up(section_sizes[RODATA_SECTION], kKernelSectionAlign);
+  ctx->section_bases[RODATA_SECTION] = cursor;
+  cursor += align_up(ctx->section_sizes[RODATA_SECTION], kKernelSectionAlign);
 
-  section_bases[DATA_SECTION] = cursor;
-  cursor += align_up(section_sizes[DATA_SECTION], kKernelSectionAlign);
+  ctx->section_bases[DATA_SECTION] = cursor;
+  cursor += align_up(ctx->section_sizes[DATA_SECTION], kKernelSectionAlign);
 
-  section_bases[BSS_SECTION] = cursor;
-  cursor += align_up(section_sizes[BSS_SECTION], kKernelSectionAlign);
+  ctx->section_bases[BSS_SECTION] = cursor;
+  cursor += align_up(ctx->section_sizes[BSS_SECTION], kKernelSectionAlign);
 
-  section_bases[END_SECTION] = cursor;
+  ctx->section_bases[END_SECTION] = cursor;
 }
 
 // Purpose: Finalize runtime section bases after sizes are known.
-// Inputs: None.
+// Inputs: ctx is the assembly being built.
 // Outputs: section_load_bases is filled for all sections.
 // Invariants/Assumptions: section_bases and section_sizes are initialized.
-static void finalize_section_load_bases(void){
+static void finalize_section_load_bases(struct AssemblerContext* ctx){
   for (int i = 0; i < SECTION_COUNT; ++i){
-    if (!section_load_set[i]) section_load_bases[i] = section_bases[i];
+    if (!ctx->section_load_set[i]) ctx->section_load_bases[i] = ctx->section_bases[i];
   }
-  if (is_kernel && section_load_set[BSS_SECTION]){
-    uint32_t bss_padded = align_up(section_sizes[BSS_SECTION], kKernelSectionAlign);
-    section_load_bases[END_SECTION] = section_load_bases[BSS_SECTION] + bss_padded;
+  if (ctx->is_kernel && ctx->section_load_set[BSS_SECTION]){
+    uint32_t bss_padded = align_up(ctx->section_sizes[BSS_SECTION], kKernelSectionAlign);
+    ctx->section_load_bases[END_SECTION] = ctx->section_load_bases[BSS_SECTION] + bss_padded;
   }
 }
 
-static uint64_t encode_section_offset(enum UserSection section, uint32_t offset) {
-  // Pack section + offset for pass 1; resolved to absolute addresses after layout.
-  return ((uint64_t)section << 32) | offset;
-}
-
-static void adjust_label_map_for_sections(struct HashMap* map) {
+static void adjust_label_map_for_sections(struct AssemblerContext* ctx, struct HashMap* map) {
   // Convert packed section offsets into absolute addresses once section sizes are known.
-  for (size_t i = 0; i < map->size; ++i){
-    struct HashEntry* entry = map->arr[i];
-    while (entry != NULL){
-      if (entry->is_defined){
-        uint64_t raw = (uint64_t)entry->value;
-        enum UserSection section = (enum UserSection)(raw >> 32);
-        uint32_t offset = (uint32_t)(raw & 0xFFFFFFFFu);
-        entry->value = (long)(section_load_bases[section] + offset);
-      }
-      entry = entry->next;
+  size_t cursor = 0;
+  struct HashEntry* entry;
+  while ((entry = hash_map_next(map, &cursor)) != NULL){
+    if (entry->is_defined){
+      entry->value = (long)resolve_section_offset(ctx, (uint64_t)entry->value);
     }
   }
 }
 
-static bool ensure_valid_section(const char* context) {
-  if (!is_section_in_range(current_section)) {
-    print_error();
+static bool ensure_valid_section(struct AssemblerContext* ctx, const char* context) {
+  if (!is_section_in_range(ctx, ctx->current_section)) {
+    print_error(ctx);
     if (strcmp(context, "label") == 0) {
-      fprintf(stderr, "Label defined while not in any section\n");
+      error_printf(ctx, "Label defined while not in any section\n");
     } else if (strcmp(context, "instruction") == 0) {
-      fprintf(stderr, "cannot use instructions while not in any section\n");
+      error_printf(ctx, "cannot use instructions while not in any section\n");
     } else {
-      fprintf(stderr, "cannot use %s while not in any section\n", context);
+      error_printf(ctx, "cannot use %s while not in any section\n", context);
     }
     return false;
   }
   return true;
 }
 
-static bool is_identifier_char(char c) {
-  return isalnum((unsigned char)c) || c == '_' || c == '.';
-}
-
 static bool is_valid_define_name(const char* start, size_t len) {
   if (len == 0) return false;
-  if (!isalpha((unsigned char)start[0]) && start[0] != '_') return false;
+  if (!char_is(start[0], CHAR_IDENT_START)) return false;
   for (size_t i = 1; i < len; ++i){
-    if (!is_identifier_char(start[i])) return false;
+    if (!char_is(start[i], CHAR_IDENT_BODY)) return false;
   }
   return true;
 }
 
-void set_cli_defines(int count, const char* const* defines){
-  cli_define_count = count;
-  cli_defines = defines;
+void set_single_pass(struct AssemblerContext* ctx, bool enabled){
+  ctx->single_pass = enabled;
 }
 
-static bool apply_cli_defines(void){
-  if (cli_define_count <= 0) return true;
-  for (int i = 0; i < cli_define_count; ++i){
-    const char* def = cli_defines[i];
-    const char* eq = strchr(def, '=');
-    if (eq == NULL || eq == def || *(eq + 1) == '\0'){
-      fprintf(stderr, "Invalid -D definition: %s\n", def);
-      return false;
-    }
-    size_t name_len = (size_t)(eq - def);
-    if (!is_valid_define_name(def, name_len)){
-      fprintf(stderr, "Invalid -D name: %.*s\n", (int)name_len, def);
-      return false;
-    }
-
-    struct Slice name_view = {def, name_len};
-    if (hash_map_contains(local_defines[current_file_index], &name_view)){
-      fprintf(stderr, "constant has multiple definitions\n");
-      return false;
-    }
-
-    const char* old_current = current;
-    const char* old_buffer = current_buffer_start;
-    unsigned old_line = line_count;
-    const char* old_file = current_file;
-
-    current = eq + 1;
-    current_buffer_start = current;
-    line_count = 1;
-    current_file = "<command line>";
-
-    enum ConsumeResult result;
-    long value = consume_literal(&result);
-    skip();
-    bool ok = (result == FOUND) && (*current == '\0');
+void set_cli_defines(struct AssemblerContext* ctx, int count, const char* const* defines){
+  ctx->cli_define_count = count;
+  ctx->cli_defines = defines;
+}
 
-    current = old_current;
-    current_buffer_start = old_buffer;
-    line_count = old_line;
-    current_file = old_file;
+// Purpose: Check one -D definition and parse its value.
+// Outputs: Returns false after reporting an invalid or repeated definition.
+// Invariants/Assumptions: The scanner is positioned on def, so diagnostics quote it.
+static bool parse_cli_define(struct AssemblerContext* ctx, const char* def, struct HashMap* defines,
+  struct CliDefine* out){
+  const char* eq = strchr(def, '=');
+  if (eq == NULL || eq == def || *(eq + 1) == '\0'){
+    print_error(ctx);
+    error_printf(ctx, "Invalid -D definition: %s\n", def);
+    return false;
+  }
+  size_t name_len = (size_t)(eq - def);
+  if (!is_valid_define_name(def, name_len)){
+    print_error(ctx);
+    error_printf(ctx, "Invalid -D name: %.*s\n", (int)name_len, def);
+    return false;
+  }
 
-    if (!ok){
-      fprintf(stderr, "Invalid -D value for %.*s\n", (int)name_len, def);
-      return false;
-    }
+  uint32_t name = intern_symbol(ctx->symbols, def, name_len);
+  if (hash_map_contains(defines, name)){
+    print_error(ctx);
+    error_printf(ctx, "constant has multiple definitions\n");
+    return false;
+  }
 
-    struct Slice* label = malloc(sizeof(struct Slice));
-    label->start = def;
-    label->len = name_len;
-    hash_map_insert(local_defines[current_file_index], label, value, true, true);
+  ctx->current = eq + 1;
+  enum ConsumeResult result;
+  long value = consume_literal(ctx, &result);
+  skip(ctx);
+  if (result != FOUND || *ctx->current != '\0'){
+    ctx->current = def;
+    print_error(ctx);
+    error_printf(ctx, "Invalid -D value for %.*s\n", (int)name_len, def);
+    return false;
   }
+
+  hash_map_insert(defines, name, value, true, true);
+  out->symbol = name;
+  out->value = value;
   return true;
 }
 
-static bool consume_named_register(const char* name) {
-  size_t len = strlen(name);
-  if (strncmp(current, name, len) == 0 && !is_identifier_char(current[len])) {
-    current += len;
+// Purpose: Enter the -D definitions into the define table of the current file.
+// Outputs: Returns false after reporting every invalid or repeated definition;
+//          each one counts as an error.
+// Invariants/Assumptions: The strings are parsed by the first file only; later
+//                         files copy cli_define_values.
+static bool apply_cli_defines(struct AssemblerContext* ctx){
+  if (ctx->cli_define_count <= 0) return true;
+  struct HashMap* defines = ctx->local_defines[ctx->current_file_index];
+  if (ctx->cli_define_values != NULL){
+    for (int i = 0; i < ctx->cli_define_count; ++i){
+      hash_map_insert(defines, ctx->cli_define_values[i].symbol, ctx->cli_define_values[i].value, true, true);
+    }
     return true;
   }
-  return false;
-}
 
-// print line causing an error
-void print_error(void) {
-  // avoid printing this twice
-  static bool has_printed = false;
+  const char* old_current = ctx->current;
+  const char* old_buffer = ctx->current_buffer_start;
+  const char* old_file = ctx->current_file;
+  int old_file_index = ctx->current_file_index;
+  // diagnostics quote the definition and sort after those of the source files
+  ctx->current_file = "<command line>";
+  ctx->current_file_index = kDiagnosticNoFile;
 
-  if (!has_printed){
-    fprintf(stderr, "Error in %s\nline %u: \"", current_file, line_count);
-    
-    // get start and end of line
-    char const * start = current;
-    char const * buffer_start = current_buffer_start != NULL ? current_buffer_start : current;
-    while (start > buffer_start && *(start - 1) != '\0' && *(start - 1) != '\n') start--;
-    char const * end = current;
-    while (*end != '\0' && *end != '\n') end++;
-    
-    // remove whitespace at beginning and end
-    while (isspace(*start)) start++;
-    while (isspace(*(end - 1))) end--;
+  struct CliDefine* values = malloc((size_t)ctx->cli_define_count * sizeof(struct CliDefine));
+  bool ok = true;
+  for (int i = 0; i < ctx->cli_define_count; ++i){
+    const char* def = ctx->cli_defines[i];
+    ctx->current = def;
+    set_current_buffer(ctx, def);
+    if (!parse_cli_define(ctx, def, defines, &values[i])){
+      ok = false;
+      if (!finish_error(ctx)) break;
+    }
+  }
+
+  ctx->current = old_current;
+  set_current_buffer(ctx, old_buffer);
+  ctx->current_file = old_file;
+  ctx->current_file_index = old_file_index;
 
-    // print the line
-    struct Slice unrecognized = {start, end - start};
-    print_slice_err(&unrecognized);
-    fprintf(stderr, "\"\n");
-    has_printed = true;
+  if (!ok){
+    free(values);
+    return false;
   }
+  ctx->cli_define_values = values;
+  return true;
 }
 
-static void print_warning(const char* message) {
-  fprintf(stderr, "Warning in %s\nline %u: \"", current_file, line_count);
+/*
+  Token cursor.
+  Both passes walk the token array of the current file. current is kept at the
+  start of the cursor token so print_error reports the line being parsed.
+*/
 
-  char const * start = current;
-  char const * buffer_start = current_buffer_start != NULL ? current_buffer_start : current;
-  while (start > buffer_start && *(start - 1) != '\0' && *(start - 1) != '\n') start--;
-  char const * end = current;
-  while (*end != '\0' && *end != '\n') end++;
+// Purpose: Position the cursor at the first token of a file.
+// Inputs: tokens is the token array produced by tokenize.
+// Outputs: None.
+// Invariants/Assumptions: tokens ends with TOKEN_EOF.
+static void start_tokens(struct AssemblerContext* ctx, const struct TokenArray* tokens){
+  ctx->tok = tokens->tokens;
+  ctx->token_source = tokens->source;
+  set_current_buffer(ctx, tokens->source);
+  ctx->current = ctx->token_source + ctx->tok->offset;
+}
 
-  while (isspace(*start)) start++;
-  while (end > start && isspace(*(end - 1))) end--;
+// Purpose: Move the cursor to the next token.
+// Inputs: ctx is the assembly being built.
+// Outputs: None.
+// Invariants/Assumptions: The cursor is not at TOKEN_EOF.
+static void advance(struct AssemblerContext* ctx){
+  ctx->tok++;
+  ctx->current = ctx->token_source + ctx->tok->offset;
+}
 
-  struct Slice unrecognized = {start, end - start};
-  print_slice_err(&unrecognized);
-  fprintf(stderr, "\"\n");
-  fprintf(stderr, "%s\n", message);
+// Purpose: Move the cursor back to a token saved earlier on the same line.
+static void rewind_to(struct AssemblerContext* ctx, const struct Token* saved){
+  ctx->tok = saved;
+  ctx->current = ctx->token_source + ctx->tok->offset;
 }
 
-// Allocate a Slice wrapper for shared source buffers so each map owns its key.
-static struct Slice* clone_slice(const struct Slice* slice) {
-  struct Slice* copy = malloc(sizeof(struct Slice));
-  copy->start = slice->start;
-  copy->len = slice->len;
-  return copy;
+static bool token_is(struct AssemblerContext* ctx, const struct Token* token, const char* text){
+  size_t len = strlen(text);
+  return token->len == len && strncmp(ctx->token_source + token->offset, text, len) == 0;
 }
 
-// is the rest of the file just whitespace?
-bool is_at_end(void) {
-  while (isspace(*current)) {
-    if (*current == '\n') line_count++;
-    current += 1;
-  }
-  if (*current != 0) return false;
-  else return true;
+// Purpose: View a token's text; the slice borrows the token source buffer.
+static struct Slice token_slice(struct AssemblerContext* ctx, const struct Token* token){
+  struct Slice slice = {ctx->token_source + token->offset, token->len};
+  return slice;
 }
 
-// skip whitespace and commas until end of line or non-whitespace character
-void skip(void) {
-  while ((isspace(*current) && *current != '\n') || *current == ',' || *current == ';') {
-    current++;
-  }
+// returned by the accept_* functions when nothing matched
+static const struct Slice kNoSlice = {NULL, 0};
+
+// is the rest of the file just whitespace?
+static bool at_end(struct AssemblerContext* ctx){
+  while (ctx->tok->kind == TOKEN_NEWLINE) advance(ctx);
+  return ctx->tok->kind == TOKEN_EOF;
 }
 
 // skip until we get to a new nonempty line
-void skip_newline(void) {
-  while (isspace(*current)) {
-    if (*current == '\n') line_count++;
-    current++;
-  }
+static void skip_newlines(struct AssemblerContext* ctx){
+  while (ctx->tok->kind == TOKEN_NEWLINE) advance(ctx);
 }
 
 // skip an entire line
-void skip_line(void){
-  while (*current != '\n' && *current != '\0') current++; 
-  skip_newline();
-}
-
-// attempt to consume a string, has no effect if a match is not found
-bool consume(const char* str) {
-  skip();
-  size_t i = 0;
-  while (true) {
-    char const expected = str[i];
-    char const found = current[i];
-    if (expected == 0) {
-      /* survived to the end of the expected string */
-      current += i;
-      return true;
-    }
-    if (expected != found) {
-      return false;
-    }
-    i += 1;
-  } 
+static void skip_rest_of_line(struct AssemblerContext* ctx){
+  while (ctx->tok->kind != TOKEN_NEWLINE && ctx->tok->kind != TOKEN_EOF) advance(ctx);
+  skip_newlines(ctx);
 }
 
-// Classify characters that can appear inside assembler identifiers
-static bool is_identifier_body_char(char c){
-  return isalnum((unsigned char)c) || c == '_' || c == '.';
-}
-
-// attempt to consume a keyword, has no effect if a match is not found
-// differs from consume because we ensure token boundaries on both sides
-bool consume_keyword(const char* str) {
-  // skip is handled by caller so that this function is useful for preprocesser/macros
-  if (current != current_buffer_start &&
-      is_identifier_body_char(current[-1])) {
-    return false;
-  }
-
-  size_t i = 0;
-  while (true) {
-    char const expected = str[i];
-    char const found = current[i];
-    if (expected == 0) {
-      /* survived to the end of the expected string */
-      if (isspace((unsigned char)found) || found == '\0' ||
-          found == ',' || found == ';' || found == ':') {
-        // word break
-        current += i;
-        return true;
-      } else {
-        // this is actually an identifier
-        return false;
-      }
-    }
-    if (expected != found) {
-      return false;
-    }
-    i += 1;
-  } 
+// attempt to consume a token with the given text, has no effect if a match is not found
+static bool accept(struct AssemblerContext* ctx, const char* text){
+  if (ctx->tok->kind == TOKEN_NEWLINE || ctx->tok->kind == TOKEN_EOF) return false;
+  if (!token_is(ctx, ctx->tok, text)) return false;
+  advance(ctx);
+  return true;
 }
 
 // attempt to consume an identifier, has no effect if a match is not found
-struct Slice* consume_identifier(void) {
-  skip();
-  size_t i = 0;
-  // identifiers begin with a letter or underscore
-  if (isalpha((unsigned char)current[i]) || current[i] == '_') {
-    do {
-      i += 1;
-      // then followed by letters, number, underscores, and periods
-    } while(is_identifier_body_char(current[i]));
-
-    struct Slice* slice = malloc(sizeof(struct Slice));
-    slice->start = current;
-    slice->len = i;
-    current += i;
-
-    return slice;
-  } else {
-    return NULL;
-  }
+static struct Slice accept_identifier(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_IDENTIFIER) return kNoSlice;
+  struct Slice slice = token_slice(ctx, ctx->tok);
+  advance(ctx);
+  return slice;
 }
 
 // attempt to consume a filename, has no effect if a match is not found
-struct Slice* consume_filename(void) {
-  skip();
-  size_t i = 0;
-  // Debug file names may be relative or absolute and are emitted without
-  // quotes. Consume until the next whitespace or statement separator.
-  if (current[i] != '\0' && !isspace(current[i]) && current[i] != ',' && current[i] != ';') {
-    do {
-      i += 1;
-    } while(current[i] != '\0' && !isspace(current[i]) && current[i] != ',' && current[i] != ';');
-
-    struct Slice* slice = malloc(sizeof(struct Slice));
-    slice->start = current;
-    slice->len = i;
-    current += i;
-
-    return slice;
-  } else {
-    return NULL;
-  }
+static struct Slice accept_filename(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_FILENAME) return kNoSlice;
+  struct Slice slice = token_slice(ctx, ctx->tok);
+  advance(ctx);
+  return slice;
 }
 
-// label is an identifier followed by a colon
-struct Slice* consume_label(void){
-  skip();
-  char const * old_current = current;
-  struct Slice* label = consume_identifier();
-  if (consume(":")) return label;
-
-  // undo side effects
-  if (label != NULL) free(label);
-  current = old_current;
-  return NULL;
+// Purpose: Consume an identifier and return its symbol id.
+// Outputs: Returns NO_SYMBOL, with no side effects, when the cursor is not at an identifier.
+// Invariants/Assumptions: tokenize interned every identifier into its token value.
+static uint32_t accept_symbol(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_IDENTIFIER) return NO_SYMBOL;
+  uint32_t symbol = (uint32_t)ctx->tok->value;
+  advance(ctx);
+  return symbol;
 }
 
 // label is an identifier followed by a colon
-bool skip_label(struct InstructionArrayList* instructions){
-  skip();
-  char const * old_current = current;
-  struct Slice* label = consume_identifier();
-  if (label != NULL && consume(":")) {
-    free(label);
-    return true;
-  }
-
-  // undo side effects
-  if (label != NULL) free(label);
-  current = old_current;
-  return false;
+static uint32_t accept_label(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_IDENTIFIER) return NO_SYMBOL;
+  if (ctx->tok[1].kind != TOKEN_PUNCT || !token_is(ctx, &ctx->tok[1], ":")) return NO_SYMBOL;
+  uint32_t label = accept_symbol(ctx);
+  advance(ctx);
+  return label;
 }
 
-// attempt to consume a register
-int consume_register(void) {
-  skip();
-
-  if (consume_named_register("sp")) return 31;
-  else if (consume_named_register("bp")) return 30;
-  else if (consume_named_register("ra")) return 29;
-
-  // registers begin with an r
-  else if (current[0] == 'r' && isdigit((unsigned char)current[1])) {
-    int v = 0;
-    size_t i = 1;
-    while(isdigit((unsigned char)current[i])) {
-      // then followed by numbers
-      v = 10 * v + current[i] - '0';
-      i += 1;
-    }
+// label is an identifier followed by a colon
+static bool skip_label(struct AssemblerContext* ctx){
+  return accept_label(ctx) != NO_SYMBOL;
+}
 
-    if (v > 31 || is_identifier_char(current[i])) return -1;
-    current += i;
-    return v;
-  }
-  else return -1;
+static void print_symbol_err(struct AssemblerContext* ctx, uint32_t symbol){
+  struct Slice name = symbol_name(ctx->symbols, symbol);
+  error_printf(ctx, "%.*s", (int)name.len, name.start);
 }
 
-// attempt to consume a control register
-int consume_control_register(void) {
-  skip();
-  // registers begin with an r
-  if (current[0] == 'c' && current[1] == 'r' && isdigit((unsigned char)current[2])) {
-    int v = 0;
-    size_t i = 2;
-    while(isdigit((unsigned char)current[i])) {
-      // then followed by numbers
-      v = 10 * v + current[i] - '0';
-      i += 1;
-    }
-
-    if (v > 12 || is_identifier_char(current[i])) return -1;
-    current += i;
-    return v;
-  } else {
-    if (consume_named_register("psr")) return 0;
-    else if (consume_named_register("pid")) return 1;
-    else if (consume_named_register("isr")) return 2;
-    else if (consume_named_register("imr")) return 3;
-    else if (consume_named_register("epc")) return 4;
-    else if (consume_named_register("flg")) return 5;
-    else if (consume_named_register("efg")) return 6;
-    else if (consume_named_register("tlba")) return 7;
-    else if (consume_named_register("ksp")) return 8;
-    else if (consume_named_register("cid")) return 9;
-    else if (consume_named_register("mbi")) return 10;
-    else if (consume_named_register("mbo")) return 11;
-    else if (consume_named_register("tlbf")) return 12;
-    else return -1;
+// attempt to consume an integer literal
+static long accept_literal(struct AssemblerContext* ctx, enum ConsumeResult* result){
+  if (ctx->tok->kind == TOKEN_BAD_LITERAL){
+    // rescan so the literal's own diagnostic is printed in parse order
+    ctx->current = ctx->token_source + ctx->tok->offset;
+    consume_literal(ctx, result);
+    ctx->current = ctx->token_source + ctx->tok->offset;
+    return 0;
+  }
+  if (ctx->tok->kind != TOKEN_INTEGER){
+    *result = NOT_FOUND;
+    return 0;
   }
+  long value = ctx->tok->value;
+  advance(ctx);
+  *result = FOUND;
+  return value;
 }
 
-// attempt to consume an integer literal
-long consume_literal(enum ConsumeResult* result) {
-  skip();
-  bool negate = false;
-  char const * old_current = current;
-  if (*current == '-') {
-    negate = true;
-    current++;
-    skip();
-  }
-
-  // edge case for zero literal
-  // (only time leading 0 is allowed)
-  if (*current == '0' && 
-    (isspace(*(current + 1)) || *(current + 1) == '\0'
-      || *(current + 1) == ']' || *(current + 1) == '#')){
-      *result = FOUND;
-      current++;
-      return 0;
+// Purpose: Parse the digits of a numbered register name such as r12 or cr3.
+// Inputs: token is an identifier; prefix_len is the length of "r" or "cr".
+// Outputs: Returns the register number, or -1 when the name is not numbered or exceeds max.
+static int numbered_register(struct AssemblerContext* ctx, const struct Token* token, size_t prefix_len, int max){
+  const char* text = ctx->token_source + token->offset;
+  if (token->len <= prefix_len) return -1;
+  int v = 0;
+  for (size_t i = prefix_len; i < token->len; ++i){
+    if (!char_is(text[i], CHAR_DIGIT)) return -1;
+    v = 10 * v + text[i] - '0';
+    if (v > max) return -1;
   }
+  return v;
+}
 
-  if (isdigit(*current) && *current != '0') {
-    // decimal literal
-    long v = 0;
-    do {
-      v = 10*v + ((*current) - '0');
-      current += 1;
-    } while (isdigit(*current));
+// attempt to consume a register
+static int accept_register(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_IDENTIFIER) return -1;
 
-    *result = FOUND;
-    if (negate) v *= -1;
-    return v;
-  } else if (*current == '0' && (*(current + 1) == 'b' || *(current + 1) == 'B')) {
-    // Binary literal
-    current += 2;
-    long v = 0;
-    bool saw_digit = false;
-    while (isdigit((unsigned char)*current)) {
-      saw_digit = true;
-      if ((*current) - '0' > 1){
-        print_error();
-        fprintf(stderr, "Invalid binary literal\n");
-        *result = ERROR;
-        return 0;
-      }
-      v = 2*v + ((*current) - '0');
-      current += 1;
-    }
+  int v;
+  if (token_is(ctx, ctx->tok, "sp")) v = 31;
+  else if (token_is(ctx, ctx->tok, "bp")) v = 30;
+  else if (token_is(ctx, ctx->tok, "ra")) v = 29;
+  // registers begin with an r, then followed by numbers
+  else if (ctx->token_source[ctx->tok->offset] == 'r') v = numbered_register(ctx, ctx->tok, 1, 31);
+  else v = -1;
 
-    if (!saw_digit){
-      print_error();
-      fprintf(stderr, "Binary literal requires at least one digit\n");
-      *result = ERROR;
-      return 0;
-    }
+  if (v != -1) advance(ctx);
+  return v;
+}
 
-    *result = FOUND;
-    if (negate) v *= -1;
-    return v;
-  } else if (*current == '0' && (*(current + 1) == 'o' || *(current + 1) == 'O')) {
-    current += 2;
-    // octal literal
-    long v = 0;
-    bool saw_digit = false;
-    while (isdigit((unsigned char)*current)) {
-      saw_digit = true;
-      if ((*current) - '7' > 0){
-        print_error();
-        fprintf(stderr, "Invalid octal literal\n");
-        *result = ERROR;
-        return 0;
-      }
-      v = 8*v + ((*current) - '0');
-      current += 1;
-    }
+// Names of the control registers, indexed by register number
+static const char* const kControlRegisterNames[] = {
+  "psr", "pid", "isr", "imr", "epc", "flg", "efg",
+  "tlba", "ksp", "cid", "mbi", "mbo", "tlbf",
+};
 
-    if (!saw_digit){
-      print_error();
-      fprintf(stderr, "Octal literal requires at least one digit\n");
-      *result = ERROR;
-      return 0;
-    }
+// attempt to consume a control register
+static int accept_control_register(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_IDENTIFIER) return -1;
 
-    *result = FOUND;
-    if (negate) v *= -1;
-    return v;
-  } else if (*current == '0' && (*(current + 1) == 'x' || *(current + 1) == 'X')) {
-    long v = 0;
-    current += 2;
-    bool saw_digit = false;
-    while (isalnum((unsigned char)*current)) {
-      int d;
-      if (isdigit(*current)){
-        d = *current - '0';
-      } else if (isupper(*current) && *current <= 'F'){
-        d = *current - 'A' + 10;
-      } else if (islower(*current) && *current <= 'f'){
-        d = *current - 'a' + 10;
-      } else {
-        print_error();
-        fprintf(stderr, "Invalid hex literal\n");
-        *result = ERROR;
-        return 0;
+  int v = -1;
+  const char* text = ctx->token_source + ctx->tok->offset;
+  if (text[0] == 'c' && text[1] == 'r'){
+    v = numbered_register(ctx, ctx->tok, 2, 12);
+  } else {
+    int count = (int)(sizeof(kControlRegisterNames) / sizeof(kControlRegisterNames[0]));
+    for (int i = 0; i < count; ++i){
+      if (token_is(ctx, ctx->tok, kControlRegisterNames[i])){
+        v = i;
+        break;
       }
-
-      saw_digit = true;
-      v = 16*v + d;
-      current += 1;
-    }
-
-    if (!saw_digit){
-      print_error();
-      fprintf(stderr, "Hex literal requires at least one digit\n");
-      *result = ERROR;
-      return 0;
     }
-
-    *result = FOUND;
-    if (negate) v *= -1; 
-    return v;
-  } else {
-    current = old_current;
-    *result = NOT_FOUND;
-    return 0;
   }
+
+  if (v != -1) advance(ctx);
+  return v;
+}
+
+// Purpose: Start a fixup for a label whose address is only known after layout.
+// Inputs: label is the symbol just consumed; kind is its encoding if already known,
+//         otherwise encode_immediate fills it in.
+// Outputs: Sets pending_fixup; the statement commits it once its site is known.
+// Invariants/Assumptions: Only used by the single-pass walk.
+static void defer_label(struct AssemblerContext* ctx, uint32_t label, enum FixupKind kind){
+  ctx->pending_fixup.kind = (uint8_t)kind;
+  ctx->pending_fixup.file_index = ctx->current_file_index;
+  ctx->pending_fixup.site = 0;
+  ctx->pending_fixup.symbol = label;
+  ctx->pending_fixup.is_define = false;
+  ctx->pending_fixup.define_value = 0;
+  // the label token was just consumed
+  ctx->pending_fixup.source = ctx->token_source + ctx->tok[-1].offset;
+  ctx->pending_fixup.debug_record = 0;
+  ctx->has_pending_fixup = true;
+}
+
+// Purpose: Record the pending label fixup at the site of the statement just parsed.
+// Inputs: site is the packed section offset of the emitted word or data.
+// Outputs: Appends to fixups and clears the pending fixup; no-op when none is pending.
+static void commit_pending_fixup(struct AssemblerContext* ctx, uint64_t site){
+  if (!ctx->has_pending_fixup) return;
+  ctx->pending_fixup.site = site;
+  fixup_array_append(ctx->fixups, &ctx->pending_fixup);
+  ctx->has_pending_fixup = false;
+}
+
+// Purpose: Defer a debug entry address until section layout is known.
+// Inputs: record is the index of the debug record just added; pc is its packed site.
+// Outputs: Appends a FIXUP_DEBUG_ADDR fixup.
+static void defer_debug_addr(struct AssemblerContext* ctx, size_t record){
+  struct Fixup fixup = {0};
+  fixup.kind = FIXUP_DEBUG_ADDR;
+  fixup.file_index = ctx->current_file_index;
+  fixup.site = ctx->pc;
+  fixup.debug_record = record;
+  fixup_array_append(ctx->fixups, &fixup);
+}
+
+// Purpose: Look up a .define constant of the current file.
+// Outputs: Returns false when the name is not defined; fills value otherwise.
+// Invariants/Assumptions: Pass 2 asks the scope; pass 1 sees the defines recorded so far.
+static bool lookup_define(struct AssemblerContext* ctx, uint32_t name, long* value){
+  if (ctx->scope != NULL){
+    const struct SymbolBinding* binding = scope_resolve(ctx->scope, ctx->current_file_index, name);
+    *value = binding->define_value;
+    return binding->is_define;
+  }
+  const struct HashEntry* entry = hash_map_find(ctx->local_defines[ctx->current_file_index], name);
+  if (entry == NULL) return false;
+  *value = entry->value;
+  return true;
 }
 
 // Purpose: Parse a numeric literal or a .define constant (no labels allowed).
 // Inputs: result is filled with FOUND/NOT_FOUND/ERROR; context labels the directive for errors.
 // Outputs: Returns the literal or constant value when FOUND; returns 0 otherwise.
 // Invariants/Assumptions: local_defines for the current file is initialized.
-static long consume_define_or_literal(enum ConsumeResult* result, const char* context) {
-  long imm = consume_literal(result);
+static long consume_define_or_literal(struct AssemblerContext* ctx, enum ConsumeResult* result, const char* context) {
+  long imm = accept_literal(ctx, result);
   if (*result != NOT_FOUND) return imm;
 
-  struct Slice* name = consume_identifier();
-  if (name == NULL) {
+  uint32_t name = accept_symbol(ctx);
+  if (name == NO_SYMBOL) {
     *result = NOT_FOUND;
     return 0;
   }
 
-  if (hash_map_contains(local_defines[current_file_index], name)) {
-    imm = hash_map_get(local_defines[current_file_index], name);
+  if (lookup_define(ctx, name, &imm)) {
     *result = FOUND;
   } else {
-    print_error();
+    print_error(ctx);
     if (context != NULL) {
-      fprintf(stderr, "%s constant \"", context);
+      error_printf(ctx, "%s constant \"", context);
     } else {
-      fprintf(stderr, "Constant \"");
+      error_printf(ctx, "Constant \"");
     }
-    print_slice_err(name);
-    fprintf(stderr, "\" has not been defined\n");
+    print_symbol_err(ctx, name);
+    error_printf(ctx, "\" has not been defined\n");
     *result = ERROR;
   }
 
-  free(name);
   return imm;
 }
 
@@ -845,93 +718,96 @@ static long consume_define_or_literal(enum ConsumeResult* result, const char* co
 // Inputs: result is filled with FOUND/NOT_FOUND/ERROR; context labels the directive for errors.
 // Outputs: Returns the literal, constant, or label address when FOUND; returns 0 otherwise.
 // Invariants/Assumptions: label maps are absolute-addressed in pass 2.
-static long consume_define_or_literal_or_label_abs(enum ConsumeResult* result,
+static long consume_define_or_literal_or_label_abs(struct AssemblerContext* ctx, enum ConsumeResult* result,
                                                    const char* context) {
-  long imm = consume_literal(result);
+  long imm = accept_literal(ctx, result);
   if (*result != NOT_FOUND) {
     return imm;
   }
 
-  struct Slice* name = consume_identifier();
-  if (name == NULL) {
+  uint32_t name = accept_symbol(ctx);
+  if (name == NO_SYMBOL) {
     *result = NOT_FOUND;
     return 0;
   }
 
-  if (hash_map_contains(local_defines[current_file_index], name)) {
-    imm = hash_map_get(local_defines[current_file_index], name);
+  if (lookup_define(ctx, name, &imm)) {
     *result = FOUND;
-    free(name);
     return imm;
   }
 
-  // Allow labels in pass 1 without forcing a definition yet.
-  if (pass_number == 1) {
+  // Single-pass mode writes the address once layout is known.
+  if (ctx->single_pass && ctx->pass_number == 1) {
+    defer_label(ctx, name, FIXUP_WORD);
     *result = FOUND;
-    free(name);
     return 0;
   }
 
-  if (label_has_definition(local_labels[current_file_index], name)) {
-    imm = hash_map_get(local_labels[current_file_index], name);
-    // Kernel labels are stored as offsets, so emit absolute addresses for .fill.
+  // Allow labels in pass 1 without forcing a definition yet.
+  if (ctx->pass_number == 1) {
     *result = FOUND;
-  } else if (label_has_definition(global_labels, name)) {
-    imm = hash_map_get(global_labels, name);
+    return 0;
+  }
+
+  const struct SymbolBinding* binding = scope_resolve(ctx->scope, ctx->current_file_index, name);
+  if (binding->kind == SYMBOL_LOCAL_LABEL || binding->kind == SYMBOL_GLOBAL_LABEL) {
     // Kernel labels are stored as offsets, so emit absolute addresses for .fill.
+    imm = binding->value;
     *result = FOUND;
   } else {
-    print_error();
+    print_error(ctx);
     if (context != NULL) {
-      fprintf(stderr, "%s constant/label \"", context);
+      error_printf(ctx, "%s constant/label \"", context);
     } else {
-      fprintf(stderr, "Constant/label \"");
+      error_printf(ctx, "Constant/label \"");
     }
-    print_slice_err(name);
-    fprintf(stderr, "\" has not been defined\n");
+    print_symbol_err(ctx, name);
+    error_printf(ctx, "\" has not been defined\n");
     *result = ERROR;
   }
 
-  free(name);
   return imm;
 }
 
-long consume_label_imm(enum ConsumeResult* result){
-  struct Slice* label = consume_identifier();
+long consume_label_imm(struct AssemblerContext* ctx, enum ConsumeResult* result){
+  uint32_t label = accept_symbol(ctx);
   long imm = 0;
-  if (label != NULL){
+  if (label != NO_SYMBOL){
+
+    if (ctx->single_pass && ctx->pass_number == 1) {
+      // even a .define is patched after layout, since a label of the same
+      // name defined later in the file takes priority, as in pass 2
+      defer_label(ctx, label, FIXUP_NONE);
+      long value;
+      if (lookup_define(ctx, label, &value)){
+        ctx->pending_fixup.is_define = true;
+        ctx->pending_fixup.define_value = value;
+      }
+      *result = FOUND;
+      return 0;
+    }
 
     // don't try to decode labels on first pass
-    if (pass_number == 1) {
+    if (ctx->pass_number == 1) {
       *result = FOUND;
-      free(label);
       return 0;
     }
 
-    if (label_has_definition(local_labels[current_file_index], label)){
-      imm = hash_map_get(local_labels[current_file_index], label) - pc - 4;
-
-      // If this label is global in this file, the global entry should match.
-      if (hash_map_contains(local_globals[current_file_index], label) &&
-          label_has_definition(global_labels, label))
-        assert(imm == hash_map_get(global_labels, label) - pc - 4);
-      
-      *result = FOUND;
-    } else if (label_has_definition(global_labels, label)){
-      imm = hash_map_get(global_labels, label) - pc - 4;
+    const struct SymbolBinding* binding = scope_resolve(ctx->scope, ctx->current_file_index, label);
+    if (binding->kind == SYMBOL_LOCAL_LABEL || binding->kind == SYMBOL_GLOBAL_LABEL){
+      imm = binding->value - ctx->pc - 4;
       *result = FOUND;
-    } else if (hash_map_contains(local_defines[current_file_index], label)){
-      imm = hash_map_get(local_defines[current_file_index], label);
+    } else if (binding->kind == SYMBOL_DEFINE){
+      // only defines that fold_defines left as names get here
+      imm = binding->value;
       *result = FOUND;
-      return imm;
     } else {
-      print_error();
-      fprintf(stderr, "Label \"");
-      print_slice_err(label);
-      fprintf(stderr, "\" has not been defined\n");
+      print_error(ctx);
+      error_printf(ctx, "Label \"");
+      print_symbol_err(ctx, label);
+      error_printf(ctx, "\" has not been defined\n");
       *result = ERROR;
     }
-    free(label);
   } else {
     *result = NOT_FOUND;
   }
@@ -939,15 +815,15 @@ long consume_label_imm(enum ConsumeResult* result){
 }
 
 // consume a literal immediate or label immediate
-long consume_immediate(enum ConsumeResult* result){
-  long imm = consume_label_imm(result);
+long consume_immediate(struct AssemblerContext* ctx, enum ConsumeResult* result){
+  long imm = consume_label_imm(ctx, result);
   if (*result == NOT_FOUND){
-    imm = consume_literal(result);
+    imm = accept_literal(ctx, result);
   }
   return imm;
 }
 
-int encode_bitwise_immediate(long imm, bool* success){
+int encode_bitwise_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (imm == (imm & 0xFF)){
     return imm;
   } else if (imm == (imm & 0xFF00)){
@@ -958,198 +834,194 @@ int encode_bitwise_immediate(long imm, bool* success){
     return (imm >> 24) | (3 << 8);
   } else {
     *success = false;
-    print_error();
-    fprintf(stderr, "Bitwise instruction immediate must be an 8 bit value, ");
-    fprintf(stderr, "shifted by 0, 8, 16, or 24 bits\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Bitwise instruction immediate must be an 8 bit value, ");
+    error_printf(ctx, "shifted by 0, 8, 16, or 24 bits\n");
+    error_printf(ctx, "Got %ld\n", imm);
     return 0;
   }
 }
 
-int encode_shift_immediate(long imm, bool* success){
+int encode_shift_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (0 <= imm && imm < 31){
     return imm;
   } else {
     *success = false;
-    print_error();
-    fprintf(stderr, "Shift instruction immediate must be in range 0 to 31\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Shift instruction immediate must be in range 0 to 31\n");
+    error_printf(ctx, "Got %ld\n", imm);
     return 0;
   }
 }
 
-int encode_arithmetic_immediate(long imm, bool* success){
+int encode_arithmetic_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (-(1 << 11) <= imm && imm < (1 << 11)){
     return imm & 0xFFF;
   } else {
-    print_error();
-    fprintf(stderr, "Arithmetic instruction immediate must be in range -2048 to 2047\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Arithmetic instruction immediate must be in range -2048 to 2047\n");
+    error_printf(ctx, "Got %ld\n", imm);
     *success = false;
     return 0;
   }
 }
 
+// Purpose: Emit one instruction word at the current section offset.
+// Outputs: Returns false after reporting a word that cannot go there.
+// Invariants/Assumptions: In pass 1 of two-pass mode the statement was checked
+//                         before parsing, so the word is only counted.
+static bool emit_instruction_word(struct AssemblerContext* ctx, int instruction){
+  if (!ctx->single_pass && ctx->pass_number == 1){
+    ctx->section_offsets[ctx->current_section] += kWordBytes;
+    ctx->pc = ctx->section_offsets[ctx->current_section];
+    return true;
+  }
+
+  if (ctx->current_section == BSS_SECTION){
+    print_error(ctx);
+    error_printf(ctx, "Instructions not allowed in .bss section\n");
+    return false;
+  }
+  if (ctx->section_offsets[ctx->current_section] % kWordBytes != 0){
+    if (ctx->single_pass){
+      return report_instruction_alignment_error(ctx, ctx->section_offsets[ctx->current_section],
+                                                "section offset");
+    }
+    return report_instruction_alignment_error(ctx, (uint32_t)ctx->pc, "pc");
+  }
+  if (ctx->current_section == RODATA_SECTION){
+    print_warning(ctx, "Instruction emitted in .rodata section");
+  } else if (ctx->current_section == DATA_SECTION){
+    print_warning(ctx, "Instruction emitted in .data section");
+  }
+  uint64_t site = encode_section_offset(ctx->current_section, ctx->section_offsets[ctx->current_section]);
+  instruction_array_append(ctx->section_arrays[ctx->current_section], instruction);
+  commit_pending_fixup(ctx, site);
+  ctx->section_offsets[ctx->current_section] += kWordBytes;
+  ctx->pc = section_pc_base(ctx, ctx->current_section) + ctx->section_offsets[ctx->current_section];
+  return true;
+}
+
+// Purpose: Encode the register form of an alu op: ra = rb op rc.
+static int alu_register_word(const struct MnemonicDescriptor* op, int ra, int rb, int rc){
+  int instruction = 0;
+  instruction |= op->alt_opcode << 27;
+  instruction |= ra << 22;
+  instruction |= rb << 17;
+  instruction |= rc;
+  instruction |= op->sub_op << 5;
+  return instruction;
+}
+
 // consume an alu instruction and return the corresponding encoding
-int consume_alu_op(int alu_op, bool* success){
-  assert(0 <= alu_op && alu_op < 32); // ensure alu_op is valid
+int consume_alu_op(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  assert(op->sub_op < 32); // ensure alu_op is valid
 
-  int ra = consume_register();
-  if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
-    *success = false;
-    return 0;
+  // cmp has no destination register
+  int ra = 0;
+  if (!(op->flags & ISA_NO_DEST)){
+    ra = accept_register(ctx);
+    if (ra == -1){
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
+      *success = false;
+      return 0;
+    }
   }
 
   // edge case for 'not', 'sxtb', 'sxtd', 'tncb', 'tncd' because they only have 2 parameters
   int rb = 0;
-  if (alu_op != 6 && alu_op != 18 && alu_op != 19 && alu_op != 20 && alu_op != 21){
-    rb = consume_register();
+  if (!(op->flags & ISA_UNARY)){
+    rb = accept_register(ctx);
     if (rb == -1){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return 0;
     }
   }
   
-  int rc = consume_register();
+  int rc = accept_register(ctx);
   int instruction = 0;
   if (rc == -1){
     // and ra, rb, imm
     enum ConsumeResult result;
-    long imm = consume_immediate(&result);
+    long imm = consume_immediate(ctx, &result);
     if (result != FOUND){
-      print_error();
-      if (result == NOT_FOUND) fprintf(stderr, "Invalid register or immediate\n");
+      print_error(ctx);
+      if (result == NOT_FOUND) error_printf(ctx, "Invalid register or immediate\n");
       *success = false;
       return 0;
     }
 
-    instruction |= 1 << 27; // opcode is 1
+    instruction |= op->opcode << 27;
     instruction |= ra << 22;
     instruction |= rb << 17;
-    instruction |= alu_op << 12;
-    
-    int encoding;
-    if (0 <= alu_op && alu_op < 7){
-      // bitwise op
-      encoding = encode_bitwise_immediate(imm, success);
-    } else if (7 <= alu_op && alu_op < 14) {
-      // shift
-      encoding = encode_shift_immediate(imm, success);
-    } else if (14 <= alu_op && alu_op < 19) {
-      // arithmetic op
-      encoding = encode_arithmetic_immediate(imm, success);
-    } else {
+    instruction |= op->sub_op << 12;
+
+    if (op->imm == FIXUP_NONE){
       // invalid alu op for immediate
-      print_error();
-      fprintf(stderr, "ALU operation %d does not support immediate values\n", alu_op);
+      print_error(ctx);
+      error_printf(ctx, "ALU operation %d does not support immediate values\n", op->sub_op);
       *success = false;
       return 0;
     }
+    int encoding = encode_immediate(ctx, op->imm, imm, success);
 
     assert(encoding == (encoding & 0xFFF)); // ensure encoding always fits in 12 bits
 
     instruction |= encoding;
   } else {
     // and ra, rb, rc
-    // opcode is 0
-    instruction |= ra << 22;
-    instruction |= rb << 17;
-    instruction |= rc;
-    instruction |= alu_op << 5;
-  }
-  
-  return instruction; 
-}
-
-int consume_cmp(bool* success){
-  int rb = consume_register();
-  if (rb == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
-    *success = false;
-    return 0;
-  }
-  
-  int rc = consume_register();
-  int instruction = 0;
-  if (rc == -1){
-    // and ra, rb, imm
-    enum ConsumeResult result;
-    long imm = consume_immediate(&result);
-    if (result != FOUND){
-      print_error();
-      if (result == NOT_FOUND) fprintf(stderr, "Invalid register or immediate\n");
-      *success = false;
-      return 0;
-    }
-
-    instruction |= 1 << 27; // opcode is 1
-    instruction |= rb << 17;
-    instruction |= 16 << 12; // alu_op
-    
-    int encoding = encode_arithmetic_immediate(imm, success);
-
-    assert(encoding == (encoding & 0xFFF)); // ensure encoding always fits in 12 bits
-
-    instruction |= encoding;
-  } else {
-    // opcode is 0
-    instruction |= rb << 17;
-    instruction |= rc;
-    instruction |= 16 << 5; // alu_op
+    instruction = alu_register_word(op, ra, rb, rc);
   }
   
   return instruction; 
 }
 
-int encode_lui_immediate(long imm, bool* success){
+int encode_lui_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if ((imm & 0x3FF) == 0 && imm < ((long)1 << 32)){
     return ((int)imm >> 10) & 0x3FFFFF;
   } else {
     *success = false;
-    print_error();
-    fprintf(stderr, "lui immediate must be a 32 bit integer with zero for bottom 10 bits\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "lui immediate must be a 32 bit integer with zero for bottom 10 bits\n");
+    error_printf(ctx, "Got %ld\n", imm);
     return 0;
   }
 }
 
-int consume_lui(bool* success){
+int consume_lui(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
   enum ConsumeResult result;
-  int ra = consume_register();
+  int ra = accept_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return 0;
   }
 
-  long imm = consume_immediate(&result);
+  long imm = consume_immediate(ctx, &result);
   if (result != FOUND){
-    print_error();
-    fprintf(stderr, "Invalid immediate\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid immediate\n");
     *success = false;
   }
 
-  int encoding = encode_lui_immediate(imm, success);
+  int encoding = encode_immediate(ctx, op->imm, imm, success);
 
   assert(encoding == (encoding & 0x3FFFFF)); // ensure immediate fits in 22 bits
 
-  int instruction = 2 << 27;
+  int instruction = op->opcode << 27;
   instruction |= ra << 22;
   instruction |= encoding;
   return instruction;
 }
 
-int encode_absolute_memory_immediate(long imm, bool* success){
+int encode_absolute_memory_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   // top n bits must all be 0s or all be 1s
   // bottom m bits must be 0s
   // the 12 bits in the middle become part of the instruction
@@ -1163,68 +1035,101 @@ int encode_absolute_memory_immediate(long imm, bool* success){
     return ((imm >> 3) & 0xFFF) | (3 << 12);
   } else {
     // can't encode
-    print_error();
-    fprintf(stderr, "Invalid immediate for memory instruction\n");
-    fprintf(stderr, "Immediate must be a 12 bit number shifted by 0, 1, 2, or 3\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Invalid immediate for memory instruction\n");
+    error_printf(ctx, "Immediate must be a 12 bit number shifted by 0, 1, 2, or 3\n");
+    error_printf(ctx, "Got %ld\n", imm);
     *success = false;
     return 0;
   }
 }
 
-int encode_relative_memory_immediate(long imm, bool* success){
+int encode_relative_memory_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (-(1L << 15) <= imm && imm < (1L << 15)){
     return (int)imm & 0xFFFF;
   } else {
     // can't encode
-    print_error();
-    fprintf(stderr, "Invalid immediate for memory instruction\n");
-    fprintf(stderr, "Immediate must fit in signed 16 bits (-32768 to 32767)\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Invalid immediate for memory instruction\n");
+    error_printf(ctx, "Immediate must fit in signed 16 bits (-32768 to 32767)\n");
+    error_printf(ctx, "Got %ld\n", imm);
     *success = false;
     return 0;
   }
 }
 
-int encode_long_relative_memory_immediate(long imm, bool* success){
+int encode_long_relative_memory_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (-(1L << 20) <= imm && imm < (1L << 20)){
     return (int)imm & 0x1FFFFF;
   } else {
     // can't encode
-    print_error();
-    fprintf(stderr, "Invalid immediate for memory instruction\n");
-    fprintf(stderr, "Immediate must fit in signed 21 bits (-1048576 to 1048575)\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Invalid immediate for memory instruction\n");
+    error_printf(ctx, "Immediate must fit in signed 21 bits (-1048576 to 1048575)\n");
+    error_printf(ctx, "Got %ld\n", imm);
     *success = false;
     return 0;
   }
 }
 
-int consume_mem(int width_type, bool is_absolute, bool is_load, bool* success){
+// Purpose: Encode a memory instruction from its parsed operands.
+// Inputs: rb is -1 when the base register was omitted; y is the absolute
+//         addressing mode (0=offset, 1=preinc, 2=postinc).
+static int memory_word(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op,
+  int ra, int rb, int y, long imm, bool* success){
   int instruction = 0;
 
-  int ra = consume_register();
+  // without a base register a relative access uses the long form
+  enum FixupKind kind = rb != -1 ? op->imm : op->alt_imm;
+  int encoding = encode_immediate(ctx, kind, imm, success);
+  assert(encoding == (encoding & (int)kFixupFieldMasks[kind]));
+
+  instruction |= (rb != -1 ? op->opcode : op->alt_opcode) << 27;
+
+  if (op->flags & ISA_LOAD){
+    if (rb != -1) instruction |= 1 << 16;
+    else instruction |= 1 << 21;
+  }
+
+  instruction |= ra << 22;
+  
+  if (op->flags & ISA_ABSOLUTE){
+    instruction |= y << 14;
+    instruction |= rb << 17;
+  } else if (rb != -1) {
+    instruction |= rb << 17;
+  }
+
+  instruction |= encoding;
+
+  return instruction;
+}
+
+int consume_mem(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  bool is_absolute = op->flags & ISA_ABSOLUTE;
+
+  int ra = accept_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return 0;
   }
 
-  if (!consume("[")){
+  if (!accept(ctx, "[")){
     *success = false;
-    print_error();
-    fprintf(stderr, "Expected \"[\" in memory instruction\n");
+    print_error(ctx);
+    error_printf(ctx, "Expected \"[\" in memory instruction\n");
     return 0;
   }
 
-  int rb = consume_register();
+  int rb = accept_register(ctx);
   if (rb == -1){
     if (is_absolute){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return 0;
     }
@@ -1233,15 +1138,15 @@ int consume_mem(int width_type, bool is_absolute, bool is_load, bool* success){
   long imm = 0;
   int y = 0; // absolute addressing mode selector: 0=offset, 1=preinc, 2=postinc
 
-  if (consume("]")){
+  if (accept(ctx, "]")){
     if (is_absolute){
       enum ConsumeResult result;
-      imm = consume_literal(&result);
+      imm = accept_literal(ctx, &result);
       if (result == FOUND){
         // postincrement: [rb], imm
         if (!is_absolute){
-          print_error();
-          fprintf(stderr, "Postincrement addressing not allowed for relative addressing\n");
+          print_error(ctx);
+          error_printf(ctx, "Postincrement addressing not allowed for relative addressing\n");
           *success = false;
           return 0;
         }
@@ -1258,19 +1163,19 @@ int consume_mem(int width_type, bool is_absolute, bool is_load, bool* success){
     }
   } else {
     enum ConsumeResult result;
-    imm = consume_immediate(&result);
+    imm = consume_immediate(ctx, &result);
     if (result == FOUND){
-      if (!consume("]")){
-        print_error();
-        fprintf(stderr, "Expected \"]\" in memory instruction\n");
+      if (!accept(ctx, "]")){
+        print_error(ctx);
+        error_printf(ctx, "Expected \"]\" in memory instruction\n");
         *success = false;
         return 0;
       }
-      if (consume("!")){
+      if (accept(ctx, "!")){
         // preincrement: [rb, imm]!
         if (!is_absolute){
-          print_error();
-          fprintf(stderr, "Preincrement addressing not allowed for relative addressing\n");
+          print_error(ctx);
+          error_printf(ctx, "Preincrement addressing not allowed for relative addressing\n");
           *success = false;
           return 0;
         }
@@ -1281,240 +1186,268 @@ int consume_mem(int width_type, bool is_absolute, bool is_load, bool* success){
       }
     } else {
       // error
-      print_error();
-      fprintf(stderr, "Invalid immediate in memory instruction\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid immediate in memory instruction\n");
       *success = false;
       return 0;
     }
   }
-  int encoding;
-  
-  if (is_absolute) encoding = encode_absolute_memory_immediate(imm, success);
-  else if (rb != -1) encoding = encode_relative_memory_immediate(imm, success);
-  else encoding = encode_long_relative_memory_immediate(imm, success);
-
-  // opcode
-  if (is_absolute){
-    instruction |= (3 + 3 * width_type) << 27;
-  } else if (rb != -1) {
-    instruction |= (4 + 3 * width_type) << 27;
-  } else {
-    instruction |= (5 + 3 * width_type) << 27;
-  }
-
-  if (is_load){
-    if (rb != -1) instruction |= 1 << 16;
-    else instruction |= 1 << 21;
-  }
-
-  instruction |= ra << 22;
-  
-  if (is_absolute){
-    instruction |= y << 14;
-    instruction |= rb << 17;
-    assert(encoding == (encoding & 0x3FFF)); // ensure encoding is 14 bits
-  } else if (rb != -1) {
-    assert(encoding == (encoding & 0xFFFF)); // ensure encoding is 16 bits
-    instruction |= rb << 17;
-  } else {
-    assert(encoding == (encoding & 0x1FFFFF)); // ensure encoding is 21 bits
-  }
-
-  instruction |= encoding;
-
-  return instruction;
+  return memory_word(ctx, op, ra, rb, y, imm, success);
 }
 
-int encode_branch_immediate(long imm, bool* success){
+int encode_branch_immediate(struct AssemblerContext* ctx, long imm, bool* success){
+  imm = (int)imm; // branch offsets wrap like the 32-bit pc
   if (-(1 << 23) <= imm && imm < (1 << 23) && (imm & 3) == 0){
     return (imm >> 2) & 0x3FFFFF;
   } else {
     *success = false;
-    print_error();
-    fprintf(stderr, "branch immediate must be divisible by 4 and in range -8388608 to 8388607\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "branch immediate must be divisible by 4 and in range -8388608 to 8388607\n");
+    error_printf(ctx, "Got %ld\n", imm);
     return 0;
   }
 }
 
-int encode_adpc_immediate(long imm, bool* success){
+int encode_adpc_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (-(1L << 21) <= imm && imm < (1L << 21)){
     return (int)imm & 0x3FFFFF;
   } else {
     *success = false;
-    print_error();
-    fprintf(stderr, "adpc immediate must fit in signed 22 bits (-2097152 to 2097151)\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "adpc immediate must fit in signed 22 bits (-2097152 to 2097151)\n");
+    error_printf(ctx, "Got %ld\n", imm);
     return 0;
   }
 }
 
-int consume_branch(int branch_code, bool is_absolute, bool* success){
+// Purpose: Encode the register form of a branch: link in ra, jump to rb.
+static int branch_register_word(const struct MnemonicDescriptor* op, int ra, int rb){
+  int instruction = 0;
+  instruction |= op->alt_opcode << 27;
+  instruction |= op->sub_op << 22;
+  instruction |= ra << 5;
+  instruction |= rb;
+  return instruction;
+}
+
+int consume_branch(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
   int instruction = 0;
 
-  assert(0 <= branch_code && branch_code < 19); // ensure branch code is valid
+  assert(op->sub_op < 19); // ensure branch code is valid
 
-  int ra = consume_register();
+  int ra = accept_register(ctx);
   if (ra == -1){
     // it's an immediate branch
     enum ConsumeResult result;
-    int imm = consume_immediate(&result);
+    int imm = consume_immediate(ctx, &result);
     if (result != FOUND){
-      print_error();
-      if (result == NOT_FOUND) fprintf(stderr, "Branch instruction expects register or immediate operand\n");
+      print_error(ctx);
+      if (result == NOT_FOUND) error_printf(ctx, "Branch instruction expects register or immediate operand\n");
       *success = false;
       return 0;
     }
-    if (is_absolute){
-      print_error();
-      fprintf(stderr, "Immediate branch is not allowed for absolute branches\n");
+    if (op->opcode == ISA_NO_OPCODE){
+      print_error(ctx);
+      error_printf(ctx, "Immediate branch is not allowed for absolute branches\n");
       *success = false;
       return 0;
     }
-    int encoding = encode_branch_immediate(imm, success);
-    instruction |= 12 << 27; // opcode
-    instruction |= branch_code << 22;
+    int encoding = encode_immediate(ctx, op->imm, imm, success);
+    instruction |= op->opcode << 27;
+    instruction |= op->sub_op << 22;
     instruction |= encoding;
   } else {
     // register branch
-    int rb = consume_register();
+    int rb = accept_register(ctx);
     if (rb == -1){
       // ra was omitted
       rb = ra;
       ra = 0;
     }
-    if (is_absolute) instruction |= 13 << 27; // opcode
-    else instruction |= 14 << 27; // opcode
-    instruction |= branch_code << 22;
-    instruction |= ra << 5;
-    instruction |= rb;
+    instruction = branch_register_word(op, ra, rb);
   }
 
   return instruction;
 }
 
-int consume_adpc(bool* success){
-  int ra = consume_register();
+int consume_adpc(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int ra = accept_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return 0;
   }
 
   enum ConsumeResult result;
-  long imm = consume_immediate(&result);
+  long imm = consume_immediate(ctx, &result);
   if (result != FOUND){
-    print_error();
-    if (result == NOT_FOUND) fprintf(stderr, "adpc expects immediate or label\n");
+    print_error(ctx);
+    if (result == NOT_FOUND) error_printf(ctx, "adpc expects immediate or label\n");
     *success = false;
     return 0;
   }
 
-  int encoding = encode_adpc_immediate(imm, success);
+  int encoding = encode_immediate(ctx, op->imm, imm, success);
   int instruction = 0;
-  instruction |= 22 << 27;
+  instruction |= op->opcode << 27;
   instruction |= ra << 22;
   instruction |= encoding;
   return instruction;
 }
 
 // Alias for unconditional branches
-int consume_jmp(bool* success){
+int consume_jmp(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
   int instruction = 0;
 
-  int ra = consume_register();
+  int ra = accept_register(ctx);
   if (ra == -1){
     // it's an immediate branch
     enum ConsumeResult result;
-    int imm = consume_immediate(&result);
+    int imm = consume_immediate(ctx, &result);
     if (result != FOUND){
-      print_error();
-      if (result == NOT_FOUND) fprintf(stderr, "Branch instruction expects register or immediate operand\n");
+      print_error(ctx);
+      if (result == NOT_FOUND) error_printf(ctx, "Branch instruction expects register or immediate operand\n");
       *success = false;
       return 0;
     }
     
-    int encoding = encode_branch_immediate(imm, success);
-    instruction |= 12 << 27; // opcode
+    int encoding = encode_immediate(ctx, op->imm, imm, success);
+    instruction |= op->opcode << 27;
     instruction |= encoding;
   } else {
     // register branch
-    instruction |= 13 << 27; // opcode
-    instruction |= ra;
+    instruction = op->alt_opcode << 27 | ra;
   }
 
   return instruction;
 }
 
-int consume_trap(bool* success){
+int consume_trap(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
   (void)success;
-  return 15 << 27;
+  return op->opcode << 27;
 }
 
-int encode_short_atomic_immediate(long imm, bool* success){
+int encode_short_atomic_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (-(1L << 11) <= imm && imm < (1L << 11)){
     return (int)imm & 0xFFF;
   } else {
     // can't encode
-    print_error();
-    fprintf(stderr, "Invalid immediate for memory instruction\n");
-    fprintf(stderr, "Immediate must fit in signed 12 bits (-2048 to 2047)\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Invalid immediate for memory instruction\n");
+    error_printf(ctx, "Immediate must fit in signed 12 bits (-2048 to 2047)\n");
+    error_printf(ctx, "Got %ld\n", imm);
     *success = false;
     return 0;
   }
 }
 
-int encode_long_atomic_immediate(long imm, bool* success){
+int encode_long_atomic_immediate(struct AssemblerContext* ctx, long imm, bool* success){
   if (-(1L << 16) <= imm && imm < (1L << 16)){
     return (int)imm & 0x1FFFF;
   } else {
     // can't encode
-    print_error();
-    fprintf(stderr, "Invalid immediate for memory instruction\n");
-    fprintf(stderr, "Immediate must fit in signed 17 bits (-65536 to 65535)\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "Invalid immediate for memory instruction\n");
+    error_printf(ctx, "Immediate must fit in signed 17 bits (-65536 to 65535)\n");
+    error_printf(ctx, "Got %ld\n", imm);
     *success = false;
     return 0;
   }
 }
 
-int consume_atomic(bool is_absolute, bool is_fadd, bool* success){
-  int instruction = 0;
 
-  int ra = consume_register();
-  if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
-    *success = false;
+// movi halves: movu/movl for constants, movu8/movl4 for labels, whose
+// immediate is taken relative to the movu (8 bytes) or movl (4 bytes)
+int encode_movu_immediate(struct AssemblerContext* ctx, long imm, bool* success){
+  return encode_lui_immediate(ctx, (int)imm & 0xFFFFFC00, success);
+}
+
+int encode_movl_immediate(struct AssemblerContext* ctx, long imm, bool* success){
+  return encode_arithmetic_immediate(ctx, (int)imm & 0x3FF, success);
+}
+
+int encode_movu8_immediate(struct AssemblerContext* ctx, long imm, bool* success){
+  return encode_lui_immediate(ctx, ((int)imm - 8) & 0xFFFFFC00, success);
+}
+
+int encode_movl4_immediate(struct AssemblerContext* ctx, long imm, bool* success){
+  return encode_arithmetic_immediate(ctx, ((int)imm - 4) & 0x3FF, success);
+}
+
+int encode_eoi_immediate(struct AssemblerContext* ctx, long imm, bool* success){
+  if (0 <= imm && imm <= 15){
+    return imm;
+  } else {
+    print_error(ctx);
+    error_printf(ctx, "eoi bit index must be in range 0 to 15\n");
+    error_printf(ctx, "Got %ld\n", imm);
+    *success = false;
+    return 0;
+  }
+}
+
+typedef int (*ImmediateEncoder)(struct AssemblerContext* ctx, long imm, bool* success);
+
+// Range check and packing for each instruction immediate field.
+static const ImmediateEncoder kImmediateEncoders[FIXUP_KIND_COUNT] = {
+#define X(kind, mask, encoder) [FIXUP_##kind] = encoder,
+  ISA_IMMEDIATE_FIELDS(X)
+#undef X
+};
+
+// Purpose: Encode an immediate into the instruction field selected by kind.
+// Inputs: kind selects the field; imm is the immediate; success is cleared on range errors.
+// Outputs: Returns the field bits, already positioned at bit 0.
+// Invariants/Assumptions: kind names an ISA_IMMEDIATE_FIELDS row; words and
+//                         debug addresses are not instruction fields.
+static int encode_field(struct AssemblerContext* ctx, enum FixupKind kind, long imm, bool* success){
+  assert(kind < FIXUP_KIND_COUNT && kImmediateEncoders[kind] != NULL);
+  return kImmediateEncoders[kind](ctx, imm, success);
+}
+
+static int encode_immediate(struct AssemblerContext* ctx, enum FixupKind kind, long imm, bool* success){
+  // a label parsed by this instruction is patched with the same encoding
+  if (ctx->has_pending_fixup) ctx->pending_fixup.kind = (uint8_t)kind;
+  return encode_field(ctx, kind, imm, success);
+}
+
+int consume_atomic(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int instruction = 0;
+  bool is_absolute = op->flags & ISA_ABSOLUTE;
+
+  int ra = accept_register(ctx);
+  if (ra == -1){
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
+    *success = false;
     return 0;
   }
 
-  int rc = consume_register();
+  int rc = accept_register(ctx);
   if (rc == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return 0;
   }
 
-  if (!consume("[")){
+  if (!accept(ctx, "[")){
     *success = false;
-    print_error();
-    fprintf(stderr, "Expected \"[\" in memory instruction\n");
+    print_error(ctx);
+    error_printf(ctx, "Expected \"[\" in memory instruction\n");
     return 0;
   }
 
-  int rb = consume_register();
+  int rb = accept_register(ctx);
   if (rb == -1){
     if (is_absolute){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return 0;
     }
@@ -1522,82 +1455,63 @@ int consume_atomic(bool is_absolute, bool is_fadd, bool* success){
 
   long imm = 0;
 
-  if (consume("]")){
+  if (accept(ctx, "]")){
     // no offset
     imm = 0;
   } else {
     // signed offset
     enum ConsumeResult result;
-    imm = consume_immediate(&result);
+    imm = consume_immediate(ctx, &result);
     if (result == FOUND){
-      if (!consume("]")){
-        print_error();
-        fprintf(stderr, "Expected \"]\" in memory instruction\n");
+      if (!accept(ctx, "]")){
+        print_error(ctx);
+        error_printf(ctx, "Expected \"]\" in memory instruction\n");
         *success = false;
         return 0;
       }
     } else {
       // error
-      print_error();
-      fprintf(stderr, "Invalid immediate in memory instruction\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid immediate in memory instruction\n");
       *success = false;
       return 0;
     }
   }
-  int encoding;
-  
-  if (is_absolute) encoding = encode_short_atomic_immediate(imm, success);
-  else if (rb != -1) encoding = encode_short_atomic_immediate(imm, success);
-  else encoding = encode_long_atomic_immediate(imm, success);
-
-  // opcode
-  if (is_absolute){
-    instruction |= (is_fadd ? 16 : 19) << 27;
-  } else if (rb != -1) {
-    instruction |= (is_fadd ? 17 : 20) << 27;
-  } else {
-    instruction |= (is_fadd ? 18 : 21) << 27;
-  }
+  // without a base register a relative access uses the long form
+  enum FixupKind kind = rb != -1 ? op->imm : op->alt_imm;
+  int encoding = encode_immediate(ctx, kind, imm, success);
+  assert(encoding == (encoding & (int)kFixupFieldMasks[kind]));
 
+  instruction |= (rb != -1 ? op->opcode : op->alt_opcode) << 27;
   instruction |= ra << 22;
   instruction |= rc << 17;
   
-  if (is_absolute){
-    assert(encoding == (encoding & 0xFFF)); // ensure encoding is 12 bits
-    instruction |= rb << 12;
-  } else if (rb != -1) {
-    assert(encoding == (encoding & 0xFFF)); // ensure encoding is 12 bits
-    instruction |= rb << 12;
-  } else {
-    assert(encoding == (encoding & 0x1FFFF)); // ensure encoding is 17 bits
-  }
+  if (rb != -1) instruction |= rb << 12;
 
   instruction |= encoding;
 
   return instruction;
 }
 
-void check_privileges(bool* success){
-  static bool has_printed = false;
+void check_privileges(struct AssemblerContext* ctx, bool* success){
   // Privileged instructions require -kernel flag
-  if (!is_kernel){
+  if (!ctx->is_kernel){
     *success = false;
-    if (!has_printed){
-      has_printed = true;
-      print_error();
-      fprintf(stderr, "Used privileged instruction\n");
-      fprintf(stderr, "Run assembler with -kernel if this was intentional\n");
+    print_error(ctx);
+    error_printf(ctx, "Used privileged instruction\n");
+    // the hint is given once per run
+    if (!ctx->has_printed_privilege_error){
+      ctx->has_printed_privilege_error = true;
+      error_printf(ctx, "Run assembler with -kernel if this was intentional\n");
     }
   }
 }
 
-int consume_tlb_op(int tlb_op, bool* success){
-  check_privileges(success);
-  if (!*success) return 0;
-
-  assert(0 <= tlb_op && tlb_op < 4); // ensure tlb op is valid
+int consume_tlb_op(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int tlb_op = op->sub_op;
+  assert(tlb_op < 4); // ensure tlb op is valid
 
-  int instruction = 31 << 27; // opcode
+  int instruction = op->opcode << 27;
 
   if (tlb_op == 3){
     // tlbc
@@ -1606,11 +1520,11 @@ int consume_tlb_op(int tlb_op, bool* success){
     // tlbi
     instruction |= 2 << 10;
 
-    int rb = consume_register();
+    int rb = accept_register(ctx);
     if (rb == -1){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return 0;
     }
@@ -1619,19 +1533,19 @@ int consume_tlb_op(int tlb_op, bool* success){
 
   } else {
     // tlbr or tlbw
-    int ra = consume_register();
+    int ra = accept_register(ctx);
     if (ra == -1){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return 0;
     }
-    int rb = consume_register();
+    int rb = accept_register(ctx);
     if (rb == -1){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return 0;
     }
@@ -1647,110 +1561,100 @@ int consume_tlb_op(int tlb_op, bool* success){
   return instruction;
 }
 
-int consume_crmv(bool* success){
-  check_privileges(success);
-  if (!*success) return 0;
+// Purpose: Encode a crmv; mode tells which operands are control registers
+//          (4: crA, rB; 5: rA, crB; 6: crA, crB; 7: rA, rB).
+static int crmv_word(const struct MnemonicDescriptor* op, int ra, int rb, int mode){
+  int instruction = op->opcode << 27;
+  instruction |= op->sub_op << 12;
+  instruction |= mode << 10;
+  instruction |= ra << 22;
+  instruction |= rb << 17;
+  return instruction;
+}
 
-  int instruction = 31 << 27;
-  instruction |= 1 << 12;
+int consume_crmv(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int mode;
 
-  int ra = consume_register();
+  int ra = accept_register(ctx);
   int rb;
   if (ra == -1){
-    ra = consume_control_register();
+    ra = accept_control_register(ctx);
     if (ra == -1){
-      print_error();
-      fprintf(stderr, "Invalid register or control register\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register or control register\n");
       *success = false;
       return 0; 
     }
-    rb = consume_control_register();
+    rb = accept_control_register(ctx);
     if (rb == -1) {
-      rb = consume_register();
+      rb = accept_register(ctx);
       if (rb == -1){
-        print_error();
-        fprintf(stderr, "Invalid control register\n");
+        print_error(ctx);
+        error_printf(ctx, "Invalid control register\n");
         *success = false;
         return 0; 
       }
       // crmv crA, rB
-      instruction |= 4 << 10;
+      mode = 4;
     } else {
       // crmv crA, crB
-      instruction |= 6 << 10;
+      mode = 6;
     }
   } else {
-    rb = consume_control_register();
+    rb = accept_control_register(ctx);
     if (rb == -1) {
-      rb = consume_register();
+      rb = accept_register(ctx);
       if (rb == -1){
-        print_error();
-        fprintf(stderr, "Invalid register or control register\n");
+        print_error(ctx);
+        error_printf(ctx, "Invalid register or control register\n");
         *success = false;
         return 0; 
       }
       // crmv rA, rB
-      instruction |= 7 << 10;
+      mode = 7;
     } else {
       // crmv rA, crB
-      instruction |= 5 << 10;
+      mode = 5;
     }
   }
-  instruction |= ra << 22;
-  instruction |= rb << 17;
 
-  return instruction;
+  return crmv_word(op, ra, rb, mode);
 }
 
-int consume_eoi(bool* success){
-  check_privileges(success);
-  if (!*success) return 0;
-
-  int instruction = 31 << 27; // opcode
-  instruction |= 5 << 12; // privileged ID for eoi
+int consume_eoi(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int instruction = op->opcode << 27;
+  instruction |= op->sub_op << 12; // privileged ID for eoi
 
-  skip();
-  if (consume_keyword("all")) {
+  if (accept(ctx, "all")) {
     instruction |= 1 << 11;
     return instruction;
   }
 
   enum ConsumeResult result;
-  long imm = consume_immediate(&result);
+  long imm = consume_immediate(ctx, &result);
   if (result != FOUND) {
-    print_error();
-    fprintf(stderr, "eoi instruction expects 'all' or an ISR bit index in range 0 to 15\n");
-    *success = false;
-    return 0;
-  }
-  if (imm < 0 || imm > 15) {
-    print_error();
-    fprintf(stderr, "eoi bit index must be in range 0 to 15\n");
-    fprintf(stderr, "Got %ld\n", imm);
+    print_error(ctx);
+    error_printf(ctx, "eoi instruction expects 'all' or an ISR bit index in range 0 to 15\n");
     *success = false;
     return 0;
   }
-
-  instruction |= imm & 0xF;
+  instruction |= encode_immediate(ctx, op->imm, imm, success);
   return instruction;
 }
 
-int consume_mode_op(bool* success){
-  check_privileges(success);
-  if (!*success) return 0;
+int consume_mode_op(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int instruction = op->opcode << 27;
+  instruction |= op->sub_op << 12;
 
-  int instruction = 31 << 27; // opcode
-  instruction |= 2 << 12;
-
-  if (consume("run"));
-  else if (consume("sleep")){
+  if (accept(ctx, "run"));
+  else if (accept(ctx, "sleep")){
     instruction |= 1 << 10;
-  } else if (consume("halt")){
+  } else if (accept(ctx, "halt")){
     instruction |= 2 << 10;
   } else {
-    print_error();
-    fprintf(stderr, "Invalid mode\n");
-    fprintf(stderr, "Valid modes are: run, sleep, or halt\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid mode\n");
+    error_printf(ctx, "Valid modes are: run, sleep, or halt\n");
     *success = false;
     return 0;
   }
@@ -1758,46 +1662,40 @@ int consume_mode_op(bool* success){
   return instruction;
 }
 
-int consume_rfe(bool* success){
-  check_privileges(success);
-  if (!*success) return 0;
-
-  int instruction = 31 << 27;
-  instruction |= 3 << 12;
+int consume_rfe(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  (void)success;
+  int instruction = op->opcode << 27;
+  instruction |= op->sub_op << 12;
 
   return instruction;
 }
 
-int consume_ipi(bool* success){
-  check_privileges(success);
-  if (!*success) return 0;
-
-  int instruction = 31 << 27; // opcode
-  instruction |= 4 << 12; // ID
+int consume_ipi(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int instruction = op->opcode << 27;
+  instruction |= op->sub_op << 12; // ID
 
-  int ra = consume_register();
+  int ra = accept_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return 0;
   }
 
-  skip();
 
   instruction |= ra << 22;
   
-  if (consume_keyword("all")) {
+  if (accept(ctx, "all")) {
     // ipi to all cores
     instruction |= 1 << 11;
   } else {
     // ipi to a specific core
     enum ConsumeResult result;
-    int imm = consume_literal(&result);
+    int imm = accept_literal(ctx, &result);
     if (result != FOUND || imm < 0 || imm >= 4){
-      print_error();
-      if (result == NOT_FOUND) fprintf(stderr, "ipi instruction expects 'all' or core num in range [0, 3]\n");
+      print_error(ctx);
+      if (result == NOT_FOUND) error_printf(ctx, "ipi instruction expects 'all' or core num in range [0, 3]\n");
       *success = false;
       return 0;
     }
@@ -1811,36 +1709,29 @@ int consume_ipi(bool* success){
 }
 
 
-// consume a mov hack return the corresponding encoding
-int consume_mov_hack(int mov_type, bool* success){
-  assert(0 <= mov_type && mov_type < 4); // ensure mov_type is valid
-
-  int ra = consume_register();
-  if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
-    *success = false;
-    return 0;
-  }
-
+// Purpose: Parse the immediate of a movu/movl into ra and encode it.
+// Inputs: op is movu or movl; ra is already parsed.
+// Outputs: Returns the instruction; clears success after reporting.
+static int consume_mov_half(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, int ra,
+  bool* success){
+  enum FixupKind kind = op->imm;
   enum ConsumeResult result;
 
-  const char* old_current = current;
-  int imm = consume_label_imm(&result); // don't encode bottom two bits of pc  
+  const struct Token* old_tok = ctx->tok;
+  int imm = consume_label_imm(ctx, &result); // don't encode bottom two bits of pc  
   if (result == FOUND) {
-    current = old_current;
-    struct Slice* label = consume_identifier();
+    rewind_to(ctx, old_tok);
+    uint32_t label = accept_symbol(ctx);
 
     // hack to see if this was a .define and not a label
-    if (!hash_map_contains(local_defines[current_file_index], label)) mov_type |= 2;
+    long value;
+    if (!lookup_define(ctx, label, &value)) kind = op->alt_imm;
 
-    free(label);
   }
-  else imm = consume_literal(&result);
+  else imm = accept_literal(ctx, &result);
   if (result != FOUND){
-    print_error();
-    if (result == NOT_FOUND) fprintf(stderr, "movi expects label or integer literal\n");
+    print_error(ctx);
+    if (result == NOT_FOUND) error_printf(ctx, "movi expects label or integer literal\n");
     *success = false;
     return 0;
   }
@@ -1852,32 +1743,28 @@ int consume_mov_hack(int mov_type, bool* success){
   // [1] movl := addi rA, rA, (imm & 0x3FF)
   // [2] movu8 := lui rA, ((imm - 8) & 0xFFFFFC00)
   // [3] movl4 := addi rA, rA, ((imm - 4) & 0x3FF)
-
-  if (mov_type == 2) imm -= 8;
-  else if (mov_type == 3) imm -= 4;
-  
   int instruction = 0;
 
-  if (mov_type & 1){
-    // this is movl or movl8
+  if (op->imm == FIXUP_MOVL){
+    // this is movl or movl4, an add
 
-    instruction |= 1 << 27; // opcode for add
+    instruction |= op->opcode << 27;
     instruction |= ra << 22;
     instruction |= ra << 17;
-    instruction |= 14 << 12; // add is 14
+    instruction |= op->sub_op << 12;
 
-    int encoding = encode_arithmetic_immediate(imm & 0x3FF, success);
+    int encoding = encode_immediate(ctx, kind, imm, success);
 
     assert(encoding == (encoding & 0xFFF)); // ensure encoding always fits in 12 bits
 
     instruction |= encoding;
   } else {
     // this is movu or movu8
-    int encoding = encode_lui_immediate(imm & 0xFFFFFC00, success);
+    int encoding = encode_immediate(ctx, kind, imm, success);
 
     assert(encoding == (encoding & 0x3FFFFF)); // ensure immediate fits in 22 bits
 
-    instruction = 2 << 27; // opcode for lui
+    instruction = op->opcode << 27; // lui
     instruction |= ra << 22;
     instruction |= encoding;
   }
@@ -1885,977 +1772,1352 @@ int consume_mov_hack(int mov_type, bool* success){
   return instruction; 
 }
 
-void record_define(bool* success){
-  struct Slice* label = consume_identifier();
-  if (label == NULL){
+// consume a mov hack return the corresponding encoding
+int consume_mov_hack(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int ra = accept_register(ctx);
+  if (ra == -1){
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
+    *success = false;
+    return 0;
+  }
+  return consume_mov_half(ctx, op, ra, success);
+}
+
+/*
+  Built-in macros.
+  nop, ret, push/pop (and the sized pshw..popb forms), mov, movi and call are
+  parsed once here and encoded as the instructions -pre expands them to.
+  Every word but the last goes through emit_instruction_word, so each gets its
+  own pc, section checks and single-pass fixup as if it had been written out;
+  the statement loop emits the last word as usual.
+*/
+
+// Purpose: Report a register operand that is not r0 - r31.
+static void report_invalid_register(struct AssemblerContext* ctx, bool* success){
+  print_error(ctx);
+  error_printf(ctx, "Invalid register\n");
+  error_printf(ctx, "Valid registers are r0 - r31\n");
+  *success = false;
+}
+
+static const struct MnemonicDescriptor* builtin_mnemonic(const char* name){
+  const struct MnemonicDescriptor* desc = lookup_mnemonic(name, strlen(name));
+  assert(desc != NULL);
+  return desc;
+}
+
+int consume_nop(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  (void)ctx;
+  (void)success;
+  return alu_register_word(op, 0, 0, 0);
+}
+
+int consume_ret(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  (void)ctx;
+  (void)success;
+  return op->alt_opcode << 27 | 29;
+}
+
+// push: store ra at [sp, -n]!; pop: load ra from [sp], n
+int consume_stack(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  int ra = accept_register(ctx);
+  if (ra == -1){
+    report_invalid_register(ctx, success);
+    return 0;
+  }
+  bool is_pop = op->flags & ISA_LOAD;
+  return memory_word(ctx, op, ra, 31, is_pop ? 2 : 1, is_pop ? op->sub_op : -op->sub_op, success);
+}
+
+int consume_mov(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  (void)op;
+  int ra = accept_register(ctx);
+  int mode;
+  if (ra == -1){
+    ra = accept_control_register(ctx);
+    if (ra == -1){
+      report_invalid_register(ctx, success);
+      return 0;
+    }
+    // crmv crA, rB or crmv crA, crB
+    mode = 4;
+    int rb = accept_register(ctx);
+    if (rb == -1){
+      rb = accept_control_register(ctx);
+      if (rb == -1){
+        report_invalid_register(ctx, success);
+        return 0;
+      }
+      mode = 6;
+    }
+    check_privileges(ctx, success);
+    return *success ? crmv_word(builtin_mnemonic("crmv"), ra, rb, mode) : 0;
+  }
+
+  int rb = accept_register(ctx);
+  if (rb == -1){
+    rb = accept_control_register(ctx);
+    if (rb == -1){
+      report_invalid_register(ctx, success);
+      return 0;
+    }
+    // crmv rA, crB
+    check_privileges(ctx, success);
+    return *success ? crmv_word(builtin_mnemonic("crmv"), ra, rb, 5) : 0;
+  }
+
+  // add rA, rB, r0
+  return alu_register_word(builtin_mnemonic("add"), ra, rb, 0);
+}
+
+// Purpose: Emit movu ra, imm then return movl ra, imm (the immediate is parsed twice).
+// Invariants/Assumptions: The cursor is at the immediate.
+static int consume_mov_pair(struct AssemblerContext* ctx, int ra, bool* success){
+  if (ctx->tok->kind != TOKEN_INTEGER && ctx->tok->kind != TOKEN_IDENTIFIER){
+    // a malformed literal reports itself first
+    enum ConsumeResult result;
+    if (ctx->tok->kind == TOKEN_BAD_LITERAL) accept_literal(ctx, &result);
+    print_error(ctx);
+    error_printf(ctx, "Expected immediate\n");
+    *success = false;
+    return 0;
+  }
+
+  const struct Token* imm = ctx->tok;
+  int movu = consume_mov_half(ctx, builtin_mnemonic("movu"), ra, success);
+  if (!*success || !emit_instruction_word(ctx, movu)){
+    *success = false;
+    return 0;
+  }
+  rewind_to(ctx, imm);
+  return consume_mov_half(ctx, builtin_mnemonic("movl"), ra, success);
+}
+
+int consume_movi(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  (void)op;
+  int ra = accept_register(ctx);
+  if (ra == -1){
+    report_invalid_register(ctx, success);
+    return 0;
+  }
+  return consume_mov_pair(ctx, ra, success);
+}
+
+// call: movi r29, imm then br r29, r29
+int consume_call(struct AssemblerContext* ctx, const struct MnemonicDescriptor* op, bool* success){
+  (void)op;
+  int movl = consume_mov_pair(ctx, 29, success);
+  if (!*success || !emit_instruction_word(ctx, movl)){
+    *success = false;
+    return 0;
+  }
+  return branch_register_word(builtin_mnemonic("br"), 29, 29);
+}
+
+void record_define(struct AssemblerContext* ctx, bool* success){
+  uint32_t label = accept_symbol(ctx);
+  if (label == NO_SYMBOL){
     // error
-    print_error();
-    fprintf(stderr, "Expected label\n");
+    print_error(ctx);
+    error_printf(ctx, "Expected label\n");
     *success = false;
     return;
   }
 
   enum ConsumeResult result;
-  long imm = consume_literal(&result);
+  long imm = accept_literal(ctx, &result);
   if (result == NOT_FOUND){
-    struct Slice* value_label = consume_identifier();
-    if (value_label == NULL){
-      print_error();
-      free(label);
-      fprintf(stderr, "Expected integer literal or label\n");
+    uint32_t value_label = accept_symbol(ctx);
+    if (value_label == NO_SYMBOL){
+      print_error(ctx);
+      error_printf(ctx, "Expected integer literal or label\n");
       *success = false;
       return;
     }
-    if (hash_map_contains(local_defines[current_file_index], value_label)){
-      imm = hash_map_get(local_defines[current_file_index], value_label);
-    } else if (label_has_definition(local_labels[current_file_index], value_label)){
-      imm = hash_map_get(local_labels[current_file_index], value_label);
-    } else if (label_has_definition(global_labels, value_label)){
-      imm = hash_map_get(global_labels, value_label);
+    if (hash_map_contains(ctx->local_defines[ctx->current_file_index], value_label)){
+      imm = hash_map_get(ctx->local_defines[ctx->current_file_index], value_label);
+    } else if (label_has_definition(ctx->local_labels[ctx->current_file_index], value_label)){
+      imm = hash_map_get(ctx->local_labels[ctx->current_file_index], value_label);
+    } else if (label_has_definition(ctx->global_labels, value_label)){
+      imm = hash_map_get(ctx->global_labels, value_label);
     } else {
-      print_error();
-      fprintf(stderr, "Label \"");
-      print_slice_err(value_label);
-      fprintf(stderr, "\" has not been defined\n");
-      free(value_label);
-      free(label);
+      print_error(ctx);
+      error_printf(ctx, "Label \"");
+      print_symbol_err(ctx, value_label);
+      error_printf(ctx, "\" has not been defined\n");
       *success = false;
       return;
     }
-    free(value_label);
   } else if (result != FOUND){
     // error
-    print_error();
-    free(label);
-    fprintf(stderr, "Expected integer literal or label\n");
+    print_error(ctx);
+    error_printf(ctx, "Expected integer literal or label\n");
     *success = false;
     return;
   }
 
-  if (hash_map_contains(local_defines[current_file_index], label)){
+  if (hash_map_contains(ctx->local_defines[ctx->current_file_index], label)){
     // error
-    print_error();
-    free(label);
-    fprintf(stderr, "constant has multiple definitions\n");
+    print_error(ctx);
+    error_printf(ctx, "constant has multiple definitions\n");
     *success = false;
     return;
   }
-  hash_map_insert(local_defines[current_file_index], label, imm, true, true);  
+  hash_map_insert(ctx->local_defines[ctx->current_file_index], label, imm, true, true);  
+}
+
+// Purpose: Consume a mnemonic token and look up its descriptor.
+// Inputs: ctx; reads its cursor token.
+// Outputs: Returns the descriptor and advances past the mnemonic, or returns
+//          NULL with no side effects.
+static const struct MnemonicDescriptor* accept_mnemonic(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_IDENTIFIER) return NULL;
+  const struct MnemonicDescriptor* desc =
+    lookup_mnemonic(ctx->token_source + ctx->tok->offset, ctx->tok->len);
+  if (desc != NULL) advance(ctx);
+  return desc;
 }
 
 // consumes a single instruction and converts it to binary or hex
-int consume_instruction(enum ConsumeResult* result){
+int consume_instruction(struct AssemblerContext* ctx, enum ConsumeResult* result){
   int instruction = 0;
   bool success = true;
 
   // user instructions
-  skip();
-
-  // alu instructions
-  if (consume_keyword("and")) instruction = consume_alu_op(0, &success);
-  else if (consume_keyword("nand")) instruction = consume_alu_op(1, &success);
-  else if (consume_keyword("or")) instruction = consume_alu_op(2, &success);
-  else if (consume_keyword("nor")) instruction = consume_alu_op(3, &success);
-  else if (consume_keyword("xor")) instruction = consume_alu_op(4, &success);
-  else if (consume_keyword("xnor")) instruction = consume_alu_op(5, &success);
-  else if (consume_keyword("not")) instruction = consume_alu_op(6, &success);
-  else if (consume_keyword("lsl")) instruction = consume_alu_op(7, &success);
-  else if (consume_keyword("lsr")) instruction = consume_alu_op(8, &success);
-  else if (consume_keyword("asr")) instruction = consume_alu_op(9, &success);
-  else if (consume_keyword("rotl")) instruction = consume_alu_op(10, &success);
-  else if (consume_keyword("rotr")) instruction = consume_alu_op(11, &success);
-  else if (consume_keyword("lslc")) instruction = consume_alu_op(12, &success);
-  else if (consume_keyword("lsrc")) instruction = consume_alu_op(13, &success);
-  else if (consume_keyword("add")) instruction = consume_alu_op(14, &success);
-  else if (consume_keyword("addc")) instruction = consume_alu_op(15, &success);
-  else if (consume_keyword("sub")) instruction = consume_alu_op(16, &success);
-  else if (consume_keyword("subb")) instruction = consume_alu_op(17, &success);
-  else if (consume_keyword("cmp")) instruction = consume_cmp(&success);
-  else if (consume_keyword("sxtb")) instruction = consume_alu_op(18, &success);
-  else if (consume_keyword("sxtd")) instruction = consume_alu_op(19, &success);
-  else if (consume_keyword("tncb")) instruction = consume_alu_op(20, &success);
-  else if (consume_keyword("tncd")) instruction = consume_alu_op(21, &success);
-  
-  // load upper immediate
-  else if (consume_keyword("lui")) instruction = consume_lui(&success);
-  
-  // memory instructions
-  else if (consume_keyword("swa")) instruction = consume_mem(0, true, false, &success);
-  else if (consume_keyword("lwa")) instruction = consume_mem(0, true, true, &success);
-  else if (consume_keyword("sw")) instruction = consume_mem(0, false, false, &success);
-  else if (consume_keyword("lw")) instruction = consume_mem(0, false, true, &success);
-  else if (consume_keyword("sda")) instruction = consume_mem(1, true, false, &success);
-  else if (consume_keyword("lda")) instruction = consume_mem(1, true, true, &success);
-  else if (consume_keyword("sd")) instruction = consume_mem(1, false, false, &success);
-  else if (consume_keyword("ld")) instruction = consume_mem(1, false, true, &success);
-  else if (consume_keyword("sba")) instruction = consume_mem(2, true, false, &success);
-  else if (consume_keyword("lba")) instruction = consume_mem(2, true, true, &success);
-  else if (consume_keyword("sb")) instruction = consume_mem(2, false, false, &success);
-  else if (consume_keyword("lb")) instruction = consume_mem(2, false, true, &success);
-  
-  // branch instructions
-  else if (consume_keyword("br")) instruction = consume_branch(0, false, &success);
-  else if (consume_keyword("bz")) instruction = consume_branch(1, false, &success);
-  else if (consume_keyword("bnz")) instruction = consume_branch(2, false, &success);
-  else if (consume_keyword("bs")) instruction = consume_branch(3, false, &success);
-  else if (consume_keyword("bns")) instruction = consume_branch(4, false, &success);
-  else if (consume_keyword("bc")) instruction = consume_branch(5, false, &success);
-  else if (consume_keyword("bnc")) instruction = consume_branch(6, false, &success);
-  else if (consume_keyword("bo")) instruction = consume_branch(7, false, &success);
-  else if (consume_keyword("bno")) instruction = consume_branch(8, false, &success);
-  else if (consume_keyword("bps")) instruction = consume_branch(9, false, &success);
-  else if (consume_keyword("bnps")) instruction = consume_branch(10, false, &success);
-  else if (consume_keyword("bg")) instruction = consume_branch(11, false, &success);
-  else if (consume_keyword("bge")) instruction = consume_branch(12, false, &success);
-  else if (consume_keyword("bl")) instruction = consume_branch(13, false, &success);
-  else if (consume_keyword("ble")) instruction = consume_branch(14, false, &success);
-  else if (consume_keyword("ba")) instruction = consume_branch(15, false, &success);
-  else if (consume_keyword("bae")) instruction = consume_branch(16, false, &success);
-  else if (consume_keyword("bb")) instruction = consume_branch(17, false, &success);
-  else if (consume_keyword("bbe")) instruction = consume_branch(18, false, &success);
-  else if (consume_keyword("bra")) instruction = consume_branch(0, true, &success);
-  else if (consume_keyword("bza")) instruction = consume_branch(1, true, &success);
-  else if (consume_keyword("bnza")) instruction = consume_branch(2, true, &success);
-  else if (consume_keyword("bsa")) instruction = consume_branch(3, true, &success);
-  else if (consume_keyword("bnsa")) instruction = consume_branch(4, true, &success);
-  else if (consume_keyword("bca")) instruction = consume_branch(5, true, &success);
-  else if (consume_keyword("bnca")) instruction = consume_branch(6, true, &success);
-  else if (consume_keyword("boa")) instruction = consume_branch(7, true, &success);
-  else if (consume_keyword("bnoa")) instruction = consume_branch(8, true, &success);
-  else if (consume_keyword("bpa")) instruction = consume_branch(9, true, &success);
-  else if (consume_keyword("bnpa")) instruction = consume_branch(10, true, &success);
-  else if (consume_keyword("bga")) instruction = consume_branch(11, true, &success);
-  else if (consume_keyword("bgea")) instruction = consume_branch(12, true, &success);
-  else if (consume_keyword("bla")) instruction = consume_branch(13, true, &success);
-  else if (consume_keyword("blea")) instruction = consume_branch(14, true, &success);
-  else if (consume_keyword("baa")) instruction = consume_branch(15, true, &success);
-  else if (consume_keyword("baea")) instruction = consume_branch(16, true, &success);
-  else if (consume_keyword("bba")) instruction = consume_branch(17, true, &success);
-  else if (consume_keyword("bbea")) instruction = consume_branch(18, true, &success);
-  else if (consume_keyword("jmp")) instruction = consume_jmp(&success);
-
-  // pc-relative to absolute address
-  else if (consume_keyword("adpc")) instruction = consume_adpc(&success);
-  
-  // system calls
-  else if (consume_keyword("trap")) instruction = consume_trap(&success);
-  
-  // atomic instructions
-  else if (consume_keyword("fada")) instruction = consume_atomic(true, true, &success);
-  else if (consume_keyword("fad")) instruction = consume_atomic(false, true, &success);
-  else if (consume_keyword("swpa")) instruction = consume_atomic(true, false, &success);
-  else if (consume_keyword("swp")) instruction = consume_atomic(false, false, &success);
-
-  // privileged instructions
-  else if (consume_keyword("tlbr")) instruction = consume_tlb_op(0, &success);
-  else if (consume_keyword("tlbw")) instruction = consume_tlb_op(1, &success);
-  else if (consume_keyword("tlbi")) instruction = consume_tlb_op(2, &success);
-  else if (consume_keyword("tlbc")) instruction = consume_tlb_op(3, &success);
-  else if (consume_keyword("crmv")) instruction = consume_crmv(&success);
-  else if (consume_keyword("mode")) instruction = consume_mode_op(&success);
-  else if (consume_keyword("rfe")) instruction = consume_rfe(&success);
-  else if (consume_keyword("ipi")) instruction = consume_ipi(&success);
-  else if (consume_keyword("eoi")) instruction = consume_eoi(&success);
-  // hacks to make movi and call work
-  else if (consume_keyword("movu")) instruction = consume_mov_hack(0, &success);
-  else if (consume_keyword("movl")) instruction = consume_mov_hack(1, &success);
-
-  else *result = NOT_FOUND;
-  
+
+  const struct MnemonicDescriptor* op = accept_mnemonic(ctx);
+  if (op == NULL){
+    *result = NOT_FOUND;
+    return 0;
+  }
+
+  if (op->flags & ISA_PRIVILEGED){
+    check_privileges(ctx, &success);
+    if (!success){
+      *result = ERROR;
+      return 0;
+    }
+  }
+
+  switch (op->format){
+    case FORMAT_ALU: instruction = consume_alu_op(ctx, op, &success); break;
+    case FORMAT_LUI: instruction = consume_lui(ctx, op, &success); break;
+    case FORMAT_MEM: instruction = consume_mem(ctx, op, &success); break;
+    case FORMAT_BRANCH: instruction = consume_branch(ctx, op, &success); break;
+    case FORMAT_JMP: instruction = consume_jmp(ctx, op, &success); break;
+    case FORMAT_ADPC: instruction = consume_adpc(ctx, op, &success); break;
+    case FORMAT_TRAP: instruction = consume_trap(ctx, op, &success); break;
+    case FORMAT_ATOMIC: instruction = consume_atomic(ctx, op, &success); break;
+    case FORMAT_TLB: instruction = consume_tlb_op(ctx, op, &success); break;
+    case FORMAT_CRMV: instruction = consume_crmv(ctx, op, &success); break;
+    case FORMAT_MODE: instruction = consume_mode_op(ctx, op, &success); break;
+    case FORMAT_RFE: instruction = consume_rfe(ctx, op, &success); break;
+    case FORMAT_IPI: instruction = consume_ipi(ctx, op, &success); break;
+    case FORMAT_EOI: instruction = consume_eoi(ctx, op, &success); break;
+    case FORMAT_MOV_HACK: instruction = consume_mov_hack(ctx, op, &success); break;
+    case FORMAT_NOP: instruction = consume_nop(ctx, op, &success); break;
+    case FORMAT_RET: instruction = consume_ret(ctx, op, &success); break;
+    case FORMAT_STACK: instruction = consume_stack(ctx, op, &success); break;
+    case FORMAT_MOV: instruction = consume_mov(ctx, op, &success); break;
+    case FORMAT_MOVI: instruction = consume_movi(ctx, op, &success); break;
+    case FORMAT_CALL: instruction = consume_call(ctx, op, &success); break;
+  }
+
   if (!success) *result = ERROR;
-  
+
   return instruction;
 }
 
-// Purpose: First pass to collect labels and section sizes without emitting output.
-// Inputs: prog is the preprocessed source buffer for one file.
-// Outputs: Returns true on success; updates label maps and section offsets.
-// Invariants/Assumptions: current_file_index is set; section_offsets track byte offsets.
-bool process_labels(char const* const prog){
-  current = prog;
-  current_buffer_start = prog - 1;
-  line_count = 1;
-
-  local_labels[current_file_index] = create_hash_map(1000);
-  local_defines[current_file_index] = create_hash_map(1000);
-  local_globals[current_file_index] = create_hash_map(1000);
-  if (!apply_cli_defines()) return false;
-
-  while (!is_at_end()){
-
-    struct Slice* label = consume_label();
-    if (label != NULL) {
-      bool label_was_used = false;
-      if (!ensure_valid_section("label")) {
-        free(label);
-        return false;
-      }
-      long label_value = (long)encode_section_offset(current_section, section_offsets[current_section]);
-
-      // check for duplicates 
-      if (hash_map_contains(local_labels[current_file_index], label)){
-        if (label_has_definition(local_labels[current_file_index], label)){
-          // duplicate label error
-          print_error();
-          fprintf(stderr, "Duplicate label\n");
-          free(label);
-          return false;
-        } else {
-          make_defined(local_labels[current_file_index], label, label_value);
-        }
-      } else {
-        hash_map_insert(local_labels[current_file_index], label, label_value, true, current_section != TEXT_SECTION);
-        label_was_used = true;
-      }
+// Purpose: Create the label and define tables of the current file.
+// Inputs: ctx is the assembly being built.
+// Outputs: Returns false if a -D definition is invalid.
+// Invariants/Assumptions: current_file_index is set.
+static bool create_file_tables(struct AssemblerContext* ctx){
+  ctx->local_labels[ctx->current_file_index] = create_hash_map(64);
+  ctx->local_defines[ctx->current_file_index] = create_hash_map(64);
+  ctx->local_globals[ctx->current_file_index] = create_hash_map(64);
+  return apply_cli_defines(ctx);
+}
 
-      // Check for duplicates on globals explicitly declared in this file.
-      if (hash_map_contains(local_globals[current_file_index], label)){
-        if (label_has_definition(global_labels, label)){
-          // duplicate label error
-          print_error();
-          fprintf(stderr, "Duplicate global label\n");
-          if (!label_was_used) free(label);
-          return false;
-        } else {
-          make_defined(global_labels, label, label_value);
-        }
-      }
+/*
+  Define folding.
+  Once pass 1 has seen every file, each identifier token that names a .define
+  of its file is rewritten as an integer token holding the value, so pass 2
+  parses constants as literals and never looks in local_defines. A define is
+  left as a name when the name could mean something else: a label (labels win
+  over defines in consume_label_imm), a mnemonic or a register. The name
+  operand of .define, .global and .local is never folded.
+*/
 
-      if (!label_was_used) free(label);
+// Purpose: Check whether a name is a mnemonic or a register in some operand.
+// Invariants/Assumptions: name is NUL terminated. Any r/cr digit run counts,
+//                         even one out of range, so the check never has to
+//                         agree with numbered_register exactly.
+static bool is_reserved_name(struct Slice name){
+  if (lookup_mnemonic(name.start, name.len) != NULL) return true;
+  if (compare_slice_to_pointer(&name, "sp") || compare_slice_to_pointer(&name, "bp") || compare_slice_to_pointer(&name, "ra")) return true;
 
-    } else {
-      skip();
-      if (consume_keyword(".global")) {
-        struct Slice* label = consume_identifier();
-        if (label != NULL){
-          // Track per-file global declarations to detect duplicate exports.
-          if (!hash_map_contains(local_globals[current_file_index], label)){
-            struct Slice* label_copy = clone_slice(label);
-            hash_map_insert(local_globals[current_file_index], label_copy, 0, false,
-              current_section != TEXT_SECTION); // mark as data if not in text section
-          }
-          if (!hash_map_contains(global_labels, label)){
-            struct Slice* label_copy = clone_slice(label);
-            hash_map_insert(global_labels, label_copy, 0, false, current_section != TEXT_SECTION);
-          }
-
-          if (label_has_definition(local_labels[current_file_index], label)){
-            if (label_has_definition(global_labels, label)){
-              print_error();
-              fprintf(stderr, "Duplicate global label\n");
-              return false;
-            }
-            make_defined(global_labels, label, hash_map_get(local_labels[current_file_index], label));
-          }
-          free(label);
-        } else {
-          print_error();
-          fprintf(stderr, ".global directive requires a label\n");
-          return false;
-        }
+  size_t prefix = name.start[0] == 'r' ? 1 : (name.start[0] == 'c' && name.start[1] == 'r') ? 2 : 0;
+  if (prefix > 0 && name.len > prefix){
+    size_t i = prefix;
+    while (i < name.len && char_is(name.start[i], CHAR_DIGIT)) ++i;
+    if (i == name.len) return true;
+  }
 
-        continue;
-      } else if (consume_keyword(".origin")) { 
-        if (!is_kernel){
-          print_error();
-          fprintf(stderr, ".origin can only be used in kernel mode\n");
-          return false;
-        }
-        if (current_section != IMPLICIT_SECTION){
-          print_error();
-          fprintf(stderr, ".origin can only be used before selecting an explicit section\n");
-          fprintf(stderr, "Move .origin directives before .text/.rodata/.data/.bss\n");
-          return false;
-        }
+  int count = (int)(sizeof(kControlRegisterNames) / sizeof(kControlRegisterNames[0]));
+  for (int i = 0; i < count; ++i){
+    if (compare_slice_to_pointer(&name, kControlRegisterNames[i])) return true;
+  }
+  return false;
+}
 
-        enum ConsumeResult result;
-        long imm = consume_define_or_literal(&result, ".origin");
-        if (result != FOUND){
-          if (result == NOT_FOUND){
-            print_error();
-            fprintf(stderr, "Invalid .origin value; expected integer literal or .define constant\n");
-          }
-          return false;
-        }
-        if (imm < (long)section_offsets[current_section]){
-          print_error();
-          fprintf(stderr, ".origin cannot be used to go backwards\n");
-          return false;
-        } else if (imm >= ((long)1 << 32)){
-          print_error();
-          fprintf(stderr, ".origin address must be a 32 bit integer\n");
-          return false;
-        }
-        section_offsets[current_section] = (uint32_t)imm;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".text")) {
-        current_section = TEXT_SECTION;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".rodata")) {
-        current_section = RODATA_SECTION;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".data")) {
-        current_section = DATA_SECTION;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".bss")) {
-        current_section = BSS_SECTION;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".text_load")) {
-        if (!parse_section_load_directive(TEXT_SECTION, ".text_load")) return false;
-        continue;
-      }
-      else if (consume_keyword(".rodata_load")) {
-        if (!parse_section_load_directive(RODATA_SECTION, ".rodata_load")) return false;
-        continue;
-      }
-      else if (consume_keyword(".data_load")) {
-        if (!parse_section_load_directive(DATA_SECTION, ".data_load")) return false;
-        continue;
-      }
-      else if (consume_keyword(".bss_load")) {
-        if (!parse_section_load_directive(BSS_SECTION, ".bss_load")) return false;
-        continue;
-      }
-      else if (consume_keyword(".fill")) {
-        enum ConsumeResult result; 
-        consume_define_or_literal_or_label_abs(&result, ".fill");
-        if (result != FOUND){
-          if (result == NOT_FOUND){
-            print_error();
-            fprintf(stderr, "Invalid .fill immediate; expected integer literal, label, or .define constant\n");
-          }
-          return false;
-        }
-        if (!ensure_valid_section(".fill")) return false;
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, ".fill not allowed in .bss section\n");
-          return false;
-        }
-        section_offsets[current_section] += kWordBytes;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".fild")) {
-        enum ConsumeResult result; 
-        consume_define_or_literal(&result, ".fild");
-        if (result != FOUND){
-          if (result == NOT_FOUND){
-            print_error();
-            fprintf(stderr, "Invalid .fild immediate; expected integer literal or .define constant\n");
-          }
-          return false;
-        }
-        if (!ensure_valid_section(".fild")) return false;
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, ".fild not allowed in .bss section\n");
-          return false;
-        }
-        section_offsets[current_section] += kHalfBytes;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".filb")) {
-        enum ConsumeResult result; 
-        consume_define_or_literal(&result, ".filb");
-        if (result != FOUND){
-          if (result == NOT_FOUND){
-            print_error();
-            fprintf(stderr, "Invalid .filb immediate; expected integer literal or .define constant\n");
-          }
-          return false;
-        }
-        if (!ensure_valid_section(".filb")) return false;
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, ".filb not allowed in .bss section\n");
-          return false;
-        }
-        section_offsets[current_section] += kByteBytes;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".space")) { 
-        enum ConsumeResult result; 
-        long imm = consume_define_or_literal(&result, ".space");
-        if (result != FOUND){
-          if (result == NOT_FOUND){
-            print_error();
-            fprintf(stderr, "Invalid .space count; expected integer literal or .define constant\n");
-          }
-          return false;
-        }
-        if (!ensure_valid_section(".space")) return false;
-        section_offsets[current_section] += imm;
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".align")) {
-        enum ConsumeResult result;
-        uint32_t alignment = 0;
-        if (!parse_alignment(&result, ".align", &alignment)) return false;
-        if (!ensure_valid_section(".align")) return false;
-        section_offsets[current_section] =
-          align_up(section_offsets[current_section], alignment);
-        pc = section_offsets[current_section];
-        continue;
-      }
-      else if (consume_keyword(".define")) {
-        bool success = true;
-        record_define(&success);
-        if (!success) return false;
-        continue;
-      }
-      else if (consume_keyword(".line")) {
-        // handled in second pass
-        skip_line();
-        continue;
-      }
-      else if (consume_keyword(".local")) {
-        // handled in second pass
-        skip_line();
-        continue;
-      }
-      
-      enum ConsumeResult result = FOUND;
-      if (!ensure_valid_section("instruction")) return false;
-      if (current_section == BSS_SECTION){
-        print_error();
-        fprintf(stderr, "Instructions not allowed in .bss section\n");
-        return false;
-      }
-      if (section_offsets[current_section] % kWordBytes != 0){
-        return report_instruction_alignment_error(section_offsets[current_section], "section offset");
-      }
-      consume_instruction(&result);
-      if (result == ERROR) return false;
-      if (result == NOT_FOUND) {
-        print_error();
-        fprintf(stderr, "Unrecognized instruction\n");
-        return false;
-      }
-      section_offsets[current_section] += kWordBytes;
-      pc = section_offsets[current_section];
+// Purpose: Fold the defines of one file into its tokens.
+// Inputs: values and foldable are scratch arrays indexed by symbol id;
+//         foldable is all zero.
+// Outputs: Rewrites tokens in place; leaves foldable all zero.
+// Invariants/Assumptions: Pass 1 is done and the scope is created.
+static void fold_file_defines(struct AssemblerContext* ctx, int index, long* values, uint8_t* foldable){
+  struct HashMap* defines = ctx->local_defines[index];
+  size_t folded = 0;
+  size_t cursor = 0;
+  struct HashEntry* entry;
+  while ((entry = hash_map_next(defines, &cursor)) != NULL){
+    uint32_t symbol = entry->symbol;
+    if (scope_resolve(ctx->scope, index, symbol)->kind != SYMBOL_DEFINE ||
+        is_reserved_name(symbol_name(ctx->symbols, symbol))) continue;
+    values[symbol] = entry->value;
+    foldable[symbol] = 1;
+    folded++;
+  }
+  if (folded == 0) return;
+
+  struct TokenArray* tokens = ctx->file_tokens[index];
+  for (size_t i = 0; i < tokens->size; ++i){
+    struct Token* token = &tokens->tokens[i];
+    if (token->kind == TOKEN_DIRECTIVE &&
+        (token->value == DIRECTIVE_DEFINE || token->value == DIRECTIVE_GLOBAL || token->value == DIRECTIVE_LOCAL)){
+      ++i; // keep the name operand a name
+    } else if (token->kind == TOKEN_IDENTIFIER && foldable[token->value]){
+      token->kind = TOKEN_INTEGER;
+      token->value = values[token->value];
+    }
+  }
+
+  cursor = 0;
+  while ((entry = hash_map_next(defines, &cursor)) != NULL) foldable[entry->symbol] = 0;
+}
+
+// Purpose: Fold the defines of every file before pass 2.
+// Invariants/Assumptions: Two-pass mode only; single-pass mode parses each
+//                         token once, as its defines are recorded.
+static void fold_defines(struct AssemblerContext* ctx, int num_files){
+  uint32_t count = ctx->symbols->count;
+  if (count == 0) return;
+  long* values = malloc(count * sizeof(long));
+  uint8_t* foldable = calloc(count, 1);
+  for (int i = 0; i < num_files; ++i) fold_file_defines(ctx, i, values, foldable);
+  free(values);
+  free(foldable);
+}
+
+// Purpose: Define a label at the current section offset.
+// Inputs: label was just consumed.
+// Outputs: Returns false after reporting duplicates or a missing section.
+// Invariants/Assumptions: Label values are packed section offsets until layout.
+static bool define_label(struct AssemblerContext* ctx, uint32_t label){
+  if (!ensure_valid_section(ctx, "label")) return false;
+  long label_value = (long)encode_section_offset(ctx->current_section, ctx->section_offsets[ctx->current_section]);
+
+  // check for duplicates 
+  if (hash_map_contains(ctx->local_labels[ctx->current_file_index], label)){
+    if (label_has_definition(ctx->local_labels[ctx->current_file_index], label)){
+      // duplicate label error
+      print_error(ctx);
+      error_printf(ctx, "Duplicate label\n");
+      return false;
+    } else {
+      make_defined(ctx->local_labels[ctx->current_file_index], label, label_value);
+    }
+  } else {
+    hash_map_insert(ctx->local_labels[ctx->current_file_index], label, label_value, true,
+      ctx->current_section != TEXT_SECTION);
+  }
+
+  // Check for duplicates on globals explicitly declared in this file.
+  if (hash_map_contains(ctx->local_globals[ctx->current_file_index], label)){
+    if (label_has_definition(ctx->global_labels, label)){
+      // duplicate label error
+      print_error(ctx);
+      error_printf(ctx, "Duplicate global label\n");
+      return false;
+    } else {
+      make_defined(ctx->global_labels, label, label_value);
     }
   }
+
   return true;
 }
 
-// Purpose: Second pass to emit instruction/data bytes into output sections.
-// Inputs: prog is the preprocessed source buffer; instructions is the output list.
-// Outputs: Returns true on success; appends words to instruction arrays and updates bss_size.
-// Invariants/Assumptions: section_bases are computed; section_offsets track byte offsets.
-bool to_binary(char const* const prog, struct InstructionArrayList* instructions){
-  current = prog;
-  current_buffer_start = prog - 1;
-  line_count = 1;
-
-  enum ConsumeResult success = FOUND;
+// Purpose: Parse the operand of .global and export the label.
+// Inputs: ctx; the .global keyword was just consumed.
+// Outputs: Returns false after reporting a missing name or duplicate export.
+// Invariants/Assumptions: The label may be defined before or after the directive.
+static bool declare_global(struct AssemblerContext* ctx){
+  uint32_t label = accept_symbol(ctx);
+  if (label == NO_SYMBOL){
+    print_error(ctx);
+    error_printf(ctx, ".global directive requires a label\n");
+    return false;
+  }
 
-  while (success == FOUND){
-    // consume any labels, they were already dealt with
-    while (skip_newline(), skip_label(instructions));
-    skip_newline();
+  // Track per-file global declarations to detect duplicate exports.
+  if (!hash_map_contains(ctx->local_globals[ctx->current_file_index], label)){
+    hash_map_insert(ctx->local_globals[ctx->current_file_index], label, 0, false,
+      ctx->current_section != TEXT_SECTION); // mark as data if not in text section
+  }
+  if (!hash_map_contains(ctx->global_labels, label)){
+    hash_map_insert(ctx->global_labels, label, 0, false, ctx->current_section != TEXT_SECTION);
+  }
 
-    if (pc > ((long)1 << 32)){
-      print_error();
-      fprintf(stderr, "Program does not fit in 32-bit address space\n");
+  if (label_has_definition(ctx->local_labels[ctx->current_file_index], label)){
+    if (label_has_definition(ctx->global_labels, label)){
+      print_error(ctx);
+      error_printf(ctx, "Duplicate global label\n");
       return false;
     }
+    make_defined(ctx->global_labels, label, hash_map_get(ctx->local_labels[ctx->current_file_index], label));
+  }
+  return true;
+}
 
-    // directives
-    if (consume_keyword(".global")) {
-      // handled in first pass
-      struct Slice* name = consume_identifier();
-      if (name == NULL){
-        print_error();
-        fprintf(stderr, ".global directive requires a label\n");
-        return false;
-      }
-      if (!label_has_definition(global_labels, name)){
-        print_error();
-        fprintf(stderr, "Global label \"");
-        print_slice_err(name);
-        fprintf(stderr, "\" missing from first pass\n");
-        free(name);
-        return false;
-      }
-      free(name);
-    }
-    else if (consume_keyword(".define")){
-      skip_line();
-    } // handled in first pass
-    else if (consume_keyword(".origin")) { 
-      if (is_kernel){
-        enum ConsumeResult result;
-        long imm = consume_define_or_literal(&result, ".origin");
-        if (result != FOUND){
-          if (result == NOT_FOUND){
-            print_error();
-            fprintf(stderr, "Invalid .origin value; expected integer literal or .define constant\n");
-          }
-          return false;
-        }
-        if (current_section != IMPLICIT_SECTION){
-          print_error();
-          fprintf(stderr, ".origin can only be used before selecting an explicit section\n");
-          fprintf(stderr, "Move .origin directives before .text/.rodata/.data/.bss\n");
-          return false;
-        }
-        if (imm < (long)section_offsets[current_section]){
-          print_error();
-          fprintf(stderr, ".origin cannot be used to go backwards\n");
-          return false;
-        } else if (imm >= ((long)1 << 32)){
-          print_error();
-          fprintf(stderr, ".origin address must be a 32 bit integer\n");
-          return false;
-        }
-        uint32_t target = (uint32_t)imm;
-        uint32_t current = section_offsets[current_section];
-        uint32_t pad = target - current;
-        append_zero_bytes_user(section_arrays[current_section], pad, current_section);
-        pc = section_pc_base(current_section) + section_offsets[current_section];
-      } else {
-        print_error();
-        fprintf(stderr, ".origin can only be used in kernel mode\n");
-        return false;
-      }
-    }
-    else if (consume_keyword(".text")) {
-      current_section = TEXT_SECTION;
-      pc = section_pc_base(current_section) + section_offsets[current_section];
-    }
-    else if (consume_keyword(".rodata")) {
-      current_section = RODATA_SECTION;
-      pc = section_pc_base(current_section) + section_offsets[current_section];
-    }
-    else if (consume_keyword(".data")) {
-      current_section = DATA_SECTION;
-      pc = section_pc_base(current_section) + section_offsets[current_section];
-    }
-    else if (consume_keyword(".bss")) {
-      current_section = BSS_SECTION;
-      pc = section_pc_base(current_section) + section_offsets[current_section];
-    }
-    else if (consume_keyword(".text_load")) {
-      if (!parse_section_load_directive(TEXT_SECTION, ".text_load")) return false;
-    }
-    else if (consume_keyword(".rodata_load")) {
-      if (!parse_section_load_directive(RODATA_SECTION, ".rodata_load")) return false;
-    }
-    else if (consume_keyword(".data_load")) {
-      if (!parse_section_load_directive(DATA_SECTION, ".data_load")) return false;
-    }
-    else if (consume_keyword(".bss_load")) {
-      if (!parse_section_load_directive(BSS_SECTION, ".bss_load")) return false;
-    }
-    else if (consume_keyword(".fill")) {
-      enum ConsumeResult result; 
-      long imm = consume_define_or_literal_or_label_abs(&result, ".fill");
-      if (result != FOUND){
-        if (result == NOT_FOUND){
-          print_error();
-          fprintf(stderr, "Invalid .fill immediate; expected integer literal, label, or .define constant\n");
-        }
-        return false;
-      }
-      if (imm >= -((long)1 << 31) && imm < ((long)1 << 32)){
-        uint32_t value = (uint32_t)imm;
-        uint8_t bytes[kWordBytes];
-        encode_value_bytes(value, bytes, kWordBytes);
-        if (!ensure_valid_section(".fill")) return false;
-        if (current_section == TEXT_SECTION){
-          print_warning(".fill used in .text section");
-        }
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, ".fill not allowed in .bss section\n");
-          return false;
-        }
-        append_bytes_user(section_arrays[current_section], bytes, kWordBytes, current_section);
-      } else {
-        print_error();
-        fprintf(stderr, ".fill immediate must fit in a 32-bit value\n");
-        return false;
-      }
-    }
-    else if (consume_keyword(".fild")) {
-      enum ConsumeResult result; 
-      long imm = consume_define_or_literal(&result, ".fild");
-      if (result != FOUND){
-        if (result == NOT_FOUND){
-          print_error();
-          fprintf(stderr, "Invalid .fild immediate; expected integer literal or .define constant\n");
-        }
-        return false;
-      }
-      if (imm >= -((long)1 << 15) && imm < ((long)1 << 16)){
-        uint16_t value = (uint16_t)imm;
-        if (!ensure_valid_section(".fild")) return false;
-        if (current_section == TEXT_SECTION){
-          print_warning(".fild used in .text section");
-        }
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, ".fild not allowed in .bss section\n");
-          return false;
-        }
-        uint8_t bytes[kHalfBytes];
-        encode_value_bytes(value, bytes, kHalfBytes);
-        append_bytes_user(section_arrays[current_section], bytes, kHalfBytes, current_section);
-      } else {
-        print_error();
-        fprintf(stderr, ".fild immediate must fit in a 16-bit value\n");
-        return false;
-      }
+/*
+  Directive dispatch.
+  The lexer tags every directive token with its DirectiveId, and both passes
+  look the id up in kDirectiveHandlers instead of comparing the token against
+  each directive name in turn. Each directive has a sizing handler for the
+  first of two passes and an emitting handler for the second (the only pass
+  in single-pass mode). Data directives take their width from the table in
+  both passes, so the two cannot disagree about how many bytes a line adds.
+*/
+
+struct DirectiveHandlers;
+
+typedef bool (*DirectiveHandler)(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive);
+
+struct DirectiveHandlers {
+  enum DirectiveId id;
+  DirectiveHandler size;      // first pass: validate operands, advance the section offset
+  DirectiveHandler emit;      // second pass: append bytes, record metadata
+  enum UserSection section;   // section selected or relocated by the directive
+  uint8_t width;              // bytes appended by a data directive
+  bool takes_label;           // a data operand may be a label address
+};
+
+// pc at the current section offset while sizing, and at its address while emitting
+static void set_sizing_pc(struct AssemblerContext* ctx){
+  ctx->pc = ctx->section_offsets[ctx->current_section];
+}
+
+static void set_emitting_pc(struct AssemblerContext* ctx){
+  ctx->pc = section_pc_base(ctx, ctx->current_section) + ctx->section_offsets[ctx->current_section];
+}
+
+static bool size_global(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  return declare_global(ctx);
+}
+
+static bool emit_global(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  if (ctx->single_pass) return declare_global(ctx);
+
+  // handled in first pass
+  (void)directive;
+  uint32_t name = accept_symbol(ctx);
+  if (name == NO_SYMBOL){
+    print_error(ctx);
+    error_printf(ctx, ".global directive requires a label\n");
+    return false;
+  }
+  if (!label_has_definition(ctx->global_labels, name)){
+    print_error(ctx);
+    error_printf(ctx, "Global label \"");
+    print_symbol_err(ctx, name);
+    error_printf(ctx, "\" missing from first pass\n");
+    return false;
+  }
+  return true;
+}
+
+static bool size_define(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  bool success = true;
+  record_define(ctx, &success);
+  return success;
+}
+
+static bool emit_define(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  if (ctx->single_pass) return size_define(ctx, directive);
+  skip_rest_of_line(ctx); // handled in first pass
+  return true;
+}
+
+// Purpose: Parse and check the target of .origin.
+// Outputs: Returns false after reporting; fills target on success.
+static bool parse_origin(struct AssemblerContext* ctx, uint32_t* target){
+  if (!ctx->is_kernel){
+    print_error(ctx);
+    error_printf(ctx, ".origin can only be used in kernel mode\n");
+    return false;
+  }
+  if (ctx->current_section != IMPLICIT_SECTION){
+    print_error(ctx);
+    error_printf(ctx, ".origin can only be used before selecting an explicit section\n");
+    error_printf(ctx, "Move .origin directives before .text/.rodata/.data/.bss\n");
+    return false;
+  }
+
+  enum ConsumeResult result;
+  long imm = consume_define_or_literal(ctx, &result, ".origin");
+  if (result != FOUND){
+    if (result == NOT_FOUND){
+      print_error(ctx);
+      error_printf(ctx, "Invalid .origin value; expected integer literal or .define constant\n");
     }
-    else if (consume_keyword(".filb")) {
-      enum ConsumeResult result; 
-      long imm = consume_define_or_literal(&result, ".filb");
-      if (result != FOUND){
-        if (result == NOT_FOUND){
-          print_error();
-          fprintf(stderr, "Invalid .filb immediate; expected integer literal or .define constant\n");
-        }
-        return false;
-      }
-      if (imm >= -((long)1 << 7) && imm < ((long)1 << 8)){
-        uint8_t value = (uint8_t)imm;
-        if (!ensure_valid_section(".filb")) return false;
-        if (current_section == TEXT_SECTION){
-          print_warning(".filb used in .text section");
-        }
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, ".filb not allowed in .bss section\n");
-          return false;
-        }
-        append_bytes_user(section_arrays[current_section], &value, kByteBytes, current_section);
-      } else {
-        print_error();
-        fprintf(stderr, ".filb immediate must fit in an 8-bit value\n");
-        return false;
-      }
+    return false;
+  }
+  if (imm < (long)ctx->section_offsets[ctx->current_section]){
+    print_error(ctx);
+    error_printf(ctx, ".origin cannot be used to go backwards\n");
+    return false;
+  } else if (imm >= ((long)1 << 32)){
+    print_error(ctx);
+    error_printf(ctx, ".origin address must be a 32 bit integer\n");
+    return false;
+  }
+  *target = (uint32_t)imm;
+  return true;
+}
+
+static bool size_origin(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  uint32_t target;
+  if (!parse_origin(ctx, &target)) return false;
+  ctx->section_offsets[ctx->current_section] = target;
+  set_sizing_pc(ctx);
+  return true;
+}
+
+static bool emit_origin(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  uint32_t target;
+  if (!parse_origin(ctx, &target)) return false;
+  uint32_t pad = target - ctx->section_offsets[ctx->current_section];
+  append_zero_bytes_user(ctx, ctx->section_arrays[ctx->current_section], pad, ctx->current_section);
+  set_emitting_pc(ctx);
+  return true;
+}
+
+static bool size_section(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  ctx->current_section = directive->section;
+  set_sizing_pc(ctx);
+  return true;
+}
+
+static bool emit_section(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  ctx->current_section = directive->section;
+  set_emitting_pc(ctx);
+  return true;
+}
+
+// .text_load and friends do the same work in both passes
+static bool section_load(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  return parse_section_load_directive(ctx, directive->section, directive_name(directive->id));
+}
+
+// Purpose: Parse the operand of .fill, .fild or .filb.
+// Outputs: Returns false after reporting a missing or malformed operand.
+static bool parse_data_operand(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive, long* imm){
+  const char* name = directive_name(directive->id);
+  enum ConsumeResult result;
+  *imm = directive->takes_label ? consume_define_or_literal_or_label_abs(ctx, &result, name)
+                                : consume_define_or_literal(ctx, &result, name);
+  if (result != FOUND){
+    if (result == NOT_FOUND){
+      print_error(ctx);
+      error_printf(ctx, "Invalid %s immediate; expected integer literal%s or .define constant\n", name,
+        directive->takes_label ? ", label," : "");
     }
-    else if (consume_keyword(".space")) { 
-      enum ConsumeResult result; 
-      long imm = consume_define_or_literal(&result, ".space");
-      if (result != FOUND){
-        if (result == NOT_FOUND){
-          print_error();
-          fprintf(stderr, "Invalid .space count; expected integer literal or .define constant\n");
-        }
-        return false;
-      }
-      if (0 <= imm && imm < ((long)1 << 32)){
-        if (!ensure_valid_section(".space")) return false;
-        if (current_section == BSS_SECTION){
-          bss_size += (uint32_t)imm;
-          section_offsets[current_section] += (uint32_t)imm;
-          pc = section_pc_base(current_section) + section_offsets[current_section];
-        } else {
-          append_zero_bytes_user(section_arrays[current_section], (uint32_t)imm, current_section);
-        }
-      } else {
-        print_error();
-        fprintf(stderr, ".space immediate must be a positive 32 bit integer\n");
-        return false;
-      }
+    return false;
+  }
+  return true;
+}
+
+// Purpose: Report a data directive used in .bss, which holds no bytes.
+static bool reject_bss(struct AssemblerContext* ctx, const char* name){
+  if (ctx->current_section == BSS_SECTION){
+    print_error(ctx);
+    error_printf(ctx, "%s not allowed in .bss section\n", name);
+    return false;
+  }
+  return true;
+}
+
+static bool size_data(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  long imm;
+  if (!parse_data_operand(ctx, directive, &imm)) return false;
+  if (!ensure_valid_section(ctx, directive_name(directive->id))) return false;
+  if (!reject_bss(ctx, directive_name(directive->id))) return false;
+  ctx->section_offsets[ctx->current_section] += directive->width;
+  set_sizing_pc(ctx);
+  return true;
+}
+
+static bool emit_data(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  const char* name = directive_name(directive->id);
+  long imm;
+  if (!parse_data_operand(ctx, directive, &imm)) return false;
+
+  // signed or unsigned values of the directive's width are accepted
+  int bits = 8 * directive->width;
+  if (imm < -((long)1 << (bits - 1)) || imm >= ((long)1 << bits)){
+    print_error(ctx);
+    error_printf(ctx, "%s immediate must fit in %s %d-bit value\n", name, bits == 8 ? "an" : "a", bits);
+    return false;
+  }
+
+  if (!ensure_valid_section(ctx, name)) return false;
+  if (ctx->current_section == TEXT_SECTION){
+    char warning[32];
+    snprintf(warning, sizeof(warning), "%s used in .text section", name);
+    print_warning(ctx, warning);
+  }
+  if (!reject_bss(ctx, name)) return false;
+
+  uint8_t bytes[kWordBytes];
+  encode_value_bytes((uint32_t)imm, bytes, directive->width);
+  uint64_t site = encode_section_offset(ctx->current_section, ctx->section_offsets[ctx->current_section]);
+  append_bytes_user(ctx, ctx->section_arrays[ctx->current_section], bytes, directive->width, ctx->current_section);
+  commit_pending_fixup(ctx, site);
+  return true;
+}
+
+// Purpose: Parse the byte count of .space.
+static bool parse_space(struct AssemblerContext* ctx, long* imm){
+  enum ConsumeResult result;
+  *imm = consume_define_or_literal(ctx, &result, ".space");
+  if (result != FOUND){
+    if (result == NOT_FOUND){
+      print_error(ctx);
+      error_printf(ctx, "Invalid .space count; expected integer literal or .define constant\n");
     }
-    else if (consume_keyword(".line")) {
-      // Parse filename and line number; record the address of the next instruction.
-      struct Slice* filename = consume_filename();
-      if (filename == NULL){
-        print_error();
-        fprintf(stderr, ".line directive requires a filename\n");
-        return false;
-      }
-      enum ConsumeResult result;
-      long line_num = consume_literal(&result);
-      if (result != FOUND){
-        print_error();
-        fprintf(stderr, ".line directive requires a line number\n");
-        free(filename);
-        return false;
-      }
-      add_debug_line(debug_info_list, filename, line_num, (uint32_t)pc);
-      free(filename);
-    }
-    else if (consume_keyword(".local")) {
-      // Parse name and bp offset; record the address where locals become visible.
-      struct Slice* varname = consume_identifier();
-      if (varname == NULL){
-        print_error();
-        fprintf(stderr, ".local directive requires a variable name\n");
-        return false;
-      }
-      enum ConsumeResult result;
-      long bp_offset = consume_literal(&result);
-      if (result != FOUND){
-        print_error();
-        fprintf(stderr, ".local directive requires a bp offset\n");
-        free(varname);
-        return false;
-      }
-      long size_value = consume_literal(&result);
-      if (result != FOUND){
-        print_error();
-        fprintf(stderr, ".local directive requires a size in bytes\n");
-        free(varname);
-        return false;
-      }
-      if (size_value <= 0 || size_value > UINT32_MAX) {
-        print_error();
-        fprintf(stderr, ".local directive size must be a positive 32-bit value\n");
-        free(varname);
-        return false;
-      }
-      add_debug_local(debug_info_list, varname, bp_offset, (size_t)size_value, (uint32_t)pc);
-      free(varname);
+    return false;
+  }
+  return true;
+}
+
+static bool size_space(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  long imm;
+  if (!parse_space(ctx, &imm)) return false;
+  if (!ensure_valid_section(ctx, ".space")) return false;
+  ctx->section_offsets[ctx->current_section] += imm;
+  set_sizing_pc(ctx);
+  return true;
+}
+
+// Purpose: Advance the current section by count zero bytes; .bss only grows.
+static void emit_zero_bytes(struct AssemblerContext* ctx, uint32_t count){
+  if (ctx->current_section == BSS_SECTION){
+    ctx->bss_size += count;
+    ctx->section_offsets[ctx->current_section] += count;
+    set_emitting_pc(ctx);
+  } else {
+    append_zero_bytes_user(ctx, ctx->section_arrays[ctx->current_section], count, ctx->current_section);
+  }
+}
+
+static bool emit_space(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  long imm;
+  if (!parse_space(ctx, &imm)) return false;
+  if (imm < 0 || imm >= ((long)1 << 32)){
+    print_error(ctx);
+    error_printf(ctx, ".space immediate must be a positive 32 bit integer\n");
+    return false;
+  }
+  if (!ensure_valid_section(ctx, ".space")) return false;
+  emit_zero_bytes(ctx, (uint32_t)imm);
+  return true;
+}
+
+static bool size_align(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  enum ConsumeResult result;
+  uint32_t alignment = 0;
+  if (!parse_alignment(ctx, &result, ".align", &alignment)) return false;
+  if (!ensure_valid_section(ctx, ".align")) return false;
+  ctx->section_offsets[ctx->current_section] = align_up(ctx->section_offsets[ctx->current_section], alignment);
+  set_sizing_pc(ctx);
+  return true;
+}
+
+static bool emit_align(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  enum ConsumeResult result;
+  uint32_t alignment = 0;
+  if (!parse_alignment(ctx, &result, ".align", &alignment)) return false;
+  if (!ensure_valid_section(ctx, ".align")) return false;
+  uint32_t offset = ctx->section_offsets[ctx->current_section];
+  emit_zero_bytes(ctx, align_up(offset, alignment) - offset);
+  return true;
+}
+
+// .line and .local are recorded in the second pass
+static bool skip_debug_directive(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  skip_rest_of_line(ctx);
+  return true;
+}
+
+static bool emit_line(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  // Parse filename and line number; record the address of the next instruction.
+  struct Slice filename = accept_filename(ctx);
+  if (filename.start == NULL){
+    print_error(ctx);
+    error_printf(ctx, ".line directive requires a filename\n");
+    return false;
+  }
+  enum ConsumeResult result;
+  long line_num = accept_literal(ctx, &result);
+  if (result != FOUND){
+    print_error(ctx);
+    error_printf(ctx, ".line directive requires a line number\n");
+    return false;
+  }
+  size_t record = add_debug_line(ctx->debug_info_list, &filename, line_num, (uint32_t)ctx->pc);
+  if (ctx->single_pass) defer_debug_addr(ctx, record);
+  return true;
+}
+
+static bool emit_local(struct AssemblerContext* ctx, const struct DirectiveHandlers* directive){
+  (void)directive;
+  // Parse name and bp offset; record the address where locals become visible.
+  struct Slice varname = accept_identifier(ctx);
+  if (varname.start == NULL){
+    print_error(ctx);
+    error_printf(ctx, ".local directive requires a variable name\n");
+    return false;
+  }
+  enum ConsumeResult result;
+  long bp_offset = accept_literal(ctx, &result);
+  if (result != FOUND){
+    print_error(ctx);
+    error_printf(ctx, ".local directive requires a bp offset\n");
+    return false;
+  }
+  long size_value = accept_literal(ctx, &result);
+  if (result != FOUND){
+    print_error(ctx);
+    error_printf(ctx, ".local directive requires a size in bytes\n");
+    return false;
+  }
+  if (size_value <= 0 || size_value > UINT32_MAX) {
+    print_error(ctx);
+    error_printf(ctx, ".local directive size must be a positive 32-bit value\n");
+    return false;
+  }
+  size_t record = add_debug_local(ctx->debug_info_list, &varname, bp_offset, (size_t)size_value,
+    (uint32_t)ctx->pc);
+  if (ctx->single_pass) defer_debug_addr(ctx, record);
+  return true;
+}
+
+static const struct DirectiveHandlers kDirectiveHandlers[DIRECTIVE_COUNT] = {
+  [DIRECTIVE_GLOBAL]      = {DIRECTIVE_GLOBAL, size_global, emit_global, 0, 0, false},
+  [DIRECTIVE_DEFINE]      = {DIRECTIVE_DEFINE, size_define, emit_define, 0, 0, false},
+  [DIRECTIVE_ORIGIN]      = {DIRECTIVE_ORIGIN, size_origin, emit_origin, 0, 0, false},
+  [DIRECTIVE_TEXT]        = {DIRECTIVE_TEXT, size_section, emit_section, TEXT_SECTION, 0, false},
+  [DIRECTIVE_RODATA]      = {DIRECTIVE_RODATA, size_section, emit_section, RODATA_SECTION, 0, false},
+  [DIRECTIVE_DATA]        = {DIRECTIVE_DATA, size_section, emit_section, DATA_SECTION, 0, false},
+  [DIRECTIVE_BSS]         = {DIRECTIVE_BSS, size_section, emit_section, BSS_SECTION, 0, false},
+  [DIRECTIVE_TEXT_LOAD]   = {DIRECTIVE_TEXT_LOAD, section_load, section_load, TEXT_SECTION, 0, false},
+  [DIRECTIVE_RODATA_LOAD] = {DIRECTIVE_RODATA_LOAD, section_load, section_load, RODATA_SECTION, 0, false},
+  [DIRECTIVE_DATA_LOAD]   = {DIRECTIVE_DATA_LOAD, section_load, section_load, DATA_SECTION, 0, false},
+  [DIRECTIVE_BSS_LOAD]    = {DIRECTIVE_BSS_LOAD, section_load, section_load, BSS_SECTION, 0, false},
+  [DIRECTIVE_FILL]        = {DIRECTIVE_FILL, size_data, emit_data, 0, kWordBytes, true},
+  [DIRECTIVE_FILD]        = {DIRECTIVE_FILD, size_data, emit_data, 0, kHalfBytes, false},
+  [DIRECTIVE_FILB]        = {DIRECTIVE_FILB, size_data, emit_data, 0, kByteBytes, false},
+  [DIRECTIVE_SPACE]       = {DIRECTIVE_SPACE, size_space, emit_space, 0, 0, false},
+  [DIRECTIVE_ALIGN]       = {DIRECTIVE_ALIGN, size_align, emit_align, 0, 0, false},
+  [DIRECTIVE_LINE]        = {DIRECTIVE_LINE, skip_debug_directive, emit_line, 0, 0, false},
+  [DIRECTIVE_LOCAL]       = {DIRECTIVE_LOCAL, skip_debug_directive, emit_local, 0, 0, false},
+};
+
+// Purpose: Consume a known directive token.
+// Outputs: Returns its handlers, or NULL (consuming nothing) at any other token.
+static const struct DirectiveHandlers* accept_directive(struct AssemblerContext* ctx){
+  if (ctx->tok->kind != TOKEN_DIRECTIVE || ctx->tok->value == DIRECTIVE_NONE) return NULL;
+  const struct DirectiveHandlers* directive = &kDirectiveHandlers[ctx->tok->value];
+  advance(ctx);
+  return directive;
+}
+
+// Purpose: Drop what is left of a failed statement and count its error.
+// Outputs: Returns false once the error limit is reached.
+// Invariants/Assumptions: Parsing resumes at the next line; the statement's
+//                         pending label reference is discarded with it.
+static bool recover_statement(struct AssemblerContext* ctx){
+  skip_rest_of_line(ctx);
+  ctx->has_pending_fixup = false;
+  return finish_error(ctx);
+}
+
+// Purpose: Size one label, directive or instruction in the first pass.
+// Outputs: Returns false after reporting an error.
+static bool size_statement(struct AssemblerContext* ctx){
+  uint32_t label = accept_label(ctx);
+  if (label != NO_SYMBOL) return define_label(ctx, label);
+
+  const struct DirectiveHandlers* directive = accept_directive(ctx);
+  if (directive != NULL) return directive->size(ctx, directive);
+
+  enum ConsumeResult result = FOUND;
+  if (!ensure_valid_section(ctx, "instruction")) return false;
+  if (ctx->current_section == BSS_SECTION){
+    print_error(ctx);
+    error_printf(ctx, "Instructions not allowed in .bss section\n");
+    return false;
+  }
+  if (ctx->section_offsets[ctx->current_section] % kWordBytes != 0){
+    return report_instruction_alignment_error(ctx, ctx->section_offsets[ctx->current_section], "section offset");
+  }
+  consume_instruction(ctx, &result);
+  if (result == ERROR) return false;
+  if (result == NOT_FOUND) {
+    print_error(ctx);
+    error_printf(ctx, "Unrecognized instruction\n");
+    return false;
+  }
+  ctx->section_offsets[ctx->current_section] += kWordBytes;
+  ctx->pc = ctx->section_offsets[ctx->current_section];
+  return true;
+}
+
+// Purpose: First pass to collect labels and section sizes without emitting output.
+// Inputs: tokens is the token array of one preprocessed file.
+// Outputs: Returns false only when the file cannot be finished (error limit reached or
+//          no memory); statement errors are counted in error_count and skipped.
+// Invariants/Assumptions: current_file_index is set; section_offsets track byte offsets.
+bool process_labels(struct AssemblerContext* ctx, const struct TokenArray* tokens){
+  start_tokens(ctx, tokens);
+
+  if (!create_file_tables(ctx)) return false;
+
+  while (!at_end(ctx)){
+    if (!size_statement(ctx) && !recover_statement(ctx)) return false;
+  }
+  return true;
+}
+
+// Purpose: Emit the labels and the directive or instruction of one statement.
+// Outputs: Returns NOT_FOUND, consuming only labels, when no statement starts here,
+//          and ERROR after reporting an error.
+static enum ConsumeResult emit_statement(struct AssemblerContext* ctx){
+  if (ctx->single_pass){
+    // labels are defined as they are reached
+    uint32_t label;
+    while (skip_newlines(ctx), (label = accept_label(ctx)) != NO_SYMBOL){
+      if (!define_label(ctx, label)) return ERROR;
     }
-    else if (consume_keyword(".align")) {
-      enum ConsumeResult result;
-      uint32_t alignment = 0;
-      if (!parse_alignment(&result, ".align", &alignment)) return false;
-
-      if (!ensure_valid_section(".align")) return false;
-      uint32_t current = section_offsets[current_section];
-      uint32_t aligned = align_up(current, alignment);
-      uint32_t pad = aligned - current;
-      if (current_section == BSS_SECTION){
-        bss_size += pad;
-        section_offsets[current_section] += pad;
-        pc = section_pc_base(current_section) + section_offsets[current_section];
-      } else {
-        append_zero_bytes_user(section_arrays[current_section], pad, current_section);
-      }
-      continue;
-    } else {
-      if (!ensure_valid_section("instruction")) return false;
-      pc = section_pc_base(current_section) + section_offsets[current_section];
-      int instruction = consume_instruction(&success);
-      if (success == FOUND) {
-        if (current_section == BSS_SECTION){
-          print_error();
-          fprintf(stderr, "Instructions not allowed in .bss section\n");
-          return false;
-        }
-        if (section_offsets[current_section] % kWordBytes != 0){
-          return report_instruction_alignment_error((uint32_t)pc, "pc");
-        }
-        if (current_section == RODATA_SECTION){
-          print_warning("Instruction emitted in .rodata section");
-        } else if (current_section == DATA_SECTION){
-          print_warning("Instruction emitted in .data section");
-        }
-        instruction_array_append(section_arrays[current_section], instruction);
-        section_offsets[current_section] += kWordBytes;
-        pc = section_pc_base(current_section) + section_offsets[current_section];
-      }
-      else if (success == ERROR) return false;
+  } else {
+    // consume any labels, they were already dealt with
+    while (skip_newlines(ctx), skip_label(ctx));
+  }
+  skip_newlines(ctx);
+
+  // addresses are checked after layout in single-pass mode
+  if (!ctx->single_pass && ctx->pc > ((long)1 << 32)){
+    print_error(ctx);
+    error_printf(ctx, "Program does not fit in 32-bit address space\n");
+    return ERROR;
+  }
+
+  const struct DirectiveHandlers* directive = accept_directive(ctx);
+  if (directive != NULL) return directive->emit(ctx, directive) ? FOUND : ERROR;
+
+  // a file may end outside any section (or be empty) without error
+  if (at_end(ctx)) return NOT_FOUND;
+  if (!ensure_valid_section(ctx, "instruction")) return ERROR;
+  ctx->pc = section_pc_base(ctx, ctx->current_section) + ctx->section_offsets[ctx->current_section];
+  enum ConsumeResult result = FOUND;
+  int instruction = consume_instruction(ctx, &result);
+  if (result == FOUND && !emit_instruction_word(ctx, instruction)) return ERROR;
+  return result;
+}
+
+// Purpose: Second pass to emit instruction/data bytes into output sections.
+// Inputs: tokens is the token array of one preprocessed file; instructions is the output list.
+// Outputs: Returns false only when the file cannot be finished (error limit reached);
+//          statement errors are counted in error_count and skipped. Appends words to
+//          instruction arrays and updates bss_size.
+// Invariants/Assumptions: section_bases are computed; section_offsets track byte offsets.
+//                         In single-pass mode this is the only pass: it also records
+//                         labels, globals and defines, and defers label immediates.
+bool to_binary(struct AssemblerContext* ctx, const struct TokenArray* tokens,
+  struct InstructionArrayList* instructions){
+  start_tokens(ctx, tokens);
+
+  if (ctx->single_pass && !create_file_tables(ctx)) return false;
+
+  while (true){
+    enum ConsumeResult result = emit_statement(ctx);
+    if (result == FOUND) continue;
+    if (result == NOT_FOUND){
+      if (at_end(ctx)) return true;
+      print_error(ctx);
+      error_printf(ctx, "Unrecognized instruction\n");
+    }
+    if (!recover_statement(ctx)) return false;
+    // nothing after an address space overflow can be placed either
+    if (!ctx->single_pass && ctx->pc > ((long)1 << 32)) return false;
+    // recovery cannot move past the end, so stop rather than fail there again
+    if (ctx->tok->kind == TOKEN_EOF) return true;
+  }
+}
+
+// Purpose: Release the token arrays of the first count files and the symbols they name.
+static void destroy_file_tokens(struct AssemblerContext* ctx, int count){
+  for (int i = 0; i < count; ++i) destroy_token_array(ctx->file_tokens[i]);
+  free(ctx->file_tokens);
+  ctx->file_tokens = NULL;
+  destroy_symbol_table(ctx->symbols);
+  ctx->symbols = NULL;
+}
+
+// Purpose: Release the label and define tables of the first count files and the global table.
+static void destroy_file_tables(struct AssemblerContext* ctx, int count){
+  for (int j = 0; j < count; ++j) destroy_hash_map(ctx->local_labels[j]);
+  for (int j = 0; j < count; ++j) destroy_hash_map(ctx->local_defines[j]);
+  for (int j = 0; j < count; ++j) destroy_hash_map(ctx->local_globals[j]);
+  free(ctx->local_labels);
+  free(ctx->local_defines);
+  free(ctx->local_globals);
+  destroy_hash_map(ctx->global_labels);
+  destroy_scope(ctx->scope);
+  ctx->scope = NULL;
+  free(ctx->cli_define_values);
+  ctx->cli_define_values = NULL;
+}
+
+// Purpose: Size every section from its final offset and assign base addresses.
+// Inputs: ctx is the assembly being built.
+// Outputs: Fills section_sizes, section_bases, and section_load_bases.
+// Invariants/Assumptions: section_offsets hold the end offset of each section.
+static void layout_sections(struct AssemblerContext* ctx){
+  if (!ctx->is_kernel){
+    ctx->section_sizes[TEXT_SECTION] = align_up(ctx->section_offsets[TEXT_SECTION], kWordBytes);
+    ctx->section_sizes[RODATA_SECTION] = align_up(ctx->section_offsets[RODATA_SECTION], kWordBytes);
+    ctx->section_sizes[DATA_SECTION] = align_up(ctx->section_offsets[DATA_SECTION], kWordBytes);
+    ctx->section_sizes[BSS_SECTION] = ctx->section_offsets[BSS_SECTION];
+    compute_section_bases(ctx);
+  } else {
+    for (int i = 0; i < SECTION_COUNT; ++i){
+      ctx->section_sizes[i] = ctx->section_offsets[i];
     }
+    ctx->section_sizes[END_SECTION] = kWordBytes;
+    compute_kernel_section_bases(ctx);
   }
 
-  if (!is_at_end()) {
-    print_error();
-    fprintf(stderr, "Unrecognized instruction\n");
-    return false;
+  finalize_section_load_bases(ctx);
+}
+
+// Purpose: Create one output array per section, starting at the section base.
+// Inputs: instructions is a fresh list; its head becomes the first section.
+// Outputs: Fills section_arrays and the user-mode section array globals.
+// Invariants/Assumptions: section_bases are computed, or still zero in single-pass
+//                         mode, where set_section_origins moves them after layout.
+static void create_section_arrays(struct AssemblerContext* ctx, struct InstructionArrayList* instructions){
+  if (ctx->is_kernel){
+    instructions->head->origin = ctx->section_bases[IMPLICIT_SECTION];
+    ctx->section_arrays[IMPLICIT_SECTION] = instructions->head;
+    struct InstructionArray* arr_text = create_instruction_array(10, ctx->section_bases[TEXT_SECTION]);
+    struct InstructionArray* arr_rodata = create_instruction_array(10, ctx->section_bases[RODATA_SECTION]);
+    struct InstructionArray* arr_data = create_instruction_array(10, ctx->section_bases[DATA_SECTION]);
+    struct InstructionArray* arr_bss = create_instruction_array(10, ctx->section_bases[BSS_SECTION]);
+    struct InstructionArray* arr_end = create_instruction_array(10, ctx->section_bases[END_SECTION]);
+    instruction_array_list_append(instructions, arr_text);
+    instruction_array_list_append(instructions, arr_rodata);
+    instruction_array_list_append(instructions, arr_data);
+    instruction_array_list_append(instructions, arr_bss);
+    instruction_array_list_append(instructions, arr_end);
+    ctx->section_arrays[TEXT_SECTION] = arr_text;
+    ctx->section_arrays[RODATA_SECTION] = arr_rodata;
+    ctx->section_arrays[DATA_SECTION] = arr_data;
+    ctx->section_arrays[BSS_SECTION] = arr_bss;
+    ctx->section_arrays[END_SECTION] = arr_end;
+  } else {
+    struct InstructionArray* arr_text = instructions->head;
+    arr_text->origin = ctx->section_bases[TEXT_SECTION];
+    struct InstructionArray* arr_rodata = create_instruction_array(10, ctx->section_bases[RODATA_SECTION]);
+    struct InstructionArray* arr_data = create_instruction_array(10, ctx->section_bases[DATA_SECTION]);
+    instruction_array_list_append(instructions, arr_rodata);
+    instruction_array_list_append(instructions, arr_data);
+    ctx->section_arrays[TEXT_SECTION] = arr_text;
+    ctx->section_arrays[RODATA_SECTION] = arr_rodata;
+    ctx->section_arrays[DATA_SECTION] = arr_data;
   }
+}
 
+// Purpose: Move each section array to its base address once layout is known.
+static void set_section_origins(struct AssemblerContext* ctx){
+  for (int i = 0; i < SECTION_COUNT; ++i){
+    if (ctx->section_arrays[i] != NULL) ctx->section_arrays[i]->origin = (int)ctx->section_bases[i];
+  }
+}
+
+// Purpose: Check that every section ends inside the 32-bit address space.
+// Inputs: ctx is the assembly being built.
+// Outputs: Returns false after reporting an overflowing section.
+// Invariants/Assumptions: Replaces the per-statement pc check that the second pass
+//                         makes, since the single-pass walk only has section offsets.
+static bool sections_fit_address_space(struct AssemblerContext* ctx){
+  for (int i = 0; i < END_SECTION; ++i){
+    if (ctx->section_offsets[i] == 0) continue;
+    if ((uint64_t)ctx->section_load_bases[i] + ctx->section_offsets[i] > ((uint64_t)1 << 32)){
+      error_printf(ctx, "Program does not fit in 32-bit address space\n");
+      return false;
+    }
+  }
   return true;
 }
 
-static void append_labels_from_map(struct HashMap* map, struct LabelList* labels, uint32_t offset){
-  for (size_t i = 0; i < map->size; ++i){
-    struct HashEntry* entry = map->arr[i];
-    while (entry != NULL){
-      if (entry->is_defined){
-        uint32_t addr = (uint32_t)(entry->value + offset);
-        label_list_append(labels, entry->key->start, entry->key->len, addr, entry->is_data);
+// Purpose: Patch every deferred label immediate and debug address after layout.
+// Inputs: argv/file_names name the source files for diagnostics.
+// Outputs: Reports each undefined label or range error against the line that referenced
+//          the label, counting it in error_count; returns false once the error limit is reached.
+// Invariants/Assumptions: Label maps hold absolute addresses; section arrays are complete.
+static bool apply_fixups(struct AssemblerContext* ctx, const char* const* argv, const int* file_names){
+  // movi and call defer the same symbol once per word; report it once per statement
+  const struct Fixup* undefined = NULL;
+  for (size_t i = 0; i < ctx->fixups->size; ++i){
+    const struct Fixup* fixup = &ctx->fixups->fixups[i];
+    uint32_t site_addr = resolve_section_offset(ctx, fixup->site);
+    if (fixup->kind == FIXUP_DEBUG_ADDR){
+      ctx->debug_info_list->addrs[fixup->debug_record] = site_addr;
+      continue;
+    }
+
+    ctx->current_file_index = fixup->file_index;
+    ctx->current_file = argv[file_names[fixup->file_index]];
+    set_current_buffer(ctx, ctx->file_tokens[fixup->file_index]->source);
+    ctx->current = fixup->source;
+
+    uint32_t symbol = fixup->symbol;
+    const struct SymbolBinding* binding = scope_resolve(ctx->scope, ctx->current_file_index, symbol);
+    long addr = binding->value;
+    bool is_label = binding->kind == SYMBOL_LOCAL_LABEL || binding->kind == SYMBOL_GLOBAL_LABEL;
+    if (!is_label && !fixup->is_define){
+      if (undefined != NULL && undefined->source == fixup->source && undefined->symbol == symbol) continue;
+      undefined = fixup;
+      print_error(ctx);
+      error_printf(ctx, "%s", fixup->kind == FIXUP_WORD ? ".fill constant/label \"" : "Label \"");
+      print_symbol_err(ctx, symbol);
+      error_printf(ctx, "\" has not been defined\n");
+      if (!finish_error(ctx)) return false;
+      continue;
+    }
+
+    enum UserSection section = (enum UserSection)(fixup->site >> 32);
+    uint32_t offset = (uint32_t)fixup->site;
+    struct InstructionArray* arr = ctx->section_arrays[section];
+
+    if (fixup->kind == FIXUP_WORD){
+      uint8_t bytes[kWordBytes];
+      encode_value_bytes((uint32_t)addr, bytes, kWordBytes);
+      for (uint32_t b = 0; b < kWordBytes; ++b){
+        instruction_array_set_byte(arr, offset + b, bytes[b]);
       }
-      entry = entry->next;
+      continue;
     }
+
+    // label immediates are pc-relative and .define constants are not, like consume_label_imm in pass 2
+    long imm = is_label ? addr - (long)site_addr - 4 : fixup->define_value;
+    bool success = true;
+    int encoding = encode_field(ctx, fixup->kind, imm, &success);
+    if (!success){
+      if (!finish_error(ctx)) return false;
+      continue;
+    }
+
+    size_t index = offset / kWordBytes;
+    uint32_t word = (uint32_t)instruction_array_get(arr, index);
+    word = (word & ~kFixupFieldMasks[fixup->kind]) | (uint32_t)encoding;
+    instruction_array_set(arr, index, (int)word);
   }
+  return true;
 }
 
-// assemble an entire program
-struct ProgramDescriptor* assemble(int num_files, int* file_names, bool kernel,
-  const char *const *const argv, char** files, struct LabelList** labels_out,
+static void append_labels_from_map(const struct SymbolTable* symbols, struct HashMap* map,
+  struct LabelList* labels, uint32_t offset){
+  size_t cursor = 0;
+  struct HashEntry* entry;
+  while ((entry = hash_map_next(map, &cursor)) != NULL){
+    if (entry->is_defined){
+      uint32_t addr = (uint32_t)(entry->value + offset);
+      struct Slice name = symbol_name(symbols, entry->symbol);
+      label_list_append(labels, name.start, name.len, addr, entry->is_data);
+    }
+  }
+}
+
+// Purpose: Free the debug list of a failed assembly, or one the caller did not ask for.
+static void release_debug_info(struct AssemblerContext* ctx, struct DebugInfoList** labels_out_c){
+  if (labels_out_c != NULL) *labels_out_c = NULL;
+  destroy_debug_info_list(ctx->debug_info_list);
+  ctx->debug_info_list = NULL;
+}
+
+// Purpose: Record what each subsystem holds for --mem-stats.
+// Inputs: the first table_count files have label/define tables; instructions
+//         and labels may be NULL.
+static void record_memory(struct AssemblerContext* ctx, int num_files, int table_count,
+  const struct InstructionArrayList* instructions, const struct LabelList* labels){
+  size_t tokens = 0;
+  if (ctx->file_tokens != NULL){
+    for (int i = 0; i < num_files; ++i) tokens += token_array_footprint(ctx->file_tokens[i]);
+  }
+
+  size_t symbols = symbol_table_footprint(ctx->symbols) + scope_footprint(ctx->scope);
+  for (int i = 0; i < table_count; ++i){
+    symbols += hash_map_footprint(ctx->local_labels[i]) + hash_map_footprint(ctx->local_defines[i]) +
+      hash_map_footprint(ctx->local_globals[i]);
+  }
+  if (table_count > 0) symbols += hash_map_footprint(ctx->global_labels);
+
+  mem_stats_record(ctx->mem_stats, MEM_TOKENS, tokens);
+  mem_stats_record(ctx->mem_stats, MEM_SYMBOLS, symbols);
+  mem_stats_record(ctx->mem_stats, MEM_INSTRUCTIONS,
+    instruction_array_list_footprint(instructions) + fixup_array_footprint(ctx->fixups));
+  mem_stats_record(ctx->mem_stats, MEM_DEBUG_INFO, debug_info_footprint(ctx->debug_info_list));
+  mem_stats_record(ctx->mem_stats, MEM_LABELS, label_list_footprint(labels));
+}
+
+// Where pass 1 left the sections at the end of a file.
+struct SectionCursor {
+  enum UserSection section;
+  uint32_t offsets[SECTION_COUNT];
+  bool had_errors;   // pass 1 reported an error in the file
+};
+
+// Purpose: Move pass 2 past a file it does not emit, to where pass 1 ended it.
+// Outputs: Pads each section with zeros up to the pass 1 offsets, so the files
+//          after it are emitted at the addresses pass 1 gave their labels.
+static void skip_file_output(struct AssemblerContext* ctx, const struct SectionCursor* end){
+  for (int i = 0; i < SECTION_COUNT; ++i){
+    if (end->offsets[i] <= ctx->section_offsets[i]) continue;
+    ctx->current_section = (enum UserSection)i;
+    emit_zero_bytes(ctx, end->offsets[i] - ctx->section_offsets[i]);
+  }
+  ctx->current_section = end->section;
+  if (is_section_in_range(ctx, ctx->current_section)) set_emitting_pc(ctx);
+}
+
+// assemble an entire program; diagnostics are left buffered for assemble to print
+static struct ProgramDescriptor* assemble_files(struct AssemblerContext* ctx, int num_files, int* file_names,
+  bool kernel, const char *const *const argv, char** files, struct LabelList** labels_out,
   struct DebugInfoList** labels_out_c){
 
-  is_kernel = kernel;
-  pass_number = 1;
-  current_section = is_kernel ? IMPLICIT_SECTION : -1;
-  text_instruction_array = NULL;
-  rodata_instruction_array = NULL;
-  data_instruction_array = NULL;
-  for (int i = 0; i < SECTION_COUNT; ++i) section_arrays[i] = NULL;
-  bss_size = 0;
-  reset_section_offsets();
-  reset_section_load_bases();
-  for (int i = 0; i < SECTION_COUNT; ++i) section_sizes[i] = 0;
-  for (int i = 0; i < SECTION_COUNT; ++i) section_bases[i] = 0;
-
-  debug_info_list = create_debug_info_list();
+  ctx->error_count = 0;
+  ctx->has_printed_error = false;
+  ctx->is_kernel = kernel;
+  ctx->pass_number = 1;
+  ctx->current_section = ctx->is_kernel ? IMPLICIT_SECTION : -1;
+  for (int i = 0; i < SECTION_COUNT; ++i) ctx->section_arrays[i] = NULL;
+  ctx->bss_size = 0;
+  reset_section_offsets(ctx);
+  reset_section_load_bases(ctx);
+  for (int i = 0; i < SECTION_COUNT; ++i) ctx->section_sizes[i] = 0;
+  for (int i = 0; i < SECTION_COUNT; ++i) ctx->section_bases[i] = 0;
+
+  ctx->debug_info_list = create_debug_info_list();
 
   if (labels_out != NULL) *labels_out = NULL;
   if (labels_out_c != NULL) {
-    *labels_out_c = debug_info_list;
+    *labels_out_c = ctx->debug_info_list;
   }
 
-  current_file_index = 0;
+  ctx->current_file_index = 0;
 
-  local_labels = malloc(num_files * sizeof(struct HashMap*));
-  local_defines = malloc(num_files * sizeof(struct HashMap*));
-  local_globals = malloc(num_files * sizeof(struct HashMap*));
+  // lex every file once; both passes walk these tokens
+  ctx->file_tokens = malloc(num_files * sizeof(struct TokenArray*));
+  ctx->symbols = create_symbol_table();
+  for (int i = 0; i < num_files; ++i){
+    ctx->file_tokens[i] = create_token_array(files[i], 256);
+    tokenize(ctx, files[i], ctx->file_tokens[i]);
+  }
+  if (ctx->mem_stats != NULL){
+    record_memory(ctx, num_files, 0, NULL, NULL);
+    mem_stats_end_phase(ctx->mem_stats, "tokenize");
+  }
+
+  ctx->local_labels = malloc(num_files * sizeof(struct HashMap*));
+  ctx->local_defines = malloc(num_files * sizeof(struct HashMap*));
+  ctx->local_globals = malloc(num_files * sizeof(struct HashMap*));
 
   // make a hashmap of labels for each file + one global hashmap for global labels
-  global_labels = create_hash_map(1000);
-  pc = 0;
-  for (int i = 0; i < num_files; ++i){
-    current_file_index = i;
-    current_file = argv[file_names[i]];
-    if (!process_labels(files[i] + 1)) {
-      for (int j = 0; j <= i; ++j) destroy_hash_map(local_labels[j]);
-      for (int j = 0; j <= i; ++j) destroy_hash_map(local_defines[j]);
-      for (int j = 0; j <= i; ++j) destroy_hash_map(local_globals[j]);
-      free(local_labels);
-      free(local_defines);
-      free(local_globals);
-      destroy_hash_map(global_labels);
-      return NULL;
-    }
-  }
-
-  if (!is_kernel){
-    section_sizes[TEXT_SECTION] = align_up(section_offsets[TEXT_SECTION], kWordBytes);
-    section_sizes[RODATA_SECTION] = align_up(section_offsets[RODATA_SECTION], kWordBytes);
-    section_sizes[DATA_SECTION] = align_up(section_offsets[DATA_SECTION], kWordBytes);
-    section_sizes[BSS_SECTION] = section_offsets[BSS_SECTION];
-    compute_section_bases();
+  ctx->global_labels = create_hash_map(64);
+  ctx->pc = 0;
+
+  struct InstructionArrayList* instructions = NULL;
+  struct SectionCursor* file_ends = NULL;
+  if (ctx->single_pass){
+    // emit everything now; addresses are filled in by apply_fixups
+    ctx->fixups = create_fixup_array(256);
+    ctx->has_pending_fixup = false;
+    instructions = create_instruction_array_list();
+    create_section_arrays(ctx, instructions);
+    ctx->pc = ctx->is_kernel ? section_pc_base(ctx, IMPLICIT_SECTION) : section_pc_base(ctx, TEXT_SECTION);
+    for (int i = 0; i < num_files; ++i){
+      ctx->current_file_index = i;
+      ctx->current_file = argv[file_names[i]];
+      if (!to_binary(ctx, ctx->file_tokens[i], instructions)) {
+        destroy_file_tables(ctx, i + 1);
+        destroy_file_tokens(ctx, num_files);
+        destroy_instruction_array_list(instructions);
+        destroy_fixup_array(ctx->fixups);
+        ctx->fixups = NULL;
+        release_debug_info(ctx, labels_out_c);
+        return NULL;
+      }
+    }
   } else {
-    for (int i = 0; i < SECTION_COUNT; ++i){
-      section_sizes[i] = section_offsets[i];
+    file_ends = malloc(num_files * sizeof(struct SectionCursor));
+    for (int i = 0; i < num_files; ++i){
+      ctx->current_file_index = i;
+      ctx->current_file = argv[file_names[i]];
+      unsigned errors = ctx->error_count;
+      if (!process_labels(ctx, ctx->file_tokens[i])) {
+        destroy_file_tables(ctx, i + 1);
+        destroy_file_tokens(ctx, num_files);
+        free(file_ends);
+        release_debug_info(ctx, labels_out_c);
+        return NULL;
+      }
+      file_ends[i].section = ctx->current_section;
+      memcpy(file_ends[i].offsets, ctx->section_offsets, sizeof(ctx->section_offsets));
+      file_ends[i].had_errors = ctx->error_count > errors;
     }
-    section_sizes[END_SECTION] = kWordBytes;
-    compute_kernel_section_bases();
   }
 
-  finalize_section_load_bases();
+  if (ctx->mem_stats != NULL){
+    record_memory(ctx, num_files, num_files, instructions, NULL);
+    mem_stats_end_phase(ctx->mem_stats, "pass 1");
+  }
+
+  layout_sections(ctx);
 
-  for (int i = 0; i < num_files; ++i) adjust_label_map_for_sections(local_labels[i]);
-  adjust_label_map_for_sections(global_labels);
+  for (int i = 0; i < num_files; ++i) adjust_label_map_for_sections(ctx, ctx->local_labels[i]);
+  adjust_label_map_for_sections(ctx, ctx->global_labels);
 
-  if (!is_kernel){
-    struct Slice start_label = {"_start", 6};
-    if (!label_has_definition(global_labels, &start_label)){
-      fprintf(stderr, "Missing global label _start\n");
-      for (int j = 0; j < num_files; ++j) destroy_hash_map(local_labels[j]);
-      for (int j = 0; j < num_files; ++j) destroy_hash_map(local_defines[j]);
-      for (int j = 0; j < num_files; ++j) destroy_hash_map(local_globals[j]);
-      free(local_labels);
-      free(local_defines);
-      free(local_globals);
-      destroy_hash_map(global_labels);
-      return NULL;
+  ctx->pass_number = 2;
+
+  bool ok = true;
+  if (!ctx->is_kernel){
+    uint32_t start_label = intern_symbol(ctx->symbols, "_start", 6);
+    if (!label_has_definition(ctx->global_labels, start_label)){
+      // keep going, so the rest of the program is still checked
+      error_printf(ctx, "Missing global label _start\n");
+      ok = finish_error(ctx);
+    } else {
+      ctx->entry_point = (uint32_t)hash_map_get(ctx->global_labels, start_label);
+    }
+  }
+
+  // the tables are final from here on, so pass 2 can cache what names mean
+  ctx->scope = create_scope(ctx->symbols->count, ctx->local_labels, ctx->local_defines,
+    ctx->local_globals, ctx->global_labels);
+
+  if (ctx->single_pass){
+    if (ok){
+      set_section_origins(ctx);
+      ok = sections_fit_address_space(ctx) && apply_fixups(ctx, argv, file_names);
+    }
+    destroy_fixup_array(ctx->fixups);
+    ctx->fixups = NULL;
+  } else if (ok){
+    instructions = create_instruction_array_list();
+    create_section_arrays(ctx, instructions);
+
+    reset_section_offsets(ctx);
+    ctx->current_section = ctx->is_kernel ? IMPLICIT_SECTION : -1;
+    ctx->bss_size = 0;
+    fold_defines(ctx, num_files);
+    ctx->pc = ctx->is_kernel ? section_pc_base(ctx, IMPLICIT_SECTION) : section_pc_base(ctx, TEXT_SECTION);
+    for (int i = 0; ok && i < num_files; ++i){
+      // pass 2 would report the same statements again, at addresses that are off,
+      // so only files without pass 1 errors are checked for undefined labels and ranges
+      if (file_ends[i].had_errors){
+        skip_file_output(ctx, &file_ends[i]);
+        continue;
+      }
+      ctx->current_file_index = i;
+      ctx->current_file = argv[file_names[i]];
+      ok = to_binary(ctx, ctx->file_tokens[i], instructions);
     }
-    entry_point = (uint32_t)hash_map_get(global_labels, &start_label);
   }
+  free(file_ends);
 
-  pass_number = 2;
-
-  struct InstructionArrayList* instructions = create_instruction_array_list();
+  if (!ok || ctx->error_count > 0){
+    destroy_file_tables(ctx, num_files);
+    destroy_file_tokens(ctx, num_files);
+    if (instructions != NULL) destroy_instruction_array_list(instructions);
+    release_debug_info(ctx, labels_out_c);
+    return NULL;
+  }
 
-  if (is_kernel){
-    instructions->head->origin = section_bases[IMPLICIT_SECTION];
-    section_arrays[IMPLICIT_SECTION] = instructions->head;
-    struct InstructionArray* arr_text = create_instruction_array(10, section_bases[TEXT_SECTION]);
-    struct InstructionArray* arr_rodata = create_instruction_array(10, section_bases[RODATA_SECTION]);
-    struct InstructionArray* arr_data = create_instruction_array(10, section_bases[DATA_SECTION]);
-    struct InstructionArray* arr_bss = create_instruction_array(10, section_bases[BSS_SECTION]);
-    struct InstructionArray* arr_end = create_instruction_array(10, section_bases[END_SECTION]);
-    instruction_array_list_append(instructions, arr_text);
-    instruction_array_list_append(instructions, arr_rodata);
-    instruction_array_list_append(instructions, arr_data);
-    instruction_array_list_append(instructions, arr_bss);
-    instruction_array_list_append(instructions, arr_end);
-    section_arrays[TEXT_SECTION] = arr_text;
-    section_arrays[RODATA_SECTION] = arr_rodata;
-    section_arrays[DATA_SECTION] = arr_data;
-    section_arrays[BSS_SECTION] = arr_bss;
-    section_arrays[END_SECTION] = arr_end;
-  } else {
-    text_instruction_array = instructions->head;
-    text_instruction_array->origin = section_bases[TEXT_SECTION];
-    rodata_instruction_array = create_instruction_array(10, section_bases[RODATA_SECTION]);
-    data_instruction_array = create_instruction_array(10, section_bases[DATA_SECTION]);
-    instruction_array_list_append(instructions, rodata_instruction_array);
-    instruction_array_list_append(instructions, data_instruction_array);
-    section_arrays[TEXT_SECTION] = text_instruction_array;
-    section_arrays[RODATA_SECTION] = rodata_instruction_array;
-    section_arrays[DATA_SECTION] = data_instruction_array;
-  }
-
-  reset_section_offsets();
-  current_section = is_kernel ? IMPLICIT_SECTION : -1;
-  bss_size = 0;
-  pc = is_kernel ? section_pc_base(IMPLICIT_SECTION) : section_pc_base(TEXT_SECTION);
-  for (int i = 0; i < num_files; ++i){
-    current_file_index = i;
-    current_file = argv[file_names[i]];
-    if (!to_binary(files[i] + 1, instructions)){
-      for (int j = 0; j < num_files; ++j) destroy_hash_map(local_labels[j]);
-      for (int j = 0; j < num_files; ++j) destroy_hash_map(local_defines[j]);
-      for (int j = 0; j < num_files; ++j) destroy_hash_map(local_globals[j]);
-      free(local_labels);
-      free(local_defines);
-      free(local_globals);
-      destroy_hash_map(global_labels);
-      destroy_instruction_array_list(instructions);
-      return NULL;
-    }
-  }
-
-  if (is_kernel){
+  if (ctx->is_kernel){
     uint32_t sentinel = 0xAAAAAAAAu;
     uint8_t bytes[kWordBytes];
     encode_value_bytes(sentinel, bytes, kWordBytes);
-    append_bytes_user(section_arrays[END_SECTION], bytes, kWordBytes, END_SECTION);
+    append_bytes_user(ctx, ctx->section_arrays[END_SECTION], bytes, kWordBytes, END_SECTION);
   }
 
   if (labels_out != NULL){
     struct LabelList* labels = create_label_list(128);
     uint32_t offset = 0;
     for (int j = 0; j < num_files; ++j) {
-      append_labels_from_map(local_labels[j], labels, offset);
+      append_labels_from_map(ctx->symbols, ctx->local_labels[j], labels, offset);
     }
     *labels_out = labels;
   }
+  struct LabelList* labels = labels_out != NULL ? *labels_out : NULL;
+  if (ctx->mem_stats != NULL){
+    record_memory(ctx, num_files, num_files, instructions, labels);
+    mem_stats_end_phase(ctx->mem_stats, "pass 2");
+  }
 
-  for (int j = 0; j < num_files; ++j) destroy_hash_map(local_labels[j]);
-  for (int j = 0; j < num_files; ++j) destroy_hash_map(local_defines[j]);
-  for (int j = 0; j < num_files; ++j) destroy_hash_map(local_globals[j]);
-  free(local_labels);
-  free(local_defines);
-  free(local_globals);
-  destroy_hash_map(global_labels);
+  destroy_file_tables(ctx, num_files);
+  destroy_file_tokens(ctx, num_files);
+
+  if (labels_out_c == NULL) release_debug_info(ctx, labels_out_c);
+  if (ctx->mem_stats != NULL) record_memory(ctx, num_files, 0, instructions, labels);
 
   struct ProgramDescriptor* program = malloc(sizeof(struct ProgramDescriptor));
-  program->entry_point = entry_point;
+  program->entry_point = ctx->entry_point;
   program->sections = instructions;
-  program->bss_size = bss_size;
+  program->bss_size = ctx->bss_size;
+
+  return program;
+}
 
+struct ProgramDescriptor* assemble(struct AssemblerContext* ctx, int num_files, int* file_names, bool kernel,
+  const char *const *const argv, char** files, struct LabelList** labels_out,
+  struct DebugInfoList** labels_out_c){
+  struct ProgramDescriptor* program =
+    assemble_files(ctx, num_files, file_names, kernel, argv, files, labels_out, labels_out_c);
+  flush_diagnostics(ctx);
   return program;
 }
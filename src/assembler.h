@@ -3,29 +3,25 @@
 
 #include "stdbool.h"
 #include "debug.h"
+#include "lexer.h"
 
-extern char const * current_file;
-extern char const * current;
-extern char const * current_buffer_start;
-extern unsigned line_count;
-extern unsigned long pc;
-
-// does the file wish to use pivileges instructions?
-extern bool is_kernel;
-
+struct AssemblerContext;
 struct LabelList;
 
-struct ProgramDescriptor* assemble(int num_files, int* file_names, bool is_kernel,
+// Purpose: Assemble preprocessed files into a program.
+// Outputs: Returns NULL after reporting every error found, up to the context's error
+//          limit, on stderr in file/line order. On success *labels_out and
+//          *labels_out_c, when requested, receive label and debug metadata
+//          the caller frees; on failure they are set to NULL.
+struct ProgramDescriptor* assemble(struct AssemblerContext* ctx, int num_files, int* file_names, bool is_kernel,
   const char *const *const argv, char** files, struct LabelList** labels_out,
   struct DebugInfoList** labels_c_out);
 
-void set_cli_defines(int count, const char* const* defines);
+void set_cli_defines(struct AssemblerContext* ctx, int count, const char* const* defines);
 
-enum ConsumeResult {
-  ERROR,
-  NOT_FOUND,
-  FOUND
-};
+// Purpose: Assemble in one pass, patching label immediates after layout.
+// Inputs: enabled selects single-pass mode for the next assemble call.
+void set_single_pass(struct AssemblerContext* ctx, bool enabled);
 
 enum UserSection {
   TEXT_SECTION = 0,
@@ -37,46 +33,10 @@ enum UserSection {
   SECTION_COUNT = 6,
 };
 
-// print line causing an error
-void print_error(void);
-
-// is the rest of the file just whitespace?
-bool is_at_end(void);
-
-// skip whitespace and commas until end of line or non-whitespace character
-void skip(void);
-
-// skip until we get to a new nonempty line
-void skip_newline(void);
-
-// skip an entire line
-void skip_line(void);
-
-// attempt to consume a string, has no effect if a match is not found
-bool consume(const char* str);
-
-// attempt to consume a keyword, has no effect if a match is not found
-// differs from consume because we ensure that there is a whitespace character at the end
-bool consume_keyword(const char* str);
-
-// attempt to consume an identifier, has no effect if a match is not found
-struct Slice* consume_identifier(void);
-
-// label is an identifier followed by a colon
-struct Slice* consume_label(void);
-
-// attempt to consume a register
-int consume_register(void);
-
-int consume_control_register(void);
-
-// attempt to consume an integer literal
-long consume_literal(enum ConsumeResult* result);
-
 // consume a literal immediate or label immediate
-long consume_immediate(enum ConsumeResult* result);
+long consume_immediate(struct AssemblerContext* ctx, enum ConsumeResult* result);
 
 // consumes a single instruction and converts it to binary or hex
-int consume_instruction(enum ConsumeResult* result);
+int consume_instruction(struct AssemblerContext* ctx, enum ConsumeResult* result);
 
 #endif  // ASSEMBLER_H
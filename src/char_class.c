@@ -0,0 +1,29 @@
+#include "char_class.h"
+
+/*
+  Character class table.
+  One lookup replaces the locale-dependent ctype calls and the chains of
+  comparisons the scanners used to make per byte.
+*/
+
+#define SP (CHAR_SPACE | CHAR_SEPARATOR | CHAR_WORD_BREAK)
+#define NL (CHAR_SPACE | CHAR_WORD_BREAK)
+#define SE (CHAR_SEPARATOR | CHAR_WORD_BREAK)
+#define WB CHAR_WORD_BREAK
+#define DG (CHAR_DIGIT | CHAR_HEX_DIGIT | CHAR_IDENT_BODY)
+#define HX (CHAR_ALPHA | CHAR_HEX_DIGIT | CHAR_IDENT_START | CHAR_IDENT_BODY)
+#define AL (CHAR_ALPHA | CHAR_IDENT_START | CHAR_IDENT_BODY)
+#define US (CHAR_IDENT_START | CHAR_IDENT_BODY)
+#define DT CHAR_IDENT_BODY
+
+// bytes 0x80-0xFF are left zero
+const uint8_t kCharClass[256] = {
+  WB,  0,  0,  0,  0,  0,  0,  0,  0, SP, NL, SP, SP, SP,  0,  0,  // 0x00
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x10
+  SP,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, SE,  0, DT,  0,  // 0x20
+  DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, WB, SE,  0,  0,  0,  0,  // 0x30
+   0, HX, HX, HX, HX, HX, HX, AL, AL, AL, AL, AL, AL, AL, AL, AL,  // 0x40
+  AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,  0,  0,  0,  0, US,  // 0x50
+   0, HX, HX, HX, HX, HX, HX, AL, AL, AL, AL, AL, AL, AL, AL, AL,  // 0x60
+  AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,  0,  0,  0,  0,  0,  // 0x70
+};
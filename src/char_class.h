@@ -0,0 +1,30 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Character classes used by the lexer, preprocessor and assembler.
+// A byte may belong to several classes; test them with char_is.
+enum CharClass {
+  CHAR_SPACE       = 1 << 0,  // ' ', \t, \n, \v, \f, \r
+  CHAR_SEPARATOR   = 1 << 1,  // skipped between operands: CHAR_SPACE but \n, ',' and ';'
+  CHAR_WORD_BREAK  = 1 << 2,  // may follow a keyword: CHAR_SPACE, NUL, ',', ';' and ':'
+  CHAR_IDENT_START = 1 << 3,  // letters and '_'
+  CHAR_IDENT_BODY  = 1 << 4,  // letters, digits, '_' and '.'
+  CHAR_DIGIT       = 1 << 5,  // 0-9
+  CHAR_HEX_DIGIT   = 1 << 6,  // 0-9, a-f, A-F
+  CHAR_ALPHA       = 1 << 7,  // a-z, A-Z
+};
+
+// Purpose: Class bits for every byte value.
+// Invariants/Assumptions: Fixed ASCII classification, independent of the
+//                         C locale; bytes >= 0x80 belong to no class.
+extern const uint8_t kCharClass[256];
+
+// Purpose: Test whether c belongs to any of the classes in the mask.
+static inline bool char_is(char c, unsigned classes){
+  return (kCharClass[(unsigned char)c] & classes) != 0;
+}
+
+#endif  // CHAR_CLASS_H
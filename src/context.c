@@ -0,0 +1,30 @@
+#include <stdlib.h>
+
+#include "context.h"
+#include "diagnostic.h"
+#include "line_index.h"
+
+struct AssemblerContext* create_assembler_context(void){
+  struct AssemblerContext* ctx = calloc(1, sizeof(struct AssemblerContext));
+  if (ctx == NULL) return NULL;
+  ctx->current_section = -1;
+  ctx->pass_number = 1;
+  ctx->diagnostics = create_diagnostic_list(16);
+  ctx->error_limit = kDefaultErrorLimit;
+  return ctx;
+}
+
+void set_error_limit(struct AssemblerContext* ctx, unsigned limit){
+  ctx->error_limit = limit;
+}
+
+void set_mem_stats(struct AssemblerContext* ctx, struct MemStats* stats){
+  ctx->mem_stats = stats;
+}
+
+void destroy_assembler_context(struct AssemblerContext* ctx){
+  if (ctx == NULL) return;
+  destroy_line_index(ctx->diagnostic_lines);
+  destroy_diagnostic_list(ctx->diagnostics);
+  free(ctx);
+}
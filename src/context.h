@@ -0,0 +1,131 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assembler.h"
+#include "fixup_array.h"
+
+struct DebugInfoList;
+struct DiagnosticList;
+struct HashMap;
+struct InstructionArray;
+struct LineIndex;
+struct MemStats;
+struct Scope;
+struct SymbolTable;
+struct Token;
+struct TokenArray;
+
+// errors reported before an assembly gives up, unless set_error_limit changes it
+enum { kDefaultErrorLimit = 20 };
+
+// A -D definition, interned and parsed once for every file to share
+struct CliDefine {
+  uint32_t symbol;
+  long value;
+};
+
+// Purpose: All state of one preprocess/assemble run.
+// Invariants/Assumptions: Every scanning, parsing and encoding function takes
+//                         the context it works on, so separate contexts can be
+//                         used from separate threads at the same time.
+struct AssemblerContext {
+  // Character-level scanner state shared by the preprocessor and tokenizer.
+  char const * current_file;
+  char const * current;
+  char const * current_buffer_start;
+  // line starts of current_buffer_start, built by the first diagnostic in it
+  struct LineIndex* diagnostic_lines;
+  // errors and warnings of the run, printed in file/line order by flush_diagnostics
+  struct DiagnosticList* diagnostics;
+  // print_error opens one diagnostic per failed statement; error_printf text joins it
+  bool has_printed_error;
+  size_t error_diagnostic;
+  bool has_printed_privilege_error;
+  // errors closed by finish_error; parsing stops once error_limit is reached (0: no limit)
+  unsigned error_count;
+  unsigned error_limit;
+
+  // preprocessor output for the file being expanded (a dynamic array)
+  // capacity always leaves room for the source between current and source_end
+  char* result;
+  size_t result_index;
+  size_t capacity;
+  char const * source_end;
+  // write built-in macros out as the instructions they stand for (-pre);
+  // off for assembly, which encodes them directly
+  bool expand_builtin_macros;
+
+  // options for the next assemble call
+  bool is_kernel;         // does the file wish to use privileged instructions?
+  bool single_pass;
+  int cli_define_count;
+  const char* const* cli_defines;
+  // -D values parsed by the first file of an assemble call; NULL until then
+  struct CliDefine* cli_define_values;
+
+  // token cursor over the current file; current is kept at the cursor token
+  const struct Token* tok;
+  char const * token_source;
+
+  unsigned long pc;
+  unsigned entry_point;
+  enum UserSection current_section;
+  struct InstructionArray* section_arrays[SECTION_COUNT];
+  unsigned bss_size;
+  uint32_t section_offsets[SECTION_COUNT];
+  uint32_t section_sizes[SECTION_COUNT];
+  uint32_t section_bases[SECTION_COUNT];
+  uint32_t section_load_bases[SECTION_COUNT];
+  bool section_load_set[SECTION_COUNT];
+
+  struct DebugInfoList* debug_info_list;
+
+  int current_file_index;
+  int pass_number;
+
+  // fixups deferred until layout in single-pass mode
+  struct FixupArray* fixups;
+  // label immediate parsed by the current statement, committed once its site is known
+  struct Fixup pending_fixup;
+  bool has_pending_fixup;
+
+  // Map labels/defines to their addresses or values.
+  // local_labels: per-file label table used for local resolution and duplicate checks.
+  // local_defines: per-file .define table to resolve constants without polluting globals.
+  // local_globals: per-file set of labels declared with .global (used to validate global duplication).
+  // global_labels: shared table of labels exported across files via .global.
+  struct HashMap** local_labels;
+  struct HashMap** local_defines;
+  struct HashMap** local_globals;
+  struct HashMap* global_labels;
+  // pass 2 resolver over the tables above; NULL during pass 1
+  struct Scope* scope;
+  struct TokenArray** file_tokens;
+  // interned identifiers of every file; token values and table keys are ids into it
+  struct SymbolTable* symbols;
+
+  // --mem-stats collector, owned by the caller; NULL when stats are off
+  struct MemStats* mem_stats;
+};
+
+// Purpose: Create a context with default options (user mode, two passes).
+// Outputs: Returns NULL if allocation fails.
+struct AssemblerContext* create_assembler_context(void);
+
+// Purpose: Stop assembling after limit errors; 0 reports every error.
+void set_error_limit(struct AssemblerContext* ctx, unsigned limit);
+
+// Purpose: Report per-subsystem memory at the end of each phase.
+// Inputs: stats outlives the context, or is NULL to stop reporting.
+void set_mem_stats(struct AssemblerContext* ctx, struct MemStats* stats);
+
+// Purpose: Free a context and the scanner state it still owns.
+// Invariants/Assumptions: Results handed out by preprocess and assemble are
+//                         owned by the caller and are not freed here.
+void destroy_assembler_context(struct AssemblerContext* ctx);
+
+#endif  // CONTEXT_H
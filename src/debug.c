@@ -1,107 +1,87 @@
 #include "debug.h"
 
 #include <stdlib.h>
-#include <string.h>
 
-// Debug metadata is written after the preprocessed source buffers are freed, so
-// it cannot retain borrowed Slice views into those transient buffers.
-static struct Slice* duplicate_slice(const struct Slice* slice){
-  struct Slice* copy = malloc(sizeof(struct Slice));
-  char* text = malloc(slice->len);
-  memcpy(text, slice->start, slice->len);
-  copy->start = text;
-  copy->len = slice->len;
-  return copy;
-}
+/*
+  Debug metadata.
+  Records are rows of parallel arrays that grow together, and file and
+  variable names are interned, so a .line costs a few array slots rather
+  than list nodes and a copy of its path. The names are copied because
+  debug metadata is written after the preprocessed buffers are freed.
+*/
 
-static void destroy_owned_slice(struct Slice* slice){
-  if (slice == NULL) return;
-  free((void*)slice->start);
-  free(slice);
-}
+enum { kInitialDebugCapacity = 64 };
 
 struct DebugInfoList* create_debug_info_list(void){
   struct DebugInfoList* list = malloc(sizeof(struct DebugInfoList));
-  list->head = NULL;
-  list->tail = NULL;
+  list->size = 0;
+  list->capacity = kInitialDebugCapacity;
+  list->types = malloc(list->capacity * sizeof(uint8_t));
+  list->names = malloc(list->capacity * sizeof(uint32_t));
+  list->values = malloc(list->capacity * sizeof(int32_t));
+  list->sizes = malloc(list->capacity * sizeof(uint32_t));
+  list->addrs = malloc(list->capacity * sizeof(uint32_t));
+  list->name_table = create_symbol_table();
   return list;
 }
 
-void add_debug_local(struct DebugInfoList* debug_list, struct Slice* name, int offset, size_t size, uint32_t addr){
-  // create new DebugLocal
-  struct DebugLocal* local = malloc(sizeof(struct DebugLocal));
-  local->name = duplicate_slice(name);
-  local->offset = offset;
-  local->size = size;
-  local->addr = addr;
-  // create new DebugEntry
-  struct DebugEntry* entry = malloc(sizeof(struct DebugEntry));
-  entry->type = DEBUG_INFO_LOCALS;
-  entry->info.locals = local;
-  entry->next = NULL;
-  // append to debug_list
-  if (debug_list->head == NULL){
-    debug_list->head = entry;
-    debug_list->tail = entry;
-  } else {
-    debug_list->tail->next = entry;
-    debug_list->tail = entry;
+// Purpose: Append one record to every column.
+// Outputs: Returns the index of the new record.
+static size_t append_record(struct DebugInfoList* list, enum DebugInfoType type, const struct Slice* name,
+  int value, uint32_t size, uint32_t addr){
+  if (list->size == list->capacity){
+    list->capacity *= 2;
+    list->types = realloc(list->types, list->capacity * sizeof(uint8_t));
+    list->names = realloc(list->names, list->capacity * sizeof(uint32_t));
+    list->values = realloc(list->values, list->capacity * sizeof(int32_t));
+    list->sizes = realloc(list->sizes, list->capacity * sizeof(uint32_t));
+    list->addrs = realloc(list->addrs, list->capacity * sizeof(uint32_t));
   }
+
+  size_t i = list->size++;
+  list->types[i] = (uint8_t)type;
+  list->names[i] = intern_symbol(list->name_table, name->start, name->len);
+  list->values[i] = value;
+  list->sizes[i] = size;
+  list->addrs[i] = addr;
+  return i;
 }
 
-void add_debug_line(struct DebugInfoList* debug_list, struct Slice* file_name, int line_number, uint32_t addr){
-  // create new DebugLine
-  struct DebugLine* line = malloc(sizeof(struct DebugLine));
-  line->file_name = duplicate_slice(file_name);
-  line->line_number = line_number;
-  line->addr = addr;
-  // create new DebugEntry
-  struct DebugEntry* entry = malloc(sizeof(struct DebugEntry));
-  entry->type = DEBUG_INFO_LINES;
-  entry->info.lines = line;
-  entry->next = NULL;
-  // append to debug_list
-  if (debug_list->head == NULL){
-    debug_list->head = entry;
-    debug_list->tail = entry;
-  } else {
-    debug_list->tail->next = entry;
-    debug_list->tail = entry;
-  }
+size_t add_debug_local(struct DebugInfoList* debug_list, const struct Slice* name, int offset, size_t size, uint32_t addr){
+  // .local sizes are checked to fit in 32 bits
+  return append_record(debug_list, DEBUG_INFO_LOCALS, name, offset, (uint32_t)size, addr);
+}
+
+size_t add_debug_line(struct DebugInfoList* debug_list, const struct Slice* file_name, int line_number, uint32_t addr){
+  return append_record(debug_list, DEBUG_INFO_LINES, file_name, line_number, 0, addr);
 }
 
 void fprint_debug_info_list(FILE* fptr, struct DebugInfoList* debug_list){
-  struct DebugEntry* current = debug_list->head;
-  while (current != NULL){
-    if (current->type == DEBUG_INFO_LOCALS){
-      struct DebugLocal* local = current->info.locals;
+  for (size_t i = 0; i < debug_list->size; ++i){
+    struct Slice name = symbol_name(debug_list->name_table, debug_list->names[i]);
+    if (debug_list->types[i] == DEBUG_INFO_LOCALS){
       fprintf(fptr, "#local %.*s %d %zu %08X\n",
-              (int)local->name->len, local->name->start, local->offset, local->size, local->addr);
-    } else if (current->type == DEBUG_INFO_LINES){
-      struct DebugLine* line = current->info.lines;
+              (int)name.len, name.start, debug_list->values[i], (size_t)debug_list->sizes[i], debug_list->addrs[i]);
+    } else if (debug_list->types[i] == DEBUG_INFO_LINES){
       fprintf(fptr, "#line %.*s %d %08X\n",
-              (int)line->file_name->len, line->file_name->start, line->line_number, line->addr);
+              (int)name.len, name.start, debug_list->values[i], debug_list->addrs[i]);
     }
-    current = current->next;
   }
 }
 
+size_t debug_info_footprint(const struct DebugInfoList* debug_list){
+  if (debug_list == NULL) return 0;
+  size_t record = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(int32_t) + sizeof(uint32_t) + sizeof(uint32_t);
+  return sizeof(struct DebugInfoList) + debug_list->capacity * record +
+    symbol_table_footprint(debug_list->name_table);
+}
+
 void destroy_debug_info_list(struct DebugInfoList* debug_list){
-  struct DebugEntry* current = debug_list->head;
-  while (current != NULL){
-    struct DebugEntry* next = current->next;
-    // free the contained info based on type
-    if (current->type == DEBUG_INFO_LOCALS){
-      struct DebugLocal* local = current->info.locals;
-      destroy_owned_slice(local->name);
-      free(local);
-    } else if (current->type == DEBUG_INFO_LINES){
-      struct DebugLine* line = current->info.lines;
-      destroy_owned_slice(line->file_name);
-      free(line);
-    }
-    free(current);
-    current = next;
-  }
+  free(debug_list->types);
+  free(debug_list->names);
+  free(debug_list->values);
+  free(debug_list->sizes);
+  free(debug_list->addrs);
+  destroy_symbol_table(debug_list->name_table);
   free(debug_list);
 }
@@ -2,52 +2,46 @@
 #define DEBUG_H
 
 #include "slice.h"
+#include "symbol.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
 
-struct DebugLocal {
-  struct Slice* name;          // Name of the local variable
-  int offset;                 // Offset from base pointer (BP)
-  size_t size;              // Size of the local variable in bytes
-  uint32_t addr;              // Address where this local becomes visible
-};
-
-struct DebugLine {
-  struct Slice* file_name;      // Source file name
-  int line_number;            // Line number in the source file
-  uint32_t addr;              // Address of the next instruction for this line
-};
-
-union DebugInfo {
-  struct DebugLocal* locals;  // Linked list of local variables
-  struct DebugLine* lines;    // Linked list of source lines
-};
-
 enum DebugInfoType {
   DEBUG_INFO_LOCALS,
   DEBUG_INFO_LINES,
 };
 
-struct DebugEntry {
-  enum DebugInfoType type;    // Type of debug information
-  union DebugInfo info;       // Actual debug information
-  struct DebugEntry* next;    // Next debug entry in the list
-};
-
+// .line and .local records in program order, one index per record across
+// parallel arrays. Compiler output has a .line before almost every
+// instruction but only a few files, so names are kept once in name_table.
 struct DebugInfoList {
-  struct DebugEntry* head;    // Head of the debug entries list
-  struct DebugEntry* tail;    // Tail of the debug entries list
+  uint8_t* types;             // enum DebugInfoType
+  uint32_t* names;            // Source file (lines) or variable (locals), an id in name_table
+  int32_t* values;            // Line number (lines) or offset from base pointer (locals)
+  uint32_t* sizes;            // Size of the local variable in bytes, 0 for lines
+  uint32_t* addrs;            // Address the record applies from
+  size_t size;
+  size_t capacity;
+  struct SymbolTable* name_table; // Each distinct file and variable name
 };
 
 struct DebugInfoList* create_debug_info_list(void);
 
-void add_debug_local(struct DebugInfoList* debug_list, struct Slice* name, int offset, size_t size, uint32_t addr);
+// Purpose: Record a local variable visible from addr.
+// Outputs: Returns the index of the new record.
+size_t add_debug_local(struct DebugInfoList* debug_list, const struct Slice* name, int offset, size_t size, uint32_t addr);
 
-void add_debug_line(struct DebugInfoList* debug_list, struct Slice* file_name, int line_number, uint32_t addr);
+// Purpose: Record that code from addr comes from line_number of file_name.
+// Outputs: Returns the index of the new record.
+size_t add_debug_line(struct DebugInfoList* debug_list, const struct Slice* file_name, int line_number, uint32_t addr);
 
 void fprint_debug_info_list(FILE* fptr, struct DebugInfoList* debug_list);
 
+// Purpose: Bytes held by the list, its records and name table (for --mem-stats).
+size_t debug_info_footprint(const struct DebugInfoList* debug_list);
+
+// Purpose: Free the list and all of its records.
 void destroy_debug_info_list(struct DebugInfoList* debug_list);
 
 #endif // DEBUG_H
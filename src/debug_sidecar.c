@@ -0,0 +1,399 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_sidecar.h"
+
+/*
+  Binary debug sidecar writer and reader.
+  The writer lays the tables out in one byte buffer and writes it once; the
+  reader only checks bounds and indexes into the buffer it is given.
+*/
+
+enum {
+  kLineIndexRowSize = 16,
+  kLocalRowSize = 16,
+  kLabelRowSize = 12,
+  kMaxLebBytes = 5,       // a uleb128 u32 never needs more
+};
+
+// Header field offsets, after the magic, version and block size.
+enum {
+  kStringOffsetField = 8,
+  kStringSizeField = 12,
+  kFileOffsetField = 16,
+  kFileCountField = 20,
+  kLineIndexOffsetField = 24,
+  kLineBlockCountField = 28,
+  kLineDataOffsetField = 32,
+  kLineDataSizeField = 36,
+  kLineCountField = 40,
+  kLocalOffsetField = 44,
+  kLocalCountField = 48,
+  kLabelOffsetField = 52,
+  kLabelCountField = 56,
+};
+
+// Growable output buffer (a dynamic array of bytes).
+struct ByteBuffer {
+  uint8_t* bytes;
+  size_t size;
+  size_t capacity;
+};
+
+static void reserve(struct ByteBuffer* buf, size_t extra){
+  if (buf->size + extra <= buf->capacity) return;
+  while (buf->size + extra > buf->capacity) buf->capacity *= 2;
+  buf->bytes = realloc(buf->bytes, buf->capacity);
+}
+
+static void put_bytes(struct ByteBuffer* buf, const void* bytes, size_t len){
+  reserve(buf, len);
+  memcpy(buf->bytes + buf->size, bytes, len);
+  buf->size += len;
+}
+
+static void set_u32(struct ByteBuffer* buf, size_t offset, uint32_t value){
+  buf->bytes[offset] = (uint8_t)value;
+  buf->bytes[offset + 1] = (uint8_t)(value >> 8);
+  buf->bytes[offset + 2] = (uint8_t)(value >> 16);
+  buf->bytes[offset + 3] = (uint8_t)(value >> 24);
+}
+
+static void put_u32(struct ByteBuffer* buf, uint32_t value){
+  reserve(buf, 4);
+  set_u32(buf, buf->size, value);
+  buf->size += 4;
+}
+
+static void put_uleb(struct ByteBuffer* buf, uint32_t value){
+  reserve(buf, kMaxLebBytes);
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    buf->bytes[buf->size++] = byte | (value != 0 ? 0x80 : 0);
+  } while (value != 0);
+}
+
+// signed deltas are zigzag encoded so small negative steps stay one byte
+static void put_sleb(struct ByteBuffer* buf, int32_t value){
+  put_uleb(buf, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static void align4(struct ByteBuffer* buf){
+  static const uint8_t zeros[4] = {0};
+  put_bytes(buf, zeros, (4 - buf->size % 4) % 4);
+}
+
+static uint32_t read_u32(const uint8_t* p){
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Purpose: Decode one uleb128 value, advancing *p.
+// Outputs: Returns false if the value runs past end or does not fit in 32 bits.
+static bool read_uleb(const uint8_t** p, const uint8_t* end, uint32_t* value){
+  *value = 0;
+  for (int shift = 0; shift < 7 * kMaxLebBytes; shift += 7){
+    if (*p == end) return false;
+    uint8_t byte = *(*p)++;
+    *value |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+static bool read_sleb(const uint8_t** p, const uint8_t* end, int32_t* value){
+  uint32_t zigzag;
+  if (!read_uleb(p, end, &zigzag)) return false;
+  *value = (int32_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+  return true;
+}
+
+/*
+  Writer
+*/
+
+// line and local rows, with their program order to keep sorting stable
+struct SortRecord {
+  uint32_t addr;
+  size_t index;
+};
+
+static int compare_records(const void* a, const void* b){
+  const struct SortRecord* x = a;
+  const struct SortRecord* y = b;
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+// Purpose: Collect the records of one type sorted by address, keeping program order on ties.
+// Outputs: Returns a heap array and stores its length in *count.
+static struct SortRecord* sorted_records(const struct DebugInfoList* debug_list, enum DebugInfoType type,
+  size_t* count){
+  struct SortRecord* records = malloc((debug_list->size + 1) * sizeof(struct SortRecord));
+  *count = 0;
+  for (size_t i = 0; i < debug_list->size; ++i){
+    if (debug_list->types[i] != type) continue;
+    records[*count].addr = debug_list->addrs[i];
+    records[*count].index = i;
+    (*count)++;
+  }
+  qsort(records, *count, sizeof(struct SortRecord), compare_records);
+  return records;
+}
+
+bool fwrite_debug_sidecar(FILE* ptr, const struct DebugInfoList* debug_list, const struct LabelList* labels){
+  const struct SymbolTable* names = debug_list->name_table;
+  size_t label_count = labels != NULL ? labels->size : 0;
+
+  struct ByteBuffer buf = {malloc(4096), 0, 4096};
+  reserve(&buf, kDebugSidecarHeaderSize);
+  memset(buf.bytes, 0, kDebugSidecarHeaderSize);
+  memcpy(buf.bytes, DEBUG_SIDECAR_MAGIC, 4);
+  buf.bytes[4] = (uint8_t)kDebugSidecarVersion;
+  buf.bytes[6] = (uint8_t)kDebugSidecarBlockLines;
+  buf.size = kDebugSidecarHeaderSize;
+
+  // strings: every debug name by id, then the label names
+  size_t strings_start = buf.size;
+  uint32_t* name_offsets = malloc((names->count + 1) * sizeof(uint32_t));
+  for (uint32_t id = 0; id < names->count; ++id){
+    struct Slice name = symbol_name(names, id);
+    name_offsets[id] = (uint32_t)(buf.size - strings_start);
+    put_bytes(&buf, name.start, name.len + 1);
+  }
+  const struct LabelEntry** sorted_labels = labels != NULL ? label_list_sorted(labels) : NULL;
+  uint32_t* label_offsets = malloc((label_count + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < label_count; ++i){
+    label_offsets[i] = (uint32_t)(buf.size - strings_start);
+    put_bytes(&buf, sorted_labels[i]->name, sorted_labels[i]->len + 1);
+  }
+  size_t string_size = buf.size - strings_start;
+  align4(&buf);
+
+  // files: the names used by line records, numbered in order of first use
+  size_t lines_count;
+  struct SortRecord* lines = sorted_records(debug_list, DEBUG_INFO_LINES, &lines_count);
+  uint32_t* file_of_name = malloc((names->count + 1) * sizeof(uint32_t));
+  for (uint32_t id = 0; id < names->count; ++id) file_of_name[id] = NO_SYMBOL;
+  size_t files_start = buf.size;
+  uint32_t file_count = 0;
+  for (size_t i = 0; i < debug_list->size; ++i){
+    if (debug_list->types[i] != DEBUG_INFO_LINES) continue;
+    uint32_t id = debug_list->names[i];
+    if (file_of_name[id] != NO_SYMBOL) continue;
+    file_of_name[id] = file_count++;
+    put_u32(&buf, name_offsets[id]);
+  }
+
+  // line index and line data: each block starts with an absolute row in the index
+  size_t block_count = (lines_count + kDebugSidecarBlockLines - 1) / kDebugSidecarBlockLines;
+  size_t index_start = buf.size;
+  reserve(&buf, block_count * kLineIndexRowSize);
+  buf.size += block_count * kLineIndexRowSize;
+  struct ByteBuffer data = {malloc(4096), 0, 4096};
+  uint32_t prev_addr = 0;
+  int32_t prev_line = 0;
+  uint32_t prev_file = 0;
+  for (size_t i = 0; i < lines_count; ++i){
+    size_t record = lines[i].index;
+    uint32_t addr = debug_list->addrs[record];
+    int32_t line = debug_list->values[record];
+    uint32_t file = file_of_name[debug_list->names[record]];
+    if (i % kDebugSidecarBlockLines == 0){
+      size_t row = index_start + (i / kDebugSidecarBlockLines) * kLineIndexRowSize;
+      set_u32(&buf, row, addr);
+      set_u32(&buf, row + 4, (uint32_t)line);
+      set_u32(&buf, row + 8, file);
+      set_u32(&buf, row + 12, (uint32_t)data.size);
+    } else {
+      put_uleb(&data, addr - prev_addr);
+      put_sleb(&data, (int32_t)((uint32_t)line - (uint32_t)prev_line));
+      put_sleb(&data, (int32_t)(file - prev_file));
+    }
+    prev_addr = addr;
+    prev_line = line;
+    prev_file = file;
+  }
+  size_t data_start = buf.size;
+  put_bytes(&buf, data.bytes, data.size);
+  align4(&buf);
+
+  // locals and labels: fixed-size rows
+  size_t locals_count;
+  struct SortRecord* locals = sorted_records(debug_list, DEBUG_INFO_LOCALS, &locals_count);
+  size_t locals_start = buf.size;
+  for (size_t i = 0; i < locals_count; ++i){
+    size_t record = locals[i].index;
+    put_u32(&buf, debug_list->addrs[record]);
+    put_u32(&buf, name_offsets[debug_list->names[record]]);
+    put_u32(&buf, (uint32_t)debug_list->values[record]);
+    put_u32(&buf, debug_list->sizes[record]);
+  }
+  size_t labels_start = buf.size;
+  for (size_t i = 0; i < label_count; ++i){
+    put_u32(&buf, sorted_labels[i]->addr);
+    put_u32(&buf, label_offsets[i]);
+    put_u32(&buf, sorted_labels[i]->is_data ? 1 : 0);
+  }
+
+  bool fits = buf.size <= UINT32_MAX;
+  if (fits){
+    set_u32(&buf, kStringOffsetField, (uint32_t)strings_start);
+    set_u32(&buf, kStringSizeField, (uint32_t)string_size);
+    set_u32(&buf, kFileOffsetField, (uint32_t)files_start);
+    set_u32(&buf, kFileCountField, file_count);
+    set_u32(&buf, kLineIndexOffsetField, (uint32_t)index_start);
+    set_u32(&buf, kLineBlockCountField, (uint32_t)block_count);
+    set_u32(&buf, kLineDataOffsetField, (uint32_t)data_start);
+    set_u32(&buf, kLineDataSizeField, (uint32_t)data.size);
+    set_u32(&buf, kLineCountField, (uint32_t)lines_count);
+    set_u32(&buf, kLocalOffsetField, (uint32_t)locals_start);
+    set_u32(&buf, kLocalCountField, (uint32_t)locals_count);
+    set_u32(&buf, kLabelOffsetField, (uint32_t)labels_start);
+    set_u32(&buf, kLabelCountField, (uint32_t)label_count);
+    fwrite(buf.bytes, 1, buf.size, ptr);
+  }
+
+  free(buf.bytes);
+  free(data.bytes);
+  free(name_offsets);
+  free(label_offsets);
+  free(sorted_labels);
+  free(file_of_name);
+  free(lines);
+  free(locals);
+  return fits;
+}
+
+/*
+  Reader
+*/
+
+// Purpose: Locate a table of count rows of row_size bytes at the offset stored in a header field.
+// Outputs: Returns NULL if the table does not lie inside the file.
+static const uint8_t* table_at(const uint8_t* data, size_t size, size_t offset_field, uint64_t count,
+  uint64_t row_size){
+  uint64_t offset = read_u32(data + offset_field);
+  if (offset % 4 != 0 || offset > size || count * row_size > size - offset) return NULL;
+  return data + offset;
+}
+
+bool open_debug_sidecar(const uint8_t* data, size_t size, struct DebugSidecar* sidecar){
+  if (size < kDebugSidecarHeaderSize || memcmp(data, DEBUG_SIDECAR_MAGIC, 4) != 0) return false;
+  if ((data[4] | (data[5] << 8)) != kDebugSidecarVersion) return false;
+  if ((data[6] | (data[7] << 8)) != kDebugSidecarBlockLines) return false;
+
+  sidecar->data = data;
+  sidecar->size = size;
+  sidecar->string_size = read_u32(data + kStringSizeField);
+  sidecar->file_count = read_u32(data + kFileCountField);
+  sidecar->line_block_count = read_u32(data + kLineBlockCountField);
+  sidecar->line_data_size = read_u32(data + kLineDataSizeField);
+  sidecar->line_count = read_u32(data + kLineCountField);
+  sidecar->local_count = read_u32(data + kLocalCountField);
+  sidecar->label_count = read_u32(data + kLabelCountField);
+
+  const uint8_t* strings = table_at(data, size, kStringOffsetField, sidecar->string_size, 1);
+  sidecar->files = table_at(data, size, kFileOffsetField, sidecar->file_count, 4);
+  sidecar->line_index = table_at(data, size, kLineIndexOffsetField, sidecar->line_block_count,
+    kLineIndexRowSize);
+  sidecar->line_data = table_at(data, size, kLineDataOffsetField, sidecar->line_data_size, 1);
+  sidecar->locals = table_at(data, size, kLocalOffsetField, sidecar->local_count, kLocalRowSize);
+  sidecar->labels = table_at(data, size, kLabelOffsetField, sidecar->label_count, kLabelRowSize);
+  if (strings == NULL || sidecar->files == NULL || sidecar->line_index == NULL ||
+      sidecar->line_data == NULL || sidecar->locals == NULL || sidecar->labels == NULL){
+    return false;
+  }
+  // every name ends inside the table, so names can be used as C strings
+  if (sidecar->string_size > 0 && strings[sidecar->string_size - 1] != '\0') return false;
+  uint64_t blocks = ((uint64_t)sidecar->line_count + kDebugSidecarBlockLines - 1) / kDebugSidecarBlockLines;
+  if (blocks != sidecar->line_block_count) return false;
+
+  sidecar->strings = (const char*)strings;
+  return true;
+}
+
+static const char* string_at(const struct DebugSidecar* sidecar, uint32_t offset){
+  return offset < sidecar->string_size ? sidecar->strings + offset : "";
+}
+
+const char* debug_sidecar_file_name(const struct DebugSidecar* sidecar, uint32_t file){
+  if (file >= sidecar->file_count) return "";
+  return string_at(sidecar, read_u32(sidecar->files + 4 * (size_t)file));
+}
+
+// Purpose: Decode up to limit lines of one block, stopping after the last at or below max_addr.
+// Outputs: Returns the number of lines written to out, or -1 if the block data is malformed.
+static long decode_block(const struct DebugSidecar* sidecar, uint32_t block, uint32_t max_addr,
+  struct DebugSidecarLine* out, size_t limit){
+  const uint8_t* row = sidecar->line_index + (size_t)block * kLineIndexRowSize;
+  struct DebugSidecarLine line = {read_u32(row), (int32_t)read_u32(row + 4), read_u32(row + 8)};
+  uint32_t data_offset = read_u32(row + 12);
+  if (data_offset > sidecar->line_data_size) return -1;
+  const uint8_t* p = sidecar->line_data + data_offset;
+  const uint8_t* end = sidecar->line_data + sidecar->line_data_size;
+
+  size_t first = (size_t)block * kDebugSidecarBlockLines;
+  size_t in_block = sidecar->line_count - first;
+  if (in_block > kDebugSidecarBlockLines) in_block = kDebugSidecarBlockLines;
+
+  long count = 0;
+  for (size_t i = 0; i < in_block && (size_t)count < limit; ++i){
+    if (i > 0){
+      uint32_t addr_delta;
+      int32_t line_delta, file_delta;
+      if (!read_uleb(&p, end, &addr_delta) || !read_sleb(&p, end, &line_delta) ||
+          !read_sleb(&p, end, &file_delta)){
+        return -1;
+      }
+      line.addr += addr_delta;
+      line.line = (int32_t)((uint32_t)line.line + (uint32_t)line_delta);
+      line.file += (uint32_t)file_delta;
+    }
+    if (line.addr > max_addr) break;
+    out[count++] = line;
+  }
+  return count;
+}
+
+bool debug_sidecar_read_lines(const struct DebugSidecar* sidecar, struct DebugSidecarLine* out){
+  size_t done = 0;
+  for (uint32_t block = 0; block < sidecar->line_block_count; ++block){
+    long count = decode_block(sidecar, block, UINT32_MAX, out + done, sidecar->line_count - done);
+    if (count < 0) return false;
+    done += (size_t)count;
+  }
+  return done == sidecar->line_count;
+}
+
+bool debug_sidecar_find_line(const struct DebugSidecar* sidecar, uint32_t addr, struct DebugSidecarLine* out){
+  // last block whose first line is at or below addr
+  uint32_t lo = 0;
+  uint32_t hi = sidecar->line_block_count;
+  while (lo < hi){
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (read_u32(sidecar->line_index + (size_t)mid * kLineIndexRowSize) <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return false;
+
+  struct DebugSidecarLine block[kDebugSidecarBlockLines];
+  long count = decode_block(sidecar, lo - 1, addr, block, kDebugSidecarBlockLines);
+  if (count <= 0) return false;
+  *out = block[count - 1];
+  return true;
+}
+
+struct DebugSidecarLocal debug_sidecar_local(const struct DebugSidecar* sidecar, uint32_t i){
+  const uint8_t* row = sidecar->locals + (size_t)i * kLocalRowSize;
+  struct DebugSidecarLocal local = {
+    read_u32(row), string_at(sidecar, read_u32(row + 4)), (int32_t)read_u32(row + 8), read_u32(row + 12),
+  };
+  return local;
+}
+
+struct DebugSidecarLabel debug_sidecar_label(const struct DebugSidecar* sidecar, uint32_t i){
+  const uint8_t* row = sidecar->labels + (size_t)i * kLabelRowSize;
+  struct DebugSidecarLabel label = {read_u32(row), string_at(sidecar, read_u32(row + 4)), read_u32(row + 8) != 0};
+  return label;
+}
@@ -0,0 +1,108 @@
+#ifndef DEBUG_SIDECAR_H
+#define DEBUG_SIDECAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "debug.h"
+#include "label_list.h"
+
+/*
+  Binary debug sidecar (-dbg, or -g with -bin).
+  Every field is little endian and 4-byte aligned at a fixed offset, so the
+  file can be mapped and read in place:
+
+    header        magic, u16 version, u16 lines per block, then u32
+                  offset/count pairs for each table below
+    strings       NUL-terminated names; a name is its byte offset in here
+    files         file_count u32 string offsets, indexed by file id
+    line index    one row per block of kDebugSidecarBlockLines lines:
+                  {addr u32, line i32, file u32, data offset u32}
+                  giving the first line of the block in full
+    line data     the rest of each block, one entry per line:
+                  uleb128 addr delta, then zigzag uleb128 line and file deltas
+    locals        {addr u32, name u32, bp offset i32, size u32}
+    labels        {addr u32, name u32, is_data u32}
+
+  Lines and locals are sorted by address (records at the same address keep
+  program order) and labels are in -g text order, so a reader binary-searches
+  the line index and decodes at most one block, or binary-searches the
+  fixed-size rows.
+*/
+
+#define DEBUG_SIDECAR_MAGIC "BDBG"
+
+enum {
+  kDebugSidecarVersion = 1,
+  kDebugSidecarHeaderSize = 60,
+  kDebugSidecarBlockLines = 64,
+};
+
+// Purpose: Decoded header and table locations of a sidecar held in memory.
+// Invariants/Assumptions: Pointers borrow the buffer given to open_debug_sidecar.
+struct DebugSidecar {
+  const uint8_t* data;
+  size_t size;
+  const char* strings;
+  uint32_t string_size;
+  const uint8_t* files;
+  uint32_t file_count;
+  const uint8_t* line_index;
+  uint32_t line_block_count;
+  const uint8_t* line_data;
+  uint32_t line_data_size;
+  uint32_t line_count;
+  const uint8_t* locals;
+  uint32_t local_count;
+  const uint8_t* labels;
+  uint32_t label_count;
+};
+
+struct DebugSidecarLine {
+  uint32_t addr;
+  int32_t line;
+  uint32_t file;          // file id; see debug_sidecar_file_name
+};
+
+struct DebugSidecarLocal {
+  uint32_t addr;
+  const char* name;
+  int32_t offset;
+  uint32_t size;
+};
+
+struct DebugSidecarLabel {
+  uint32_t addr;
+  const char* name;
+  bool is_data;
+};
+
+// Purpose: Write the debug records and labels of an assembly as a sidecar.
+// Inputs: ptr is open for binary output; labels may be NULL.
+// Outputs: Returns false if the tables do not fit the 32-bit format.
+bool fwrite_debug_sidecar(FILE* ptr, const struct DebugInfoList* debug_list, const struct LabelList* labels);
+
+// Purpose: Validate a sidecar and locate its tables.
+// Inputs: data/size is the whole file.
+// Outputs: Returns false if the magic, version or any table bounds are wrong.
+bool open_debug_sidecar(const uint8_t* data, size_t size, struct DebugSidecar* sidecar);
+
+const char* debug_sidecar_file_name(const struct DebugSidecar* sidecar, uint32_t file);
+
+// Purpose: Decode every line record in address order.
+// Inputs: out has room for sidecar->line_count records.
+// Outputs: Returns false if the line data is malformed.
+bool debug_sidecar_read_lines(const struct DebugSidecar* sidecar, struct DebugSidecarLine* out);
+
+// Purpose: Find the line record in effect at addr: the last one at or below it.
+// Outputs: Returns false when addr is below every line record.
+// Invariants/Assumptions: O(log blocks + block size).
+bool debug_sidecar_find_line(const struct DebugSidecar* sidecar, uint32_t addr, struct DebugSidecarLine* out);
+
+struct DebugSidecarLocal debug_sidecar_local(const struct DebugSidecar* sidecar, uint32_t i);
+
+struct DebugSidecarLabel debug_sidecar_label(const struct DebugSidecar* sidecar, uint32_t i);
+
+#endif  // DEBUG_SIDECAR_H
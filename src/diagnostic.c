@@ -0,0 +1,85 @@
+#include <stdlib.h>
+
+#include "diagnostic.h"
+
+/*
+  Diagnostics are buffered while the passes run and printed together when a
+  phase ends, so errors from a run come out sorted by file and line and text
+  from separate contexts never interleaves.
+*/
+
+struct DiagnosticList* create_diagnostic_list(size_t capacity){
+  struct DiagnosticList* list = malloc(sizeof(struct DiagnosticList));
+  if (capacity == 0) capacity = 16;
+
+  list->diagnostics = malloc(sizeof(struct Diagnostic) * capacity);
+  list->size = 0;
+  list->capacity = capacity;
+
+  return list;
+}
+
+size_t diagnostic_begin(struct DiagnosticList* list, int file, unsigned line){
+  if (list->size == list->capacity){
+    list->diagnostics = realloc(list->diagnostics, list->capacity * sizeof(struct Diagnostic) * 2);
+    list->capacity = list->capacity * 2;
+  }
+
+  struct Diagnostic* diagnostic = &list->diagnostics[list->size];
+  diagnostic->file = file;
+  diagnostic->line = line;
+  diagnostic->order = list->size;
+  diagnostic->capacity = 128;
+  diagnostic->text = malloc(diagnostic->capacity);
+  diagnostic->text[0] = '\0';
+  diagnostic->len = 0;
+  return list->size++;
+}
+
+void diagnostic_vprintf(struct DiagnosticList* list, size_t index, const char* format, va_list args){
+  struct Diagnostic* diagnostic = &list->diagnostics[index];
+  va_list copy;
+  va_copy(copy, args);
+  int needed = vsnprintf(diagnostic->text + diagnostic->len, diagnostic->capacity - diagnostic->len,
+    format, copy);
+  va_end(copy);
+  if (needed < 0) return;
+
+  if (diagnostic->len + (size_t)needed + 1 > diagnostic->capacity){
+    while (diagnostic->len + (size_t)needed + 1 > diagnostic->capacity) diagnostic->capacity *= 2;
+    diagnostic->text = realloc(diagnostic->text, diagnostic->capacity);
+    vsnprintf(diagnostic->text + diagnostic->len, diagnostic->capacity - diagnostic->len, format, args);
+  }
+  diagnostic->len += (size_t)needed;
+}
+
+void diagnostic_printf(struct DiagnosticList* list, size_t index, const char* format, ...){
+  va_list args;
+  va_start(args, format);
+  diagnostic_vprintf(list, index, format, args);
+  va_end(args);
+}
+
+static int compare_diagnostics(const void* a, const void* b){
+  const struct Diagnostic* x = a;
+  const struct Diagnostic* y = b;
+  if (x->file != y->file) return x->file < y->file ? -1 : 1;
+  if (x->line != y->line) return x->line < y->line ? -1 : 1;
+  return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+void fprint_diagnostic_list(FILE* ptr, struct DiagnosticList* list){
+  qsort(list->diagnostics, list->size, sizeof(struct Diagnostic), compare_diagnostics);
+  for (size_t i = 0; i < list->size; ++i){
+    fwrite(list->diagnostics[i].text, 1, list->diagnostics[i].len, ptr);
+    free(list->diagnostics[i].text);
+  }
+  list->size = 0;
+}
+
+void destroy_diagnostic_list(struct DiagnosticList* list){
+  if (list == NULL) return;
+  for (size_t i = 0; i < list->size; ++i) free(list->diagnostics[i].text);
+  free(list->diagnostics);
+  free(list);
+}
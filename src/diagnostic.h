@@ -0,0 +1,47 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// file of a diagnostic about the whole run rather than a source line; sorts after every file
+enum { kDiagnosticNoFile = INT_MAX };
+
+// Purpose: One buffered error or warning and the text printed for it.
+// Invariants/Assumptions: order is the report order, so sorting by (file, line, order)
+//                         keeps diagnostics on one line in the order they were found.
+struct Diagnostic {
+  int file;           // index of the source file on the command line
+  unsigned line;
+  size_t order;
+  char* text;
+  size_t len;
+  size_t capacity;
+};
+
+struct DiagnosticList {
+  struct Diagnostic* diagnostics;
+  size_t size;
+  size_t capacity;
+};
+
+struct DiagnosticList* create_diagnostic_list(size_t capacity);
+
+// Purpose: Start a diagnostic at a source line.
+// Outputs: Returns its index for diagnostic_vprintf.
+size_t diagnostic_begin(struct DiagnosticList* list, int file, unsigned line);
+
+// Purpose: Append formatted text to diagnostic index.
+void diagnostic_vprintf(struct DiagnosticList* list, size_t index, const char* format, va_list args);
+
+void diagnostic_printf(struct DiagnosticList* list, size_t index, const char* format, ...)
+  __attribute__((format(printf, 3, 4)));
+
+// Purpose: Print every diagnostic in file/line order and empty the list.
+void fprint_diagnostic_list(FILE* ptr, struct DiagnosticList* list);
+
+void destroy_diagnostic_list(struct DiagnosticList* list);
+
+#endif  // DIAGNOSTIC_H
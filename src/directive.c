@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "directive.h"
+
+/*
+  Directive lookup.
+  The names hash (FNV-1a) into a small open-addressing table built once, so
+  the lexer classifies a directive token with one hash and a compare.
+*/
+
+static const char* const kDirectiveNames[DIRECTIVE_COUNT] = {
+  [DIRECTIVE_NONE] = "",
+#define X(id, text) [DIRECTIVE_##id] = text,
+  DIRECTIVES(X)
+#undef X
+};
+
+enum {
+  kDirectiveSlotBits = 6,
+  kDirectiveSlots = 1 << kDirectiveSlotBits,  // more than twice DIRECTIVE_COUNT
+};
+
+// slot -> directive id, DIRECTIVE_NONE marks an empty slot
+static uint8_t directive_slots[kDirectiveSlots];
+// built on first lookup; pthread_once keeps concurrent assemblies from racing
+static pthread_once_t directive_slots_once = PTHREAD_ONCE_INIT;
+
+static uint32_t hash_directive(const char* start, size_t len){
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i){
+    hash = (hash ^ (unsigned char)start[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void build_directive_slots(void){
+  for (int id = DIRECTIVE_NONE + 1; id < DIRECTIVE_COUNT; ++id){
+    const char* name = kDirectiveNames[id];
+    uint32_t slot = hash_directive(name, strlen(name)) & (kDirectiveSlots - 1);
+    while (directive_slots[slot] != DIRECTIVE_NONE) slot = (slot + 1) & (kDirectiveSlots - 1);
+    directive_slots[slot] = (uint8_t)id;
+  }
+}
+
+enum DirectiveId lookup_directive(const char* start, size_t len){
+  pthread_once(&directive_slots_once, build_directive_slots);
+
+  uint32_t slot = hash_directive(start, len) & (kDirectiveSlots - 1);
+  while (directive_slots[slot] != DIRECTIVE_NONE){
+    const char* name = kDirectiveNames[directive_slots[slot]];
+    if (strncmp(name, start, len) == 0 && name[len] == '\0') return (enum DirectiveId)directive_slots[slot];
+    slot = (slot + 1) & (kDirectiveSlots - 1);
+  }
+  return DIRECTIVE_NONE;
+}
+
+const char* directive_name(enum DirectiveId id){
+  return kDirectiveNames[id];
+}
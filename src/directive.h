@@ -0,0 +1,45 @@
+#ifndef DIRECTIVE_H
+#define DIRECTIVE_H
+
+#include <stddef.h>
+
+// Every assembler directive, as (id, text). The lexer tags each directive
+// token with its id, so the passes dispatch without comparing text.
+#define DIRECTIVES(X) \
+  X(GLOBAL,      ".global") \
+  X(DEFINE,      ".define") \
+  X(ORIGIN,      ".origin") \
+  X(TEXT,        ".text") \
+  X(RODATA,      ".rodata") \
+  X(DATA,        ".data") \
+  X(BSS,         ".bss") \
+  X(TEXT_LOAD,   ".text_load") \
+  X(RODATA_LOAD, ".rodata_load") \
+  X(DATA_LOAD,   ".data_load") \
+  X(BSS_LOAD,    ".bss_load") \
+  X(FILL,        ".fill") \
+  X(FILD,        ".fild") \
+  X(FILB,        ".filb") \
+  X(SPACE,       ".space") \
+  X(ALIGN,       ".align") \
+  X(LINE,        ".line") \
+  X(LOCAL,       ".local")
+
+enum DirectiveId {
+  DIRECTIVE_NONE,         // not a known directive
+#define X(id, text) DIRECTIVE_##id,
+  DIRECTIVES(X)
+#undef X
+  DIRECTIVE_COUNT,
+};
+
+// Purpose: Map directive token text (including the '.') to its id.
+// Inputs: start/len describe the token text (not NUL terminated).
+// Outputs: Returns DIRECTIVE_NONE for unknown directives.
+// Invariants/Assumptions: O(1); one hash and at most a few key compares.
+enum DirectiveId lookup_directive(const char* start, size_t len);
+
+// Purpose: Text of a directive, for diagnostics.
+const char* directive_name(enum DirectiveId id);
+
+#endif  // DIRECTIVE_H
@@ -0,0 +1,39 @@
+#include <stdlib.h>
+
+#include "fixup_array.h"
+
+/*
+  Dynamic array of forward references waiting for section layout
+*/
+
+struct FixupArray* create_fixup_array(size_t capacity){
+  struct FixupArray* arr = malloc(sizeof(struct FixupArray));
+  if (capacity == 0) capacity = 16;
+
+  arr->fixups = malloc(sizeof(struct Fixup) * capacity);
+  arr->size = 0;
+  arr->capacity = capacity;
+
+  return arr;
+}
+
+void fixup_array_append(struct FixupArray* arr, const struct Fixup* fixup){
+  if (arr->size == arr->capacity){
+    arr->fixups = realloc(arr->fixups, arr->capacity * sizeof(struct Fixup) * 2);
+    arr->capacity = arr->capacity * 2;
+  }
+
+  arr->fixups[arr->size] = *fixup;
+  arr->size++;
+}
+
+size_t fixup_array_footprint(const struct FixupArray* arr){
+  if (arr == NULL) return 0;
+  return sizeof(struct FixupArray) + arr->capacity * sizeof(struct Fixup);
+}
+
+void destroy_fixup_array(struct FixupArray* arr){
+  if (arr == NULL) return;
+  free(arr->fixups);
+  free(arr);
+}
@@ -0,0 +1,52 @@
+#ifndef FIXUP_ARRAY_H
+#define FIXUP_ARRAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "isa.h"
+#include "symbol.h"
+
+// How a deferred value is encoded at its site: one kind per instruction
+// immediate field in isa.h, plus the non-instruction kinds below.
+enum FixupKind {
+#define X(kind, mask, encoder) FIXUP_##kind,
+  ISA_IMMEDIATE_FIELDS(X)
+#undef X
+  FIXUP_WORD,       // .fill of a label address
+  FIXUP_DEBUG_ADDR, // address of a .line/.local entry, no symbol
+  FIXUP_NONE,       // no immediate field (isa.h rows without one)
+  FIXUP_KIND_COUNT,
+};
+
+// Purpose: Record a value that single-pass assembly patches after layout.
+// Invariants/Assumptions: site is a packed section offset ((section << 32) | offset);
+//                         source points into the file's preprocessed buffer.
+struct Fixup {
+  uint8_t kind;          // enum FixupKind
+  int file_index;        // file whose local labels resolve symbol
+  uint64_t site;         // where the instruction or data lives
+  uint32_t symbol;       // label being referenced
+  bool is_define;        // symbol named a .define when parsed; used if no label shadows it
+  long define_value;     // valid when is_define
+  char const* source;    // token text, so print_error can find the line
+  size_t debug_record;   // debug record whose address FIXUP_DEBUG_ADDR rewrites
+};
+
+struct FixupArray {
+  struct Fixup* fixups;
+  size_t size;
+  size_t capacity;
+};
+
+struct FixupArray* create_fixup_array(size_t capacity);
+
+void fixup_array_append(struct FixupArray* arr, const struct Fixup* fixup);
+
+// Purpose: Bytes held by the array (for --mem-stats).
+size_t fixup_array_footprint(const struct FixupArray* arr);
+
+void destroy_fixup_array(struct FixupArray* arr);
+
+#endif  // FIXUP_ARRAY_H
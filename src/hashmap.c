@@ -3,143 +3,132 @@
 #include <assert.h>
 
 #include "hashmap.h"
-#include "slice.h"
 
-struct HashMap* create_hash_map(size_t num_buckets){
-  struct HashEntry** arr = malloc(num_buckets * sizeof(struct HashEntry*));
-  struct HashMap* hmap = malloc(sizeof(struct HashMap));
-
-  for (int i = 0; i < num_buckets; ++i){
-    arr[i] = NULL;
-  }
-
-  hmap->size = num_buckets;
-  hmap->arr = arr;
-
-  return hmap;
+/*
+  Label and define tables.
+  Entries sit in one flat array probed linearly from the symbol id, so a
+  probe is an integer compare; names are compared once, when they are
+  interned. Every operation walks a single probe sequence and no operation
+  recurses.
+*/
+
+enum {
+  kMinCapacity = 16,
+};
+
+// ids are dense, so scattering them with an odd multiplier keeps
+// consecutive ids in distinct slots
+static size_t home_slot(uint32_t symbol, size_t mask){
+  return (size_t)(symbol * 0x9E3779B1u) & mask;
 }
 
-struct HashEntry* create_hash_entry(struct Slice* key, long value, bool is_def, bool is_data){
-  struct HashEntry* entry = malloc(sizeof(struct HashEntry));
-
-  entry->key = key;
-  entry->value = value;
-  entry->is_defined = is_def;
-  entry->is_data = is_data;
-  entry->next = NULL;
-
-  return entry;
+static size_t capacity_for(size_t expected_size){
+  size_t capacity = kMinCapacity;
+  while (capacity < 2 * expected_size) capacity *= 2;
+  return capacity;
 }
 
-void hash_entry_insert(struct HashEntry* entry, struct Slice* key, long value, bool is_def, bool is_data){
-  if (compare_slice_to_slice(entry->key, key)){
-    entry->value = value;
-    free(key);
-  } else if (entry->next == NULL){
-    entry->next = create_hash_entry(key, value, is_def, is_data);
-  } else {
-    hash_entry_insert(entry->next, key, value, is_def, is_data);
-  }
+static struct HashEntry* allocate_entries(size_t capacity){
+  struct HashEntry* entries = malloc(capacity * sizeof(struct HashEntry));
+  for (size_t i = 0; i < capacity; ++i) entries[i].symbol = NO_SYMBOL;
+  return entries;
 }
 
-void hash_map_insert(struct HashMap* hmap, struct Slice* key, long value, bool is_def, bool is_data){
-  size_t hash = hash_slice(key) % hmap->size;
-  
-  if ((hmap->arr[hash]) == NULL){
-    hmap->arr[hash] = create_hash_entry(key, value, is_def, is_data);
-  } else {
-    hash_entry_insert(hmap->arr[hash], key, value, is_def, is_data);
-  }
+struct HashMap* create_hash_map(size_t expected_size){
+  struct HashMap* hmap = malloc(sizeof(struct HashMap));
+  hmap->capacity = capacity_for(expected_size);
+  hmap->size = 0;
+  hmap->entries = allocate_entries(hmap->capacity);
+  return hmap;
 }
 
-long hash_entry_get(struct HashEntry* entry, struct Slice* key){
-  if (compare_slice_to_slice(entry->key, key)){
-    return entry->value;
-  } else if (entry->next == NULL){
-    return 0;
-  } else {
-    return hash_entry_get(entry->next, key);
+// Purpose: Find the slot holding symbol, or the empty slot where it belongs.
+// Outputs: Never NULL; check symbol != NO_SYMBOL to tell the two apart.
+static struct HashEntry* find_slot(const struct HashMap* hmap, uint32_t symbol){
+  size_t mask = hmap->capacity - 1;
+  size_t i = home_slot(symbol, mask);
+  while (true){
+    struct HashEntry* entry = &hmap->entries[i];
+    if (entry->symbol == symbol || entry->symbol == NO_SYMBOL) return entry;
+    i = (i + 1) & mask;
   }
 }
 
-long hash_map_get(struct HashMap* hmap, struct Slice* key){
-  size_t hash = hash_slice(key) % hmap->size;
+static void grow(struct HashMap* hmap){
+  struct HashEntry* old = hmap->entries;
+  size_t old_capacity = hmap->capacity;
 
-  if (hmap->arr[hash] == NULL){
-    return 0;
-  } else {
-    return hash_entry_get(hmap->arr[hash], key);
+  hmap->capacity = 2 * old_capacity;
+  hmap->entries = allocate_entries(hmap->capacity);
+  for (size_t i = 0; i < old_capacity; ++i){
+    if (old[i].symbol == NO_SYMBOL) continue;
+    *find_slot(hmap, old[i].symbol) = old[i];
   }
+  free(old);
 }
 
-bool hash_entry_contains(struct HashEntry* entry, struct Slice* key){
-  if (compare_slice_to_slice(entry->key, key)){
-    return true;
-  } else if (entry->next == NULL){
-    return false;
-  } else {
-    return hash_entry_contains(entry->next, key);
+void hash_map_insert(struct HashMap* hmap, uint32_t symbol, long value, bool is_def, bool is_data){
+  struct HashEntry* entry = find_slot(hmap, symbol);
+  if (entry->symbol != NO_SYMBOL){
+    entry->value = value;
+    return;
   }
-}
 
-bool hash_entry_contains_def(struct HashEntry* entry, struct Slice* key){
-  if (compare_slice_to_slice(entry->key, key) && entry->is_defined){
-    return true;
-  } else if (entry->next == NULL){
-    return false;
-  } else {
-    return hash_entry_contains_def(entry->next, key);
+  // keep the table at most half full so probe sequences stay short
+  if (2 * (hmap->size + 1) > hmap->capacity){
+    grow(hmap);
+    entry = find_slot(hmap, symbol);
   }
-}
 
-bool hash_map_contains(struct HashMap* hmap, struct Slice* key){
-  size_t hash = hash_slice(key) % hmap->size;
+  entry->symbol = symbol;
+  entry->value = value;
+  entry->is_defined = is_def;
+  entry->is_data = is_data;
+  hmap->size++;
+}
 
-  if (hmap->arr[hash] == NULL){
-    return false;
-  } else {
-    return hash_entry_contains(hmap->arr[hash], key);
-  }
+long hash_map_get(const struct HashMap* hmap, uint32_t symbol){
+  struct HashEntry* entry = find_slot(hmap, symbol);
+  return entry->symbol != NO_SYMBOL ? entry->value : 0;
 }
 
-bool label_has_definition(struct HashMap* hmap, struct Slice* key){
-  size_t hash = hash_slice(key) % hmap->size;
+bool hash_map_contains(const struct HashMap* hmap, uint32_t symbol){
+  return find_slot(hmap, symbol)->symbol != NO_SYMBOL;
+}
 
-  if (hmap->arr[hash] == NULL){
-    return false;
-  } else {
-    return hash_entry_contains_def(hmap->arr[hash], key);
-  }
+const struct HashEntry* hash_map_find(const struct HashMap* hmap, uint32_t symbol){
+  struct HashEntry* entry = find_slot(hmap, symbol);
+  return entry->symbol != NO_SYMBOL ? entry : NULL;
 }
 
-void make_entry_defined(struct HashEntry* entry, struct Slice* key, long value){
-  if (compare_slice_to_slice(entry->key, key)){
-    entry->is_defined = true;
-    entry->value = value;
-  } else {
-    assert(entry->next != NULL);
-    make_entry_defined(entry->next, key, value);
-  }
+bool label_has_definition(const struct HashMap* hmap, uint32_t symbol){
+  struct HashEntry* entry = find_slot(hmap, symbol);
+  return entry->symbol != NO_SYMBOL && entry->is_defined;
 }
 
-void make_defined(struct HashMap* hmap, struct Slice* key, long value){
-  size_t hash = hash_slice(key) % hmap->size;
+void make_defined(struct HashMap* hmap, uint32_t symbol, long value){
+  struct HashEntry* entry = find_slot(hmap, symbol);
+
+  assert(entry->symbol != NO_SYMBOL);
 
-  assert(hmap->arr[hash] != NULL);
+  entry->is_defined = true;
+  entry->value = value;
+}
 
-  make_entry_defined(hmap->arr[hash], key, value);
+struct HashEntry* hash_map_next(struct HashMap* hmap, size_t* cursor){
+  while (*cursor < hmap->capacity){
+    struct HashEntry* entry = &hmap->entries[(*cursor)++];
+    if (entry->symbol != NO_SYMBOL) return entry;
+  }
+  return NULL;
 }
 
-void destroy_hash_entry(struct HashEntry* entry){
-  if (entry->next !=  NULL) destroy_hash_entry(entry->next);
-  free(entry->key);
-  free(entry);
+size_t hash_map_footprint(const struct HashMap* hmap){
+  if (hmap == NULL) return 0;
+  return sizeof(struct HashMap) + hmap->capacity * sizeof(struct HashEntry);
 }
 
 void destroy_hash_map(struct HashMap* hmap){
-  for (int i = 0; i < hmap->size; ++i){
-    if (hmap->arr[i] != NULL) destroy_hash_entry(hmap->arr[i]);
-  }
-  free(hmap->arr);
+  free(hmap->entries);
   free(hmap);
 }
@@ -1,35 +1,59 @@
 #ifndef HASHMAP_H
 #define HASHMAP_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#include "slice.h"
+#include "symbol.h"
 
 struct HashEntry{
-  struct Slice* key;
-  long value;
+  uint32_t symbol;        // interned name; NO_SYMBOL marks an empty slot
   bool is_defined;
   bool is_data;
-  struct HashEntry* next;
+  long value;
 };
 
+// Open-addressing table keyed by symbol id, with linear probing; capacity is
+// a power of two and doubles before the table is more than half full.
 struct HashMap{
-	size_t size;
-  struct HashEntry** arr;
+  struct HashEntry* entries;
+  size_t capacity;
+  size_t size;
 };
 
-struct HashMap* create_hash_map(size_t numBuckets);
+// Purpose: Create an empty map.
+// Inputs: expected_size is a sizing hint; the map grows as needed.
+struct HashMap* create_hash_map(size_t expected_size);
+
+// Purpose: Insert symbol with value; an existing symbol only has its value replaced.
+void hash_map_insert(struct HashMap* hmap, uint32_t symbol, long value, bool is_def, bool is_data);
 
-void hash_map_insert(struct HashMap* hmap, struct Slice* key, long value, bool is_def, bool is_data);
+// Purpose: Look up the value of symbol, 0 when absent.
+long hash_map_get(const struct HashMap* hmap, uint32_t symbol);
 
-long hash_map_get(struct HashMap* hmap, struct Slice* key);
+bool hash_map_contains(const struct HashMap* hmap, uint32_t symbol);
 
-bool hash_map_contains(struct HashMap* hmap, struct Slice* key);
+// Purpose: Look up the entry of symbol with a single probe sequence.
+// Outputs: Returns NULL when absent; the entry is valid until the map grows.
+const struct HashEntry* hash_map_find(const struct HashMap* hmap, uint32_t symbol);
 
-bool label_has_definition(struct HashMap* hmap, struct Slice* key);
+// Purpose: Is symbol present and marked defined?
+bool label_has_definition(const struct HashMap* hmap, uint32_t symbol);
+
+// Purpose: Bytes held by the map (for --mem-stats).
+size_t hash_map_footprint(const struct HashMap* hmap);
 
 void destroy_hash_map(struct HashMap* hmap);
 
-void make_defined(struct HashMap* map, struct Slice* key, long value);
+// Purpose: Mark an existing symbol defined with value.
+// Invariants/Assumptions: symbol is already in the map.
+void make_defined(struct HashMap* map, uint32_t symbol, long value);
+
+// Purpose: Step through the entries of a map in slot order.
+// Inputs: *cursor starts at 0 and is advanced past the entry returned.
+// Outputs: Returns the next entry, or NULL after the last one.
+// Invariants/Assumptions: The map is not modified during the walk.
+struct HashEntry* hash_map_next(struct HashMap* hmap, size_t* cursor);
 
-#endif  // HASHMAP_H
\ No newline at end of file
+#endif  // HASHMAP_H
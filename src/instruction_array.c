@@ -38,6 +38,15 @@ void destroy_instruction_array_list(struct InstructionArrayList* list){
   free(list);
 }
 
+size_t instruction_array_list_footprint(const struct InstructionArrayList* list){
+  if (list == NULL) return 0;
+  size_t bytes = sizeof(struct InstructionArrayList);
+  for (const struct InstructionArray* arr = list->head; arr != NULL; arr = arr->next){
+    bytes += sizeof(struct InstructionArray) + arr->capacity * sizeof(int);
+  }
+  return bytes;
+}
+
 void print_instruction_array_list(struct InstructionArrayList* list){
   print_instruction_array(list->head);
 }
@@ -157,10 +166,24 @@ int instruction_array_get(struct InstructionArray* arr, size_t i){
   return arr->instructions[i];
 }
 
+void instruction_array_set(struct InstructionArray* arr, size_t i, int value){
+  assert(i < arr->size);
+  arr->instructions[i] = value;
+}
+
+void instruction_array_set_byte(struct InstructionArray* arr, size_t byte_offset, uint8_t value){
+  size_t i = byte_offset / kWordBytes;
+  assert(i < arr->size);
+  set_word_byte(&arr->instructions[i], (int)(byte_offset % kWordBytes), value);
+}
+
 void destroy_instruction_array(struct InstructionArray* arr){
-  if (arr->next != NULL) destroy_instruction_array(arr->next);
-  free(arr->instructions);
-  free(arr);
+  while (arr != NULL){
+    struct InstructionArray* next = arr->next;
+    free(arr->instructions);
+    free(arr);
+    arr = next;
+  }
 }
 
 void print_instruction_array(struct InstructionArray* arr){
@@ -25,6 +25,9 @@ void instruction_array_list_append(struct InstructionArrayList* list, struct Ins
 
 void destroy_instruction_array_list(struct InstructionArrayList* list);
 
+// Purpose: Bytes held by the list and all of its arrays (for --mem-stats).
+size_t instruction_array_list_footprint(const struct InstructionArrayList* list);
+
 void print_instruction_array_list(struct InstructionArrayList* list);
 
 void fprint_instruction_array_list(FILE* ptr, struct InstructionArrayList* list, bool raw);
@@ -58,6 +61,17 @@ void instruction_array_append_byte(struct InstructionArray* arr, uint8_t value,
 
 int instruction_array_get(struct InstructionArray* arr, size_t i);
 
+// Purpose: Overwrite the word at index i.
+// Inputs: arr is the array to update; i is a word index below arr->size.
+// Outputs: None.
+void instruction_array_set(struct InstructionArray* arr, size_t i, int value);
+
+// Purpose: Overwrite one byte of an already appended word.
+// Inputs: arr is the array to update; byte_offset counts bytes from the start of arr.
+// Outputs: None.
+// Invariants/Assumptions: byte_offset lies within the appended words.
+void instruction_array_set_byte(struct InstructionArray* arr, size_t byte_offset, uint8_t value);
+
 void destroy_instruction_array(struct InstructionArray* arr);
 
 void print_instruction_array(struct InstructionArray* arr);
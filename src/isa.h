@@ -0,0 +1,193 @@
+#ifndef ISA_H
+#define ISA_H
+
+/*
+  Dioptase instruction set description.
+  Every mnemonic, opcode, sub-op and immediate field is listed once here; the
+  mnemonic hash, the fixup kinds and the encoders are expanded from these
+  tables, so adding an instruction means adding a row.
+*/
+
+// Operand shape of a mnemonic; each has one parse/encode routine in assembler.c.
+enum IsaFormat {
+  FORMAT_ALU,      // ra, rb, rc | ra, rb, imm
+  FORMAT_LUI,      // ra, imm
+  FORMAT_MEM,      // ra, [rb, imm] and the addressing modes
+  FORMAT_BRANCH,   // imm | ra, rb | rb
+  FORMAT_JMP,      // imm | ra
+  FORMAT_ADPC,     // ra, imm
+  FORMAT_TRAP,     // no operands
+  FORMAT_ATOMIC,   // ra, rc, [rb, imm]
+  FORMAT_TLB,      // operands depend on the tlb op
+  FORMAT_CRMV,     // mixed register and control register moves
+  FORMAT_MODE,     // run | sleep | halt
+  FORMAT_RFE,      // no operands
+  FORMAT_IPI,      // ra, core | ra, all
+  FORMAT_EOI,      // bit | all
+  FORMAT_MOV_HACK, // ra, imm (half of a movi)
+  // built-in macros, encoded as the instructions -pre expands them to
+  FORMAT_NOP,      // no operands: and r0, r0, r0
+  FORMAT_RET,      // no operands: jmp r29
+  FORMAT_STACK,    // ra: push/pop with an absolute store/load through sp
+  FORMAT_MOV,      // ra, rb: add, or crmv when a control register is named
+  FORMAT_MOVI,     // ra, imm: movu then movl
+  FORMAT_CALL,     // imm: movu r29, movl r29, br r29, r29
+};
+
+// Descriptor flags
+#define ISA_UNARY      0x01 // alu op without rb
+#define ISA_NO_DEST    0x02 // alu op without ra (cmp)
+#define ISA_ABSOLUTE   0x04 // absolute addressing: base register required
+#define ISA_LOAD       0x08 // memory load
+#define ISA_PRIVILEGED 0x10 // requires -kernel
+
+// Opcode column value for a form the mnemonic does not have.
+#define ISA_NO_OPCODE (-1)
+
+// Immediate fields: X(kind, mask, encoder)
+// mask is the bits the field occupies at the bottom of its instruction word;
+// encoder range-checks an immediate and returns the field bits.
+#define ISA_IMMEDIATE_FIELDS(X) \
+  X(BITWISE,           0xFFF,    encode_bitwise_immediate) \
+  X(SHIFT,             0xFFF,    encode_shift_immediate) \
+  X(ARITHMETIC,        0xFFF,    encode_arithmetic_immediate) \
+  X(LUI,               0x3FFFFF, encode_lui_immediate) \
+  X(MEM_ABSOLUTE,      0x3FFF,   encode_absolute_memory_immediate) \
+  X(MEM_RELATIVE,      0xFFFF,   encode_relative_memory_immediate) \
+  X(MEM_LONG_RELATIVE, 0x1FFFFF, encode_long_relative_memory_immediate) \
+  X(BRANCH,            0x3FFFFF, encode_branch_immediate) \
+  X(ADPC,              0x3FFFFF, encode_adpc_immediate) \
+  X(ATOMIC_SHORT,      0xFFF,    encode_short_atomic_immediate) \
+  X(ATOMIC_LONG,       0x1FFFF,  encode_long_atomic_immediate) \
+  X(MOVU,              0x3FFFFF, encode_movu_immediate) \
+  X(MOVL,              0xFFF,    encode_movl_immediate) \
+  X(MOVU8,             0x3FFFFF, encode_movu8_immediate) \
+  X(MOVL4,             0xFFF,    encode_movl4_immediate) \
+  X(EOI,               0xF,      encode_eoi_immediate)
+
+// Instructions: X(name, format, opcode, alt_opcode, sub_op, imm, alt_imm, flags)
+// opcode/imm:         the main form and its immediate field (NONE if it has none)
+// alt_opcode/alt_imm: the register form for alu, branch and jmp; the long form
+//                     without a base register for memory and atomics; the
+//                     label form (alt_imm only) for movu and movl
+// sub_op:             alu op, branch condition, tlb op, privileged id, or the
+//                     bytes a push/pop moves sp by
+#define ISA_INSTRUCTIONS(X) \
+  /* alu instructions */ \
+  X("and",  ALU,      1,  0,  0,  BITWISE,           NONE,              0) \
+  X("nand", ALU,      1,  0,  1,  BITWISE,           NONE,              0) \
+  X("or",   ALU,      1,  0,  2,  BITWISE,           NONE,              0) \
+  X("nor",  ALU,      1,  0,  3,  BITWISE,           NONE,              0) \
+  X("xor",  ALU,      1,  0,  4,  BITWISE,           NONE,              0) \
+  X("xnor", ALU,      1,  0,  5,  BITWISE,           NONE,              0) \
+  X("not",  ALU,      1,  0,  6,  BITWISE,           NONE,              ISA_UNARY) \
+  X("lsl",  ALU,      1,  0,  7,  SHIFT,             NONE,              0) \
+  X("lsr",  ALU,      1,  0,  8,  SHIFT,             NONE,              0) \
+  X("asr",  ALU,      1,  0,  9,  SHIFT,             NONE,              0) \
+  X("rotl", ALU,      1,  0,  10, SHIFT,             NONE,              0) \
+  X("rotr", ALU,      1,  0,  11, SHIFT,             NONE,              0) \
+  X("lslc", ALU,      1,  0,  12, SHIFT,             NONE,              0) \
+  X("lsrc", ALU,      1,  0,  13, SHIFT,             NONE,              0) \
+  X("add",  ALU,      1,  0,  14, ARITHMETIC,        NONE,              0) \
+  X("addc", ALU,      1,  0,  15, ARITHMETIC,        NONE,              0) \
+  X("sub",  ALU,      1,  0,  16, ARITHMETIC,        NONE,              0) \
+  X("subb", ALU,      1,  0,  17, ARITHMETIC,        NONE,              0) \
+  X("cmp",  ALU,      1,  0,  16, ARITHMETIC,        NONE,              ISA_NO_DEST) \
+  X("sxtb", ALU,      1,  0,  18, ARITHMETIC,        NONE,              ISA_UNARY) \
+  X("sxtd", ALU,      1,  0,  19, NONE,              NONE,              ISA_UNARY) \
+  X("tncb", ALU,      1,  0,  20, NONE,              NONE,              ISA_UNARY) \
+  X("tncd", ALU,      1,  0,  21, NONE,              NONE,              ISA_UNARY) \
+  /* load upper immediate */ \
+  X("lui",  LUI,      2,  -1, 0,  LUI,               NONE,              0) \
+  /* memory instructions: opcode is 3 + 3 * width, +1 relative, +2 long relative */ \
+  X("swa",  MEM,      3,  -1, 0,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("lwa",  MEM,      3,  -1, 0,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("sw",   MEM,      4,  5,  0,  MEM_RELATIVE,      MEM_LONG_RELATIVE, 0) \
+  X("lw",   MEM,      4,  5,  0,  MEM_RELATIVE,      MEM_LONG_RELATIVE, ISA_LOAD) \
+  X("sda",  MEM,      6,  -1, 0,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("lda",  MEM,      6,  -1, 0,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("sd",   MEM,      7,  8,  0,  MEM_RELATIVE,      MEM_LONG_RELATIVE, 0) \
+  X("ld",   MEM,      7,  8,  0,  MEM_RELATIVE,      MEM_LONG_RELATIVE, ISA_LOAD) \
+  X("sba",  MEM,      9,  -1, 0,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("lba",  MEM,      9,  -1, 0,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("sb",   MEM,      10, 11, 0,  MEM_RELATIVE,      MEM_LONG_RELATIVE, 0) \
+  X("lb",   MEM,      10, 11, 0,  MEM_RELATIVE,      MEM_LONG_RELATIVE, ISA_LOAD) \
+  /* branch instructions: sub_op is the condition */ \
+  X("br",   BRANCH,   12, 14, 0,  BRANCH,            NONE,              0) \
+  X("bz",   BRANCH,   12, 14, 1,  BRANCH,            NONE,              0) \
+  X("bnz",  BRANCH,   12, 14, 2,  BRANCH,            NONE,              0) \
+  X("bs",   BRANCH,   12, 14, 3,  BRANCH,            NONE,              0) \
+  X("bns",  BRANCH,   12, 14, 4,  BRANCH,            NONE,              0) \
+  X("bc",   BRANCH,   12, 14, 5,  BRANCH,            NONE,              0) \
+  X("bnc",  BRANCH,   12, 14, 6,  BRANCH,            NONE,              0) \
+  X("bo",   BRANCH,   12, 14, 7,  BRANCH,            NONE,              0) \
+  X("bno",  BRANCH,   12, 14, 8,  BRANCH,            NONE,              0) \
+  X("bps",  BRANCH,   12, 14, 9,  BRANCH,            NONE,              0) \
+  X("bnps", BRANCH,   12, 14, 10, BRANCH,            NONE,              0) \
+  X("bg",   BRANCH,   12, 14, 11, BRANCH,            NONE,              0) \
+  X("bge",  BRANCH,   12, 14, 12, BRANCH,            NONE,              0) \
+  X("bl",   BRANCH,   12, 14, 13, BRANCH,            NONE,              0) \
+  X("ble",  BRANCH,   12, 14, 14, BRANCH,            NONE,              0) \
+  X("ba",   BRANCH,   12, 14, 15, BRANCH,            NONE,              0) \
+  X("bae",  BRANCH,   12, 14, 16, BRANCH,            NONE,              0) \
+  X("bb",   BRANCH,   12, 14, 17, BRANCH,            NONE,              0) \
+  X("bbe",  BRANCH,   12, 14, 18, BRANCH,            NONE,              0) \
+  X("bra",  BRANCH,   -1, 13, 0,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bza",  BRANCH,   -1, 13, 1,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bnza", BRANCH,   -1, 13, 2,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bsa",  BRANCH,   -1, 13, 3,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bnsa", BRANCH,   -1, 13, 4,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bca",  BRANCH,   -1, 13, 5,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bnca", BRANCH,   -1, 13, 6,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("boa",  BRANCH,   -1, 13, 7,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bnoa", BRANCH,   -1, 13, 8,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bpa",  BRANCH,   -1, 13, 9,  NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bnpa", BRANCH,   -1, 13, 10, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bga",  BRANCH,   -1, 13, 11, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bgea", BRANCH,   -1, 13, 12, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bla",  BRANCH,   -1, 13, 13, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("blea", BRANCH,   -1, 13, 14, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("baa",  BRANCH,   -1, 13, 15, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("baea", BRANCH,   -1, 13, 16, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bba",  BRANCH,   -1, 13, 17, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("bbea", BRANCH,   -1, 13, 18, NONE,              NONE,              ISA_ABSOLUTE) \
+  X("jmp",  JMP,      12, 13, 0,  BRANCH,            NONE,              0) \
+  /* pc-relative to absolute address */ \
+  X("adpc", ADPC,     22, -1, 0,  ADPC,              NONE,              0) \
+  /* system calls */ \
+  X("trap", TRAP,     15, -1, 0,  NONE,              NONE,              0) \
+  /* atomic instructions: fetch-add is 16-18, swap is 19-21 */ \
+  X("fada", ATOMIC,   16, -1, 0,  ATOMIC_SHORT,      NONE,              ISA_ABSOLUTE) \
+  X("fad",  ATOMIC,   17, 18, 0,  ATOMIC_SHORT,      ATOMIC_LONG,       0) \
+  X("swpa", ATOMIC,   19, -1, 0,  ATOMIC_SHORT,      NONE,              ISA_ABSOLUTE) \
+  X("swp",  ATOMIC,   20, 21, 0,  ATOMIC_SHORT,      ATOMIC_LONG,       0) \
+  /* privileged instructions */ \
+  X("tlbr", TLB,      31, -1, 0,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("tlbw", TLB,      31, -1, 1,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("tlbi", TLB,      31, -1, 2,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("tlbc", TLB,      31, -1, 3,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("crmv", CRMV,     31, -1, 1,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("mode", MODE,     31, -1, 2,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("rfe",  RFE,      31, -1, 3,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("ipi",  IPI,      31, -1, 4,  NONE,              NONE,              ISA_PRIVILEGED) \
+  X("eoi",  EOI,      31, -1, 5,  EOI,               NONE,              ISA_PRIVILEGED) \
+  /* hacks to make movi and call work: movu is a lui, movl an add */ \
+  X("movu", MOV_HACK, 2,  -1, 0,  MOVU,              MOVU8,             0) \
+  X("movl", MOV_HACK, 1,  -1, 14, MOVL,              MOVL4,             0) \
+  /* built-in macros: nop and ret take the columns of and/jmp, */ \
+  /* push/pop the columns of the absolute store/load they use */ \
+  X("nop",  NOP,      1,  0,  0,  BITWISE,           NONE,              0) \
+  X("ret",  RET,      12, 13, 0,  BRANCH,            NONE,              0) \
+  X("push", STACK,    3,  -1, 4,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("pop",  STACK,    3,  -1, 4,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("pshw", STACK,    3,  -1, 4,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("popw", STACK,    3,  -1, 4,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("pshd", STACK,    6,  -1, 2,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("popd", STACK,    6,  -1, 2,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("pshb", STACK,    9,  -1, 1,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE) \
+  X("popb", STACK,    9,  -1, 1,  MEM_ABSOLUTE,      NONE,              ISA_ABSOLUTE | ISA_LOAD) \
+  X("mov",  MOV,      -1, -1, 0,  NONE,              NONE,              0) \
+  X("movi", MOVI,     -1, -1, 0,  NONE,              NONE,              0) \
+  X("call", CALL,     -1, -1, 0,  NONE,              NONE,              0)
+
+#endif  // ISA_H
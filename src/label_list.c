@@ -3,6 +3,21 @@
 #include <stdbool.h>
 
 #include "label_list.h"
+#include "slice.h"
+
+/*
+  Label metadata for -g output.
+  Appends are deduplicated through an open-addressing set of entry indices
+  keyed by (name, address, kind), so building the list is linear. Output is
+  sorted by address so readers can binary-search it.
+*/
+
+enum { kMinSlotCapacity = 64 };
+
+static uint32_t hash_label(const char* name, size_t len, uint32_t addr, bool is_data){
+  struct Slice key = {name, len};
+  return (uint32_t)hash_slice(&key) ^ (addr * 0x9E3779B1u) ^ (is_data ? 0x5bd1e995u : 0);
+}
 
 struct LabelList* create_label_list(size_t capacity){
   struct LabelList* list = malloc(sizeof(struct LabelList));
@@ -10,59 +25,121 @@ struct LabelList* create_label_list(size_t capacity){
   list->entries = malloc(sizeof(struct LabelEntry) * capacity);
   list->size = 0;
   list->capacity = capacity;
+  list->names = create_arena(4096);
+  list->slot_capacity = kMinSlotCapacity;
+  while (list->slot_capacity < 2 * capacity) list->slot_capacity *= 2;
+  list->slots = calloc(list->slot_capacity, sizeof(uint32_t));
   return list;
 }
 
-static bool label_entry_matches(const struct LabelEntry* entry, const char* name, size_t len, uint32_t addr, bool is_data){
-  if (entry->addr != addr) return false;
-  if (entry->is_data != is_data) return false;
-  if (strlen(entry->name) != len) return false;
-  return strncmp(entry->name, name, len) == 0;
+static bool label_entry_matches(const struct LabelEntry* entry, uint32_t hash, const char* name, size_t len,
+  uint32_t addr, bool is_data){
+  return entry->hash == hash && entry->addr == addr && entry->is_data == is_data &&
+    entry->len == len && memcmp(entry->name, name, len) == 0;
 }
 
-void label_list_append(struct LabelList* list, const char* name, size_t len, uint32_t addr, bool is_data){
-  for (size_t i = 0; i < list->size; ++i){
-    if (label_entry_matches(&list->entries[i], name, len, addr, is_data)) return;
+// Purpose: Find the slot of a matching entry, or the empty slot where it belongs.
+// Outputs: Returns an index into slots; slots[i] is 0 when no entry matched.
+static size_t find_slot(const struct LabelList* list, uint32_t hash, const char* name, size_t len,
+  uint32_t addr, bool is_data){
+  size_t mask = list->slot_capacity - 1;
+  size_t i = hash & mask;
+  while (list->slots[i] != 0){
+    const struct LabelEntry* entry = &list->entries[list->slots[i] - 1];
+    if (label_entry_matches(entry, hash, name, len, addr, is_data)) break;
+    i = (i + 1) & mask;
   }
+  return i;
+}
+
+// double the slot array, reinserting entries by their stored hashes
+static void grow_slots(struct LabelList* list){
+  free(list->slots);
+  list->slot_capacity *= 2;
+  list->slots = calloc(list->slot_capacity, sizeof(uint32_t));
+  size_t mask = list->slot_capacity - 1;
+  for (size_t e = 0; e < list->size; ++e){
+    size_t i = list->entries[e].hash & mask;
+    while (list->slots[i] != 0) i = (i + 1) & mask;
+    list->slots[i] = (uint32_t)(e + 1);
+  }
+}
+
+void label_list_append(struct LabelList* list, const char* name, size_t len, uint32_t addr, bool is_data){
+  uint32_t hash = hash_label(name, len, addr, is_data);
+  size_t slot = find_slot(list, hash, name, len, addr, is_data);
+  if (list->slots[slot] != 0) return;
 
   if (list->size == list->capacity){
     list->capacity *= 2;
     list->entries = realloc(list->entries, sizeof(struct LabelEntry) * list->capacity);
   }
 
-  char* name_copy = malloc(len + 1);
-  memcpy(name_copy, name, len);
-  name_copy[len] = '\0';
+  // keep the set at most half full so probe sequences stay short
+  if (2 * (list->size + 1) > list->slot_capacity){
+    grow_slots(list);
+    slot = find_slot(list, hash, name, len, addr, is_data);
+  }
 
-  list->entries[list->size].name = name_copy;
-  list->entries[list->size].addr = addr;
-  list->entries[list->size].is_data = is_data;
+  struct LabelEntry* entry = &list->entries[list->size];
+  entry->name = arena_strndup(list->names, name, len);
+  entry->len = len;
+  entry->hash = hash;
+  entry->addr = addr;
+  entry->is_data = is_data;
   list->size++;
+  list->slots[slot] = (uint32_t)list->size;
+}
+
+size_t label_list_footprint(const struct LabelList* list){
+  if (list == NULL) return 0;
+  return sizeof(struct LabelList) + list->capacity * sizeof(struct LabelEntry) +
+    list->slot_capacity * sizeof(uint32_t) + arena_footprint(list->names);
 }
 
 void destroy_label_list(struct LabelList* list){
   if (list == NULL) return;
-  for (size_t i = 0; i < list->size; ++i){
-    free(list->entries[i].name);
-  }
+  destroy_arena(list->names);
+  free(list->slots);
   free(list->entries);
   free(list);
 }
 
+// by address, then name, then labels before data, so output is deterministic
+static int compare_entries(const void* a, const void* b){
+  const struct LabelEntry* x = *(const struct LabelEntry* const*)a;
+  const struct LabelEntry* y = *(const struct LabelEntry* const*)b;
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  int names = strcmp(x->name, y->name);
+  if (names != 0) return names;
+  return (int)x->is_data - (int)y->is_data;
+}
+
+const struct LabelEntry** label_list_sorted(const struct LabelList* list){
+  const struct LabelEntry** sorted = malloc((list->size + 1) * sizeof(struct LabelEntry*));
+  for (size_t i = 0; i < list->size; ++i) sorted[i] = &list->entries[i];
+  qsort(sorted, list->size, sizeof(struct LabelEntry*), compare_entries);
+  return sorted;
+}
+
 void fprint_label_list(FILE* ptr, const struct LabelList* list){
   if (list == NULL) return;
+  const struct LabelEntry** sorted = label_list_sorted(list);
   for (size_t i = 0; i < list->size; ++i){
-    fprintf(ptr, "#%s %s %08X\n", list->entries[i].is_data ? "data" : "label", list->entries[i].name, list->entries[i].addr);
+    fprintf(ptr, "#%s %s %08X\n", sorted[i]->is_data ? "data" : "label", sorted[i]->name, sorted[i]->addr);
   }
+  free(sorted);
 }
 
 // Purpose: Emit label metadata for kernel outputs (no data/text distinction).
 // Inputs: ptr is the output file; list contains label entries with addresses.
-// Outputs: Writes "#label <name> <addr>" lines, ignoring is_data.
+// Outputs: Writes "#label <name> <addr>" lines in address order, ignoring is_data.
 // Invariants/Assumptions: list entries are unique by name/address.
 void fprint_label_list_kernel(FILE* ptr, const struct LabelList* list){
   if (list == NULL) return;
+  const struct LabelEntry** sorted = label_list_sorted(list);
   for (size_t i = 0; i < list->size; ++i){
-    fprintf(ptr, "#label %s %08X\n", list->entries[i].name, list->entries[i].addr);
+    fprintf(ptr, "#label %s %08X\n", sorted[i]->name, sorted[i]->addr);
   }
+  free(sorted);
 }
@@ -1,12 +1,17 @@
 #ifndef LABEL_LIST_H
 #define LABEL_LIST_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include "arena.h"
+
 struct LabelEntry {
   char* name;
+  size_t len;
+  uint32_t hash;          // of name, addr and is_data
   bool is_data;
   uint32_t addr;
 };
@@ -15,14 +20,28 @@ struct LabelList {
   struct LabelEntry* entries;
   size_t size;
   size_t capacity;
+  struct Arena* names;    // owns every entry's name
+  // dedupe set: index + 1 of the entry hashed to each slot, 0 when empty
+  uint32_t* slots;
+  size_t slot_capacity;   // power of two, at least twice size
 };
 
 struct LabelList* create_label_list(size_t capacity);
 
+// Purpose: Append a label unless the same name, address and kind is already listed.
+// Inputs: name/len is copied, so it may be transient.
 void label_list_append(struct LabelList* list, const char* name, size_t len, uint32_t addr, bool is_data);
 
+// Purpose: Bytes held by the list, its dedupe set and names (for --mem-stats).
+size_t label_list_footprint(const struct LabelList* list);
+
 void destroy_label_list(struct LabelList* list);
 
+// Purpose: List the entries in output order: by address, then name, labels before data.
+// Outputs: Returns a heap array of list->size entry pointers for the caller to free.
+const struct LabelEntry** label_list_sorted(const struct LabelList* list);
+
+// Purpose: Emit "#label"/"#data" records sorted by address (then name).
 void fprint_label_list(FILE* ptr, const struct LabelList* list);
 void fprint_label_list_kernel(FILE* ptr, const struct LabelList* list);
 
@@ -0,0 +1,363 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "char_class.h"
+#include "context.h"
+#include "diagnostic.h"
+#include "directive.h"
+#include "lexer.h"
+#include "line_index.h"
+#include "literal.h"
+#include "scan.h"
+#include "slice.h"
+#include "symbol.h"
+#include "token_array.h"
+
+/*
+  Character-level scanning.
+  The preprocessor works directly on source text with these functions; the
+  assembler only sees the token stream that tokenize produces from them.
+*/
+
+void set_current_buffer(struct AssemblerContext* ctx, char const* buffer) {
+  ctx->current_buffer_start = buffer;
+  destroy_line_index(ctx->diagnostic_lines);
+  ctx->diagnostic_lines = NULL;
+}
+
+// Purpose: Locate current for a diagnostic.
+// Inputs: ctx supplies current and current_buffer_start.
+// Outputs: Returns the line number of current and stores that line, without
+//          surrounding whitespace, in line.
+static unsigned locate_current(struct AssemblerContext* ctx, struct Slice* line) {
+  char const * buffer = ctx->current_buffer_start != NULL ? ctx->current_buffer_start : ctx->current;
+  if (ctx->diagnostic_lines == NULL || ctx->diagnostic_lines->buffer != buffer) {
+    destroy_line_index(ctx->diagnostic_lines);
+    ctx->diagnostic_lines = create_line_index(buffer);
+  }
+
+  char const * start;
+  unsigned line_number = line_index_lookup(ctx->diagnostic_lines, ctx->current, &start);
+  char const * end = scan_kernels()->find_line_end(ctx->current);
+
+  // remove whitespace at beginning and end
+  while (char_is(*start, CHAR_SPACE)) start++;
+  while (end > start && char_is(end[-1], CHAR_SPACE)) end--;
+
+  line->start = start;
+  line->len = end - start;
+  return line_number;
+}
+
+// print line causing an error
+void print_error(struct AssemblerContext* ctx) {
+  // one diagnostic per failed statement; callers up the stack add to it
+  if (!ctx->has_printed_error){
+    struct Slice line;
+    unsigned line_number = locate_current(ctx, &line);
+    ctx->error_diagnostic = diagnostic_begin(ctx->diagnostics, ctx->current_file_index, line_number);
+    ctx->has_printed_error = true;
+    error_printf(ctx, "Error in %s\nline %u: \"%.*s\"\n", ctx->current_file, line_number,
+      (int)line.len, line.start);
+  }
+}
+
+void error_printf(struct AssemblerContext* ctx, const char* format, ...) {
+  // text outside any statement (a missing _start, the error limit) stands alone, last
+  size_t index = ctx->has_printed_error ? ctx->error_diagnostic
+                                        : diagnostic_begin(ctx->diagnostics, kDiagnosticNoFile, UINT_MAX);
+  va_list args;
+  va_start(args, format);
+  diagnostic_vprintf(ctx->diagnostics, index, format, args);
+  va_end(args);
+}
+
+bool finish_error(struct AssemblerContext* ctx) {
+  ctx->has_printed_error = false;
+  ctx->error_count++;
+  if (ctx->error_limit == 0 || ctx->error_count < ctx->error_limit) return true;
+  error_printf(ctx, "Stopping after %u errors; raise the limit with -max-errors\n", ctx->error_count);
+  return false;
+}
+
+void flush_diagnostics(struct AssemblerContext* ctx) {
+  fprint_diagnostic_list(stderr, ctx->diagnostics);
+  fflush(stderr);
+}
+
+void print_warning(struct AssemblerContext* ctx, const char* message) {
+  struct Slice line;
+  unsigned line_number = locate_current(ctx, &line);
+  size_t index = diagnostic_begin(ctx->diagnostics, ctx->current_file_index, line_number);
+  diagnostic_printf(ctx->diagnostics, index, "Warning in %s\nline %u: \"%.*s\"\n%s\n", ctx->current_file,
+    line_number, (int)line.len, line.start, message);
+}
+
+// skip whitespace and commas until end of line or non-whitespace character
+void skip(struct AssemblerContext* ctx) {
+  // most gaps are a single space, which is cheaper to step over inline
+  if (*ctx->current == ' ' && !char_is(ctx->current[1], CHAR_SEPARATOR)) {
+    ctx->current++;
+    return;
+  }
+  if (char_is(*ctx->current, CHAR_SEPARATOR)) ctx->current = scan_kernels()->skip_blanks(ctx->current);
+}
+
+// skip until we get to a new nonempty line
+void skip_newline(struct AssemblerContext* ctx) {
+  // line numbers come from the line index, so the count is not kept
+  unsigned newlines = 0;
+  if (char_is(*ctx->current, CHAR_SPACE)) ctx->current = scan_kernels()->skip_whitespace(ctx->current, &newlines);
+}
+
+// attempt to consume a keyword, has no effect if a match is not found
+// differs from a plain string match because we ensure token boundaries on both sides
+bool consume_keyword(struct AssemblerContext* ctx, const char* str) {
+  // skip is handled by caller so that this function is useful for preprocesser/macros
+  if (ctx->current != ctx->current_buffer_start &&
+      char_is(ctx->current[-1], CHAR_IDENT_BODY)) {
+    return false;
+  }
+
+  size_t i = 0;
+  while (true) {
+    char const expected = str[i];
+    char const found = ctx->current[i];
+    if (expected == 0) {
+      /* survived to the end of the expected string */
+      if (char_is(found, CHAR_WORD_BREAK)) {
+        // word break
+        ctx->current += i;
+        return true;
+      } else {
+        // this is actually an identifier
+        return false;
+      }
+    }
+    if (expected != found) {
+      return false;
+    }
+    i += 1;
+  } 
+}
+
+// attempt to consume an identifier, has no effect if a match is not found
+struct Slice consume_identifier(struct AssemblerContext* ctx) {
+  skip(ctx);
+  size_t i = 0;
+  // identifiers begin with a letter or underscore
+  if (char_is(ctx->current[i], CHAR_IDENT_START)) {
+    do {
+      i += 1;
+      // then followed by letters, number, underscores, and periods
+    } while(char_is(ctx->current[i], CHAR_IDENT_BODY));
+
+    struct Slice slice = {ctx->current, i};
+    ctx->current += i;
+
+    return slice;
+  } else {
+    struct Slice none = {NULL, 0};
+    return none;
+  }
+}
+
+static bool consume_named_register(struct AssemblerContext* ctx, const char* name) {
+  size_t len = strlen(name);
+  if (strncmp(ctx->current, name, len) == 0 && !char_is(ctx->current[len], CHAR_IDENT_BODY)) {
+    ctx->current += len;
+    return true;
+  }
+  return false;
+}
+
+// attempt to consume a register
+int consume_register(struct AssemblerContext* ctx) {
+  skip(ctx);
+
+  if (consume_named_register(ctx, "sp")) return 31;
+  else if (consume_named_register(ctx, "bp")) return 30;
+  else if (consume_named_register(ctx, "ra")) return 29;
+
+  // registers begin with an r
+  else if (ctx->current[0] == 'r' && char_is(ctx->current[1], CHAR_DIGIT)) {
+    int v = 0;
+    size_t i = 1;
+    while(char_is(ctx->current[i], CHAR_DIGIT)) {
+      // then followed by numbers
+      v = 10 * v + ctx->current[i] - '0';
+      i += 1;
+    }
+
+    if (v > 31 || char_is(ctx->current[i], CHAR_IDENT_BODY)) return -1;
+    ctx->current += i;
+    return v;
+  }
+  else return -1;
+}
+
+// attempt to consume a control register
+int consume_control_register(struct AssemblerContext* ctx) {
+  skip(ctx);
+  // registers begin with an r
+  if (ctx->current[0] == 'c' && ctx->current[1] == 'r' && char_is(ctx->current[2], CHAR_DIGIT)) {
+    int v = 0;
+    size_t i = 2;
+    while(char_is(ctx->current[i], CHAR_DIGIT)) {
+      // then followed by numbers
+      v = 10 * v + ctx->current[i] - '0';
+      i += 1;
+    }
+
+    if (v > 12 || char_is(ctx->current[i], CHAR_IDENT_BODY)) return -1;
+    ctx->current += i;
+    return v;
+  } else {
+    if (consume_named_register(ctx, "psr")) return 0;
+    else if (consume_named_register(ctx, "pid")) return 1;
+    else if (consume_named_register(ctx, "isr")) return 2;
+    else if (consume_named_register(ctx, "imr")) return 3;
+    else if (consume_named_register(ctx, "epc")) return 4;
+    else if (consume_named_register(ctx, "flg")) return 5;
+    else if (consume_named_register(ctx, "efg")) return 6;
+    else if (consume_named_register(ctx, "tlba")) return 7;
+    else if (consume_named_register(ctx, "ksp")) return 8;
+    else if (consume_named_register(ctx, "cid")) return 9;
+    else if (consume_named_register(ctx, "mbi")) return 10;
+    else if (consume_named_register(ctx, "mbo")) return 11;
+    else if (consume_named_register(ctx, "tlbf")) return 12;
+    else return -1;
+  }
+}
+
+// Purpose: Scan an integer literal at current without reporting errors.
+// Inputs: result receives FOUND, NOT_FOUND, or ERROR; message receives the
+//         diagnostic for ERROR.
+// Outputs: Returns the literal value and advances current past it when found.
+// Invariants/Assumptions: current is restored when nothing is found.
+static long scan_literal(struct AssemblerContext* ctx, enum ConsumeResult* result, char const** message) {
+  skip(ctx);
+  bool negate = false;
+  char const * old_current = ctx->current;
+  if (*ctx->current == '-') {
+    negate = true;
+    ctx->current++;
+    skip(ctx);
+  }
+
+  long v = parse_literal(ctx->current, &ctx->current, result, message);
+  if (*result == NOT_FOUND) {
+    ctx->current = old_current;
+    return 0;
+  }
+  if (*result == ERROR) return 0;
+
+  if (negate) v = (long)(0UL - (unsigned long)v);
+  return v;
+}
+
+// attempt to consume an integer literal
+long consume_literal(struct AssemblerContext* ctx, enum ConsumeResult* result) {
+  char const* message = NULL;
+  long v = scan_literal(ctx, result, &message);
+  if (*result == ERROR){
+    print_error(ctx);
+    error_printf(ctx, "%s\n", message);
+  }
+  return v;
+}
+
+// Purpose: Consume the raw operand of a .line directive.
+// Inputs: ctx; reads from its current position.
+// Outputs: Returns the length consumed, 0 when no filename is present.
+// Invariants/Assumptions: Debug file names may be relative or absolute and are
+//                         emitted without quotes, so they end at the next
+//                         whitespace or statement separator.
+static size_t consume_filename_len(struct AssemblerContext* ctx){
+  size_t i = 0;
+  while (ctx->current[i] != '\0' && !char_is(ctx->current[i], CHAR_SPACE | CHAR_SEPARATOR)) {
+    i += 1;
+  }
+  ctx->current += i;
+  return i;
+}
+
+void tokenize(struct AssemblerContext* ctx, char const* const buffer, struct TokenArray* tokens){
+  ctx->current = buffer + 1;
+  set_current_buffer(ctx, buffer);
+
+  while (true){
+    skip(ctx);
+
+    char const c = *ctx->current;
+    uint32_t offset = (uint32_t)(ctx->current - buffer);
+
+    if (c == '\0'){
+      token_array_append(tokens, TOKEN_EOF, offset, 0, 0);
+      return;
+    }
+
+    if (c == '\n'){
+      // a run of blank lines becomes one separator
+      skip_newline(ctx);
+      token_array_append(tokens, TOKEN_NEWLINE, offset, 1, 0);
+      continue;
+    }
+
+    if (char_is(c, CHAR_IDENT_START)){
+      // identifiers begin with a letter or underscore,
+      // then followed by letters, number, underscores, and periods
+      size_t len = 1;
+      while (char_is(ctx->current[len], CHAR_IDENT_BODY)) len++;
+      uint32_t symbol = intern_symbol(ctx->symbols, ctx->current, len);
+      ctx->current += len;
+      token_array_append(tokens, TOKEN_IDENTIFIER, offset, (uint32_t)len, symbol);
+      continue;
+    }
+
+    if (c == '.' && char_is(ctx->current[1], CHAR_IDENT_BODY)){
+      size_t len = 1;
+      while (char_is(ctx->current[len], CHAR_IDENT_BODY)) len++;
+      enum DirectiveId directive = lookup_directive(ctx->current, len);
+      bool is_line = directive == DIRECTIVE_LINE;
+      ctx->current += len;
+      token_array_append(tokens, TOKEN_DIRECTIVE, offset, (uint32_t)len, directive);
+
+      if (is_line){
+        skip(ctx);
+        uint32_t name_offset = (uint32_t)(ctx->current - buffer);
+        size_t name_len = consume_filename_len(ctx);
+        if (name_len > 0){
+          token_array_append(tokens, TOKEN_FILENAME, name_offset, (uint32_t)name_len, 0);
+        }
+      }
+      continue;
+    }
+
+    if (char_is(c, CHAR_DIGIT) || c == '-'){
+      enum ConsumeResult result;
+      char const* message = NULL;
+      long value = scan_literal(ctx, &result, &message);
+      if (result == FOUND){
+        uint32_t len = (uint32_t)(ctx->current - buffer) - offset;
+        token_array_append(tokens, TOKEN_INTEGER, offset, len, value);
+        continue;
+      }
+      if (result == ERROR || c != '-'){
+        // leave the diagnostic to the parser, which knows what operand was
+        // expected here; it rescans the text with consume_literal
+        ctx->current = buffer + offset + 1;
+        while (char_is(*ctx->current, CHAR_ALPHA | CHAR_DIGIT)) ctx->current++;
+        uint32_t len = (uint32_t)(ctx->current - buffer) - offset;
+        token_array_append(tokens, TOKEN_BAD_LITERAL, offset, len, 0);
+        continue;
+      }
+      // a lone '-' falls through to punctuation
+    }
+
+    ctx->current++;
+    token_array_append(tokens, TOKEN_PUNCT, offset, 1, 0);
+  }
+}
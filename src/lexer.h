@@ -0,0 +1,71 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdbool.h>
+
+#include "slice.h"
+
+struct AssemblerContext;
+struct TokenArray;
+
+// Purpose: Start scanning a new buffer; diagnostics number lines from its start.
+// Inputs: buffer is NUL terminated and outlives the scan.
+void set_current_buffer(struct AssemblerContext* ctx, char const* buffer);
+
+enum ConsumeResult {
+  ERROR,
+  NOT_FOUND,
+  FOUND
+};
+
+// print line causing an error; the line number is looked up from current
+// the first call for a statement opens its diagnostic, later ones are ignored
+void print_error(struct AssemblerContext* ctx);
+
+// Purpose: Add text to the open error, like fprintf to stderr did.
+// Invariants/Assumptions: With no open error the text is a diagnostic of its own,
+//                         printed after those tied to a source line.
+void error_printf(struct AssemblerContext* ctx, const char* format, ...)
+  __attribute__((format(printf, 2, 3)));
+
+// Purpose: Close the open error and count it, so the next print_error opens a new one.
+// Outputs: Returns false once ctx->error_limit errors have been counted.
+bool finish_error(struct AssemblerContext* ctx);
+
+// Purpose: Print the buffered diagnostics to stderr in file/line order.
+void flush_diagnostics(struct AssemblerContext* ctx);
+
+// print line causing a warning, followed by message
+void print_warning(struct AssemblerContext* ctx, const char* message);
+
+// skip whitespace and commas until end of line or non-whitespace character
+void skip(struct AssemblerContext* ctx);
+
+// skip until we get to a new nonempty line
+void skip_newline(struct AssemblerContext* ctx);
+
+// attempt to consume a keyword, has no effect if a match is not found
+// differs from a plain string match because we ensure token boundaries on both sides
+bool consume_keyword(struct AssemblerContext* ctx, const char* str);
+
+// attempt to consume an identifier, has no effect if a match is not found
+// the slice views the source buffer; start is NULL when none was found
+struct Slice consume_identifier(struct AssemblerContext* ctx);
+
+// attempt to consume a register
+int consume_register(struct AssemblerContext* ctx);
+
+int consume_control_register(struct AssemblerContext* ctx);
+
+// attempt to consume an integer literal
+long consume_literal(struct AssemblerContext* ctx, enum ConsumeResult* result);
+
+// Purpose: Lex a preprocessed buffer into a token array.
+// Inputs: buffer is the preprocessed text, starting with the NUL sentinel the
+//         preprocessor writes; tokens receives the tokens.
+// Outputs: Always succeeds; a malformed literal becomes a TOKEN_BAD_LITERAL
+//          that the parser reports when it reaches it.
+// Invariants/Assumptions: Identifiers are interned into ctx->symbols and carry their id as value.
+void tokenize(struct AssemblerContext* ctx, char const* buffer, struct TokenArray* tokens);
+
+#endif  // LEXER_H
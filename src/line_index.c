@@ -0,0 +1,73 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "line_index.h"
+#include "scan.h"
+
+/*
+  Line index for diagnostics.
+  Nothing on the assembly path counts lines; the first diagnostic in a buffer
+  indexes its newlines once and every later one is a binary search.
+*/
+
+static void append_line_start(struct LineIndex* index, uint32_t offset){
+  if (index->size == index->capacity){
+    index->starts = realloc(index->starts, index->capacity * sizeof(uint32_t) * 2);
+    index->capacity = index->capacity * 2;
+  }
+
+  index->starts[index->size] = offset;
+  index->size++;
+}
+
+struct LineIndex* create_line_index(char const* buffer){
+  struct LineIndex* index = malloc(sizeof(struct LineIndex));
+  index->buffer = buffer;
+  index->capacity = 64;
+  index->size = 0;
+  index->starts = malloc(sizeof(uint32_t) * index->capacity);
+
+  // line 1 starts after the preprocessor sentinel, if there is one
+  uint32_t first = (*buffer == '\0') ? 1 : 0;
+  append_line_start(index, first);
+
+  const struct ScanKernels* scan = scan_kernels();
+  char const* p = buffer + first;
+  while (true){
+    p = scan->find_line_end(p);
+    if (*p == '\0') break;
+    p++;
+    append_line_start(index, (uint32_t)(p - buffer));
+  }
+
+  return index;
+}
+
+unsigned line_index_lookup(const struct LineIndex* index, char const* position,
+  char const** line_start){
+  uint32_t offset = (uint32_t)(position - index->buffer);
+
+  // count the line starts at or before offset
+  size_t low = 0;
+  size_t high = index->size;
+  while (low < high){
+    size_t mid = low + (high - low) / 2;
+    if (index->starts[mid] <= offset) low = mid + 1;
+    else high = mid;
+  }
+
+  if (low == 0){
+    // the sentinel itself
+    *line_start = position;
+    return 1;
+  }
+
+  *line_start = index->buffer + index->starts[low - 1];
+  return (unsigned)low;
+}
+
+void destroy_line_index(struct LineIndex* index){
+  if (index == NULL) return;
+  free(index->starts);
+  free(index);
+}
@@ -0,0 +1,32 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Purpose: Byte offsets of every line start in one NUL-terminated buffer.
+// Invariants/Assumptions: starts is increasing; line n (1-based) begins at
+//                         buffer + starts[n - 1]. Line 1 begins after the NUL
+//                         sentinel the preprocessor writes at buffer[0].
+struct LineIndex {
+  char const* buffer;
+  uint32_t* starts;
+  size_t size;
+  size_t capacity;
+};
+
+// Purpose: Index the line starts of buffer with the vector newline scan.
+// Outputs: Returns a heap-allocated index; free it with destroy_line_index.
+struct LineIndex* create_line_index(char const* buffer);
+
+// Purpose: Map a position in the indexed buffer to its line.
+// Inputs: position points into index->buffer.
+// Outputs: Returns the 1-based line number and stores the first byte of that
+//          line in *line_start.
+// Invariants/Assumptions: O(log lines).
+unsigned line_index_lookup(const struct LineIndex* index, char const* position,
+  char const** line_start);
+
+void destroy_line_index(struct LineIndex* index);
+
+#endif  // LINE_INDEX_H
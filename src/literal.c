@@ -0,0 +1,250 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "char_class.h"
+#include "literal.h"
+
+/*
+  Integer literal parsing.
+  Decimal and hex digit runs are converted eight bytes at a time (SWAR):
+  the bytes are classified in parallel, the digit prefix is found with one
+  count-trailing-zeros, and the digits are combined pairwise in three
+  multiply/shift steps. Binary and octal literals are rare and stay scalar.
+*/
+
+#define ONES   0x0101010101010101ULL
+#define HIGHS  0x8080808080808080ULL
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LITERAL_HAVE_SWAR 1
+#endif
+
+// Conservative page size: an 8-byte read that stays inside one 4 KiB block
+// cannot fault if its first byte is readable.
+static const uintptr_t kPageSize = 4096;
+
+static bool can_read_chunk(char const* p){
+  return ((uintptr_t)p & (kPageSize - 1)) <= kPageSize - 8;
+}
+
+// One digit per step, as the literal parser always did.
+static size_t decimal_run_scalar(char const* p, unsigned long* v){
+  size_t n = 0;
+  while (char_is(p[n], CHAR_DIGIT)){
+    *v = 10 * *v + (unsigned long)(p[n] - '0');
+    n++;
+  }
+  return n;
+}
+
+static size_t hex_run_scalar(char const* p, unsigned long* v){
+  size_t n = 0;
+  while (char_is(p[n], CHAR_HEX_DIGIT)){
+    // '0'-'9' low nibble is the value; 'a'-'f' and 'A'-'F' need 9 more
+    unsigned d = (unsigned)(p[n] & 0x0F) + (char_is(p[n], CHAR_ALPHA) ? 9 : 0);
+    *v = 16 * *v + d;
+    n++;
+  }
+  return n;
+}
+
+#ifdef LITERAL_HAVE_SWAR
+
+// high bit of each byte set when the byte is in [lo, hi] (both < 0x80)
+static uint64_t bytes_in_range(uint64_t x, unsigned lo, unsigned hi){
+  uint64_t low7 = x & (ONES * 0x7F);
+  uint64_t ge = (low7 | HIGHS) - ONES * lo;
+  uint64_t le = (ONES * (0x80 | hi)) - low7;
+  return ge & le & ~x & HIGHS;
+}
+
+// number of leading bytes whose high bit is set in mask
+static size_t leading_bytes(uint64_t mask){
+  uint64_t stop = ~mask & HIGHS;
+  return stop == 0 ? 8 : (size_t)__builtin_ctzll(stop) / 8;
+}
+
+// Convert 8 digit values (first digit in the lowest byte) to a number.
+static uint64_t combine_decimal(uint64_t digits){
+  digits = (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFULL;
+  digits = (digits * 100 + (digits >> 16)) & 0x0000FFFF0000FFFFULL;
+  return (digits * 10000 + (digits >> 32)) & 0xFFFFFFFFULL;
+}
+
+static uint64_t combine_hex(uint64_t nibbles){
+  nibbles = ((nibbles << 4) + (nibbles >> 8)) & 0x00FF00FF00FF00FFULL;
+  nibbles = ((nibbles << 8) + (nibbles >> 16)) & 0x0000FFFF0000FFFFULL;
+  return ((nibbles << 16) + (nibbles >> 32)) & 0xFFFFFFFFULL;
+}
+
+static const unsigned long kPowersOfTen[9] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+};
+
+static size_t decimal_run(char const* p, unsigned long* v){
+  size_t total = 0;
+  while (can_read_chunk(p + total)){
+    uint64_t chunk;
+    memcpy(&chunk, p + total, 8);
+    size_t n = leading_bytes(bytes_in_range(chunk, '0', '9'));
+    if (n == 0) return total;
+
+    uint64_t digits = chunk - ONES * '0';
+    // keep the n digits, moved up so the missing ones read as leading zeros
+    if (n < 8) digits <<= 8 * (8 - n);
+    *v = *v * kPowersOfTen[n] + combine_decimal(digits);
+    total += n;
+    if (n < 8) return total;
+  }
+  return total + decimal_run_scalar(p + total, v);
+}
+
+static size_t hex_run(char const* p, unsigned long* v){
+  size_t total = 0;
+  while (can_read_chunk(p + total)){
+    uint64_t chunk;
+    memcpy(&chunk, p + total, 8);
+    uint64_t letters = bytes_in_range(chunk | (ONES * 0x20), 'a', 'f');
+    uint64_t digits = bytes_in_range(chunk, '0', '9');
+    size_t n = leading_bytes(digits | letters);
+    if (n == 0) return total;
+
+    // '0'-'9' low nibble is the value; 'a'-'f' and 'A'-'F' need 9 more
+    uint64_t nibbles = (chunk & (ONES * 0x0F)) + (letters >> 7) * 9;
+    if (n < 8) nibbles <<= 8 * (8 - n);
+    *v = (n == 8 ? *v << 32 : *v << (4 * n)) | combine_hex(nibbles);
+    total += n;
+    if (n < 8) return total;
+  }
+  return total + hex_run_scalar(p + total, v);
+}
+
+#else
+
+static size_t decimal_run(char const* p, unsigned long* v){
+  return decimal_run_scalar(p, v);
+}
+
+static size_t hex_run(char const* p, unsigned long* v){
+  return hex_run_scalar(p, v);
+}
+
+#endif  // LITERAL_HAVE_SWAR
+
+static long parse_literal_with(char const* p, char const** end, enum ConsumeResult* result,
+  char const** message, bool swar){
+  // edge case for zero literal
+  // (only time leading 0 is allowed)
+  if (p[0] == '0' &&
+    (char_is(p[1], CHAR_SPACE) || p[1] == '\0' || p[1] == ']' || p[1] == '#')){
+    *result = FOUND;
+    *end = p + 1;
+    return 0;
+  }
+
+  unsigned long v = 0;
+  if (char_is(p[0], CHAR_DIGIT) && p[0] != '0') {
+    // decimal literal
+    size_t n = swar ? decimal_run(p, &v) : decimal_run_scalar(p, &v);
+    *result = FOUND;
+    *end = p + n;
+    return (long)v;
+  }
+
+  if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+    // binary literal
+    p += 2;
+    bool saw_digit = false;
+    while (char_is(*p, CHAR_DIGIT)) {
+      saw_digit = true;
+      if (*p - '0' > 1){
+        *message = "Invalid binary literal";
+        *result = ERROR;
+        *end = p;
+        return 0;
+      }
+      v = 2 * v + (unsigned long)(*p - '0');
+      p++;
+    }
+
+    if (!saw_digit){
+      *message = "Binary literal requires at least one digit";
+      *result = ERROR;
+      *end = p;
+      return 0;
+    }
+
+    *result = FOUND;
+    *end = p;
+    return (long)v;
+  }
+
+  if (p[0] == '0' && (p[1] == 'o' || p[1] == 'O')) {
+    // octal literal
+    p += 2;
+    bool saw_digit = false;
+    while (char_is(*p, CHAR_DIGIT)) {
+      saw_digit = true;
+      if (*p - '7' > 0){
+        *message = "Invalid octal literal";
+        *result = ERROR;
+        *end = p;
+        return 0;
+      }
+      v = 8 * v + (unsigned long)(*p - '0');
+      p++;
+    }
+
+    if (!saw_digit){
+      *message = "Octal literal requires at least one digit";
+      *result = ERROR;
+      *end = p;
+      return 0;
+    }
+
+    *result = FOUND;
+    *end = p;
+    return (long)v;
+  }
+
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    // hex literal
+    p += 2;
+    size_t n = swar ? hex_run(p, &v) : hex_run_scalar(p, &v);
+    p += n;
+
+    // any other letter or digit after the run is a bad hex digit
+    if (char_is(*p, CHAR_ALPHA | CHAR_DIGIT)){
+      *message = "Invalid hex literal";
+      *result = ERROR;
+      *end = p;
+      return 0;
+    }
+
+    if (n == 0){
+      *message = "Hex literal requires at least one digit";
+      *result = ERROR;
+      *end = p;
+      return 0;
+    }
+
+    *result = FOUND;
+    *end = p;
+    return (long)v;
+  }
+
+  *result = NOT_FOUND;
+  *end = p;
+  return 0;
+}
+
+long parse_literal(char const* p, char const** end, enum ConsumeResult* result,
+  char const** message){
+  return parse_literal_with(p, end, result, message, true);
+}
+
+long parse_literal_scalar(char const* p, char const** end, enum ConsumeResult* result,
+  char const** message){
+  return parse_literal_with(p, end, result, message, false);
+}
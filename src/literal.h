@@ -0,0 +1,22 @@
+#ifndef LITERAL_H
+#define LITERAL_H
+
+#include "lexer.h"
+
+// Purpose: Parse an unsigned integer literal (decimal, 0b, 0o or 0x) at p.
+// Inputs: p points at the first digit; no whitespace or sign is skipped.
+// Outputs: FOUND returns the value (wrapping modulo 2^64) and sets *end just
+//          past the literal. ERROR sets *message and leaves *end at the
+//          offending character. NOT_FOUND sets *end to p.
+// Invariants/Assumptions: p is NUL terminated. Decimal and hex digits are
+//                         read 8 per step; an 8-byte read is only made when
+//                         it stays inside the page of its first byte.
+long parse_literal(char const* p, char const** end, enum ConsumeResult* result,
+  char const** message);
+
+// Purpose: Same contract as parse_literal, one digit per step.
+// Invariants/Assumptions: Reference for the differential test.
+long parse_literal_scalar(char const* p, char const** end, enum ConsumeResult* result,
+  char const** message);
+
+#endif  // LITERAL_H
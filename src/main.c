@@ -2,16 +2,21 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "assembler.h"
+#include "context.h"
 #include "instruction_array.h"
 #include "label_list.h"
 #include "preprocessor.h"
 #include "elf.h"
 #include "debug.h"
+#include "debug_sidecar.h"
+#include "mem_stats.h"
 
 // Purpose: CRT files to prepend when -crt is used.
 // Inputs/Outputs: Joined with the CRT directory to form full paths.
@@ -22,6 +27,17 @@ static const char* const kCrtFileNames[kCrtFileCount] = {
   "arithmetic.s",
 };
 
+// Purpose: Should main free its results before exiting?
+// Invariants/Assumptions: Exiting returns every page at once, which is far
+//                         cheaper than walking the allocations, so release
+//                         builds skip teardown. Builds that check for leaks
+//                         define BASM_FULL_TEARDOWN.
+#ifdef BASM_FULL_TEARDOWN
+static const bool kFullTeardown = true;
+#else
+static const bool kFullTeardown = false;
+#endif
+
 // Purpose: Join two path components with a '/' separator when needed.
 // Inputs: left and right are path components.
 // Outputs: Returns a heap-allocated joined path or NULL on allocation failure.
@@ -54,6 +70,135 @@ static void free_crt_paths(char** paths, int count) {
   free(paths);
 }
 
+// Purpose: One source file as handed to the preprocessor.
+// Invariants/Assumptions: text is NUL terminated; it is mapped from the file
+//                         when mapped is set and heap allocated otherwise.
+struct SourceFile {
+  char* text;
+  size_t size;            // bytes of source, without the terminator
+  bool mapped;
+};
+
+// Purpose: Read a file that cannot be mapped (a pipe, or a regular file with
+//          no room for the terminator) into a heap buffer.
+// Inputs: size_hint is the expected size, 0 when unknown.
+// Outputs: Returns false after reporting a read error.
+static bool read_source(int fd, const char* file_path, size_t size_hint, struct SourceFile* source){
+  size_t capacity = size_hint > 0 ? size_hint + 1 : 64 * 1024;
+  size_t size = 0;
+  char* text = malloc(capacity);
+  if (text == NULL) {
+    fprintf(stderr, "Failed to allocate memory for source file %s\n", file_path);
+    return false;
+  }
+
+  while (true) {
+    // keep a byte for the terminator
+    if (size + 1 == capacity) {
+      capacity *= 2;
+      char* grown = realloc(text, capacity);
+      if (grown == NULL) {
+        fprintf(stderr, "Failed to allocate memory for source file %s\n", file_path);
+        free(text);
+        return false;
+      }
+      text = grown;
+    }
+    ssize_t got = read(fd, text + size, capacity - size - 1);
+    if (got == 0) break;
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "Failed to read source file %s: %s\n", file_path, strerror(errno));
+      free(text);
+      return false;
+    }
+    size += (size_t)got;
+  }
+
+  text[size] = '\0';
+  source->text = text;
+  source->size = size;
+  source->mapped = false;
+  return true;
+}
+
+// Purpose: Load one source file; "-" reads standard input.
+// Outputs: Returns false after reporting why the file could not be loaded.
+// Invariants/Assumptions: Regular files are mapped read-only and rely on the
+//                         zero fill after the last byte of the final page
+//                         for their terminator, so files that end exactly on
+//                         a page boundary (and empty ones) are read instead.
+static bool load_source(const char* file_path, struct SourceFile* source){
+  bool is_stdin = strcmp(file_path, "-") == 0;
+  int fd = is_stdin ? STDIN_FILENO : open(file_path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open source file %s: %s\n", file_path, strerror(errno));
+    return false;
+  }
+
+  struct stat file_stats;
+  if (fstat(fd, &file_stats) != 0) {
+    fprintf(stderr, "Failed to stat source file %s: %s\n", file_path, strerror(errno));
+    if (!is_stdin) close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)file_stats.st_size;
+  long page_size = sysconf(_SC_PAGESIZE);
+  bool ok;
+  if (S_ISREG(file_stats.st_mode) && size > 0 && page_size > 0 && size % (size_t)page_size != 0) {
+    char* text = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ok = text != MAP_FAILED;
+    if (ok) {
+      // the preprocessor reads it front to back exactly once
+      madvise(text, size, MADV_SEQUENTIAL);
+      source->text = text;
+      source->size = size;
+      source->mapped = true;
+    } else {
+      fprintf(stderr, "Failed to map source file %s: %s\n", file_path, strerror(errno));
+    }
+  } else {
+    ok = read_source(fd, file_path, S_ISREG(file_stats.st_mode) ? size : 0, source);
+  }
+
+  // a mapping stays valid after its descriptor is closed
+  if (!is_stdin) close(fd);
+  return ok;
+}
+
+// Purpose: Unmap or free a loaded source file.
+static void release_source(struct SourceFile* source){
+  if (source->mapped) {
+    munmap(source->text, source->size);
+  } else {
+    free(source->text);
+  }
+  source->text = NULL;
+}
+
+// Purpose: Source files loaded one at a time as preprocess_sources reaches them.
+// Invariants/Assumptions: At most one file (current) is loaded at once.
+struct SourceQueue {
+  const char* const* paths;   // per file, as given on the command line
+  struct SourceFile current;
+  struct MemStats* mem_stats;
+};
+
+static const char* load_queued_source(void* arg, int index){
+  struct SourceQueue* queue = arg;
+  if (!load_source(queue->paths[index], &queue->current)) return NULL;
+  if (queue->current.mapped && queue->mem_stats != NULL) queue->mem_stats->mapped_input += queue->current.size;
+  return queue->current.text;
+}
+
+// the preprocessed copy is all that later phases read
+static void release_queued_source(void* arg, int index){
+  (void)index;
+  struct SourceQueue* queue = arg;
+  release_source(&queue->current);
+}
+
 int main(int argc, const char *const *const argv){
   if (argc <= 0) {
     fprintf(stderr,"usage: %s <file name>\n",argv[0]);
@@ -73,7 +218,12 @@ int main(int argc, const char *const *const argv){
   bool is_kernel = false;
   bool debug_labels = false;
   bool output_binary = false;
+  const char* sidecar_name = NULL;
+  char* sidecar_name_alloc = NULL;
+  bool single_pass = false;
+  bool mem_stats_on = false;
   const char* crt_dir = NULL;
+  unsigned max_errors = kDefaultErrorLimit;
   const char** cli_defines = malloc(argc * sizeof(char*));
   int num_defines = 0;
   for (int i = 1; i < argc; ++i){
@@ -95,6 +245,18 @@ int main(int argc, const char *const *const argv){
       is_kernel = true;
     } else if (strcmp(argv[i], "-g") == 0){
       debug_labels = true;
+    } else if (strcmp(argv[i], "-dbg") == 0){
+      if (i + 1 == argc){
+        fprintf(stderr, "Must specify a debug file name after -dbg\n");
+        free(file_names);
+        free(cli_defines);
+        exit(1);
+      }
+      sidecar_name = argv[++i];
+    } else if (strcmp(argv[i], "-onepass") == 0){
+      single_pass = true;
+    } else if (strcmp(argv[i], "--mem-stats") == 0){
+      mem_stats_on = true;
     } else if (strcmp(argv[i], "-crt") == 0){
       if (i + 1 == argc){
         fprintf(stderr, "Must specify a CRT directory after -crt\n");
@@ -103,6 +265,17 @@ int main(int argc, const char *const *const argv){
         exit(1);
       }
       crt_dir = argv[++i];
+    } else if (strcmp(argv[i], "-max-errors") == 0){
+      char* end = NULL;
+      unsigned long limit = i + 1 < argc ? strtoul(argv[i + 1], &end, 10) : 0;
+      if (end == NULL || end == argv[i + 1] || *end != '\0' || limit > UINT_MAX){
+        fprintf(stderr, "Must specify an error count after -max-errors (0 for no limit)\n");
+        free(file_names);
+        free(cli_defines);
+        exit(1);
+      }
+      max_errors = (unsigned)limit;
+      ++i;
     } else if (strncmp(argv[i], "-D", 2) == 0){
       const char* def = argv[i] + 2;
       if (def[0] == '\0' || strchr(def, '=') == NULL){
@@ -112,8 +285,8 @@ int main(int argc, const char *const *const argv){
         exit(1);
       }
       cli_defines[num_defines++] = def;
-    } else if (argv[i][0] == '-'){
-      fprintf(stderr, "Unrecognized flag %s. Allowed flags are -pre, -o, -bin, -kernel, -g, -crt <dir>, or -DNAME=value\n", argv[i]);
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0'){
+      fprintf(stderr, "Unrecognized flag %s. Allowed flags are -pre, -o, -bin, -kernel, -g, -dbg <file>, -onepass, --mem-stats, -crt <dir>, -max-errors <n>, or -DNAME=value\n", argv[i]);
       free(file_names);
       free(cli_defines);
       exit(1);
@@ -129,17 +302,27 @@ int main(int argc, const char *const *const argv){
     exit(1);
   }
 
-  if (output_binary && debug_labels){
-    fprintf(stderr, "Assembler Error: -bin output does not support -g debug labels\n");
-    free(file_names);
-    free(cli_defines);
-    exit(1);
-  }
-
   if (output_binary && target_name_default){
     target_name = "./a.bin";
   }
 
+  // Binary images cannot carry the text records, so -g writes them to a
+  // binary sidecar next to the output instead.
+  if (output_binary && debug_labels && sidecar_name == NULL){
+    if (strcmp(target_name, "-") == 0){
+      fprintf(stderr, "Must name the debug file with -dbg when -g -bin writes to stdout\n");
+      free(file_names);
+      free(cli_defines);
+      exit(1);
+    }
+    size_t len = strlen(target_name);
+    sidecar_name_alloc = malloc(len + sizeof(".dbg"));
+    memcpy(sidecar_name_alloc, target_name, len);
+    memcpy(sidecar_name_alloc + len, ".dbg", sizeof(".dbg"));
+    sidecar_name = sidecar_name_alloc;
+  }
+  bool want_debug_info = debug_labels || sidecar_name != NULL;
+
   const char* const* input_args = argv;
   const char** input_args_alloc = NULL;
   char** crt_paths = NULL;
@@ -182,46 +365,45 @@ int main(int argc, const char *const *const argv){
     num_files += kCrtFileCount;
   }
 
-  char const** const files = malloc(num_files * sizeof(char**));
+  // the paths to load, before diagnostic names replace "-"
+  const char** paths = malloc(num_files * sizeof(char*));
+  for (int i = 0; i < num_files; ++i) paths[i] = input_args[file_names[i]];
 
+  // diagnostics name standard input "<stdin>" rather than "-"
   for (int i = 0; i < num_files; ++i){
-    // open the files
-    const char* file_path = input_args[file_names[i]];
-    int fd = open(file_path,O_RDONLY);
-    if (fd < 0) {
-      fprintf(stderr, "Failed to open source file %s: %s\n", file_path, strerror(errno));
-      exit(1);
+    if (strcmp(input_args[file_names[i]], "-") != 0) continue;
+    if (input_args_alloc == NULL) {
+      input_args_alloc = malloc(argc * sizeof(char*));
+      for (int j = 0; j < argc; ++j) input_args_alloc[j] = argv[j];
+      input_args = input_args_alloc;
     }
+    input_args_alloc[file_names[i]] = "<stdin>";
+  }
 
-    // determine its size (std::filesystem::get_size?)
-    struct stat file_stats;
-    int rc = fstat(fd,&file_stats);
-    if (rc != 0) {
-      fprintf(stderr, "Failed to stat source file %s: %s\n", file_path, strerror(errno));
-      exit(1);
-    }
+  struct AssemblerContext* ctx = create_assembler_context();
+  if (ctx == NULL) {
+    fprintf(stderr, "Assembler Error: failed to allocate assembler context\n");
+    exit(1);
+  }
 
-    // map the file in my address space
-    char const* const src = (char const * const)mmap(
-        0,
-        file_stats.st_size,
-        PROT_READ,
-        MAP_PRIVATE,
-        fd,
-        0);
-    if (src == MAP_FAILED) {
-      fprintf(stderr, "Failed to map source file %s: %s\n", file_path, strerror(errno));
-      free(file_names);
-      free(files);
-      exit(1);
-    }
-    files[i] = src;
+  // per-phase memory report on stderr, so it never mixes with -pre output
+  struct MemStats* mem_stats = NULL;
+  if (mem_stats_on) {
+    mem_stats = create_mem_stats(stderr);
+    set_mem_stats(ctx, mem_stats);
   }
 
-  char** preprocessed = preprocess(num_files, file_names, is_kernel, input_args, files);
+  set_error_limit(ctx, max_errors);
+  set_expand_macros(ctx, pre_only);
+  struct SourceQueue queue = {paths, {NULL, 0, false}, mem_stats};
+  struct SourceLoader loader = {load_queued_source, release_queued_source, &queue};
+  char** preprocessed = preprocess_sources(ctx, num_files, file_names, input_args, &loader);
+  free(paths);
+
   if (preprocessed == NULL) {
+    destroy_assembler_context(ctx);
+    destroy_mem_stats(mem_stats);
     free(file_names);
-    free(files);
     free(cli_defines);
     free(input_args_alloc);
     free_crt_paths(crt_paths, kCrtFileCount);
@@ -230,46 +412,61 @@ int main(int argc, const char *const *const argv){
 
   if (pre_only){
     for (int i = 0; i < num_files; ++i) printf("%s\n", preprocessed[i] + 1);
+    if (mem_stats != NULL) mem_stats_report_peaks(mem_stats);
     
-    free(file_names);
-    free(files);
-    for (int i = 0; i < num_files; ++i) free(preprocessed[i]);
-    free(preprocessed);
-    free(cli_defines);
-    free(input_args_alloc);
-    free_crt_paths(crt_paths, kCrtFileCount);
+    if (kFullTeardown) {
+      free(file_names);
+      for (int i = 0; i < num_files; ++i) free(preprocessed[i]);
+      free(preprocessed);
+      free(cli_defines);
+      free(input_args_alloc);
+      free_crt_paths(crt_paths, kCrtFileCount);
+      destroy_assembler_context(ctx);
+      destroy_mem_stats(mem_stats);
+    }
     return 0;
   }
 
-  set_cli_defines(num_defines, cli_defines);
+  set_cli_defines(ctx, num_defines, cli_defines);
+  set_single_pass(ctx, single_pass);
   struct LabelList* labels = NULL;
   struct DebugInfoList* labels_c = NULL;
   struct ProgramDescriptor* program = assemble(
+    ctx,
     num_files,
     file_names,
     is_kernel,
     input_args,
     preprocessed,
-    debug_labels ? &labels : NULL,
-    debug_labels ? &labels_c : NULL
+    want_debug_info ? &labels : NULL,
+    want_debug_info ? &labels_c : NULL
   );
   
+  // assembly was the last reader of the preprocessed text; freeing it in every
+  // build keeps the --mem-stats report the same with and without full teardown
   for (int i = 0; i < num_files; ++i) free(preprocessed[i]);
   free(preprocessed);
-  free(file_names);
-  free(files);
-  free(cli_defines);
-  free(input_args_alloc);
-  free_crt_paths(crt_paths, kCrtFileCount);
+  if (mem_stats != NULL) mem_stats_record(mem_stats, MEM_PREPROCESSOR, 0);
+
+  if (kFullTeardown) {
+    free(file_names);
+    free(cli_defines);
+    free(input_args_alloc);
+    free_crt_paths(crt_paths, kCrtFileCount);
+    destroy_assembler_context(ctx);
+  }
 
   if (program == NULL) {
     if (target_name_alloc != NULL) free(target_name_alloc);
+    free(sidecar_name_alloc);
+    destroy_mem_stats(mem_stats);
     return 1;
   }
 
   // write output
   const char* output_mode = output_binary ? "wb" : "w";
-  FILE* fptr = fopen(target_name, output_mode);
+  bool to_stdout = strcmp(target_name, "-") == 0;
+  FILE* fptr = to_stdout ? stdout : fopen(target_name, output_mode);
 
   if(fptr == NULL){
     fprintf(stderr, "Could not open output file\n");   
@@ -293,8 +490,6 @@ int main(int argc, const char *const *const argv){
       // write program data
       fwrite_instruction_array_list(fptr, program->sections, false);
     }
-
-    destroy_program_descriptor(program);
   } else {
     if (is_kernel) {
       // write raw instructions without ELF structure
@@ -313,8 +508,6 @@ int main(int argc, const char *const *const argv){
       fprint_instruction_array_list(fptr, program->sections, false);
     }
 
-    destroy_program_descriptor(program);
-
     // Append label metadata for the debugger.
     if (debug_labels){
       if (is_kernel) {
@@ -322,15 +515,41 @@ int main(int argc, const char *const *const argv){
       } else {
         fprint_label_list(fptr, labels);
       }
-      destroy_label_list(labels);
       fprint_debug_info_list(fptr, labels_c);
-      destroy_debug_info_list(labels_c);
     }
   }
 
-  fclose(fptr);
-  if (target_name_alloc != NULL) {
+  if (to_stdout ? fflush(fptr) != 0 : fclose(fptr) != 0) {
+    fprintf(stderr, "Could not write output file\n");
+    exit(1);
+  }
+
+  if (sidecar_name != NULL) {
+    FILE* sidecar = fopen(sidecar_name, "wb");
+    if (sidecar == NULL) {
+      fprintf(stderr, "Could not open debug file %s\n", sidecar_name);
+      exit(1);
+    }
+    bool written = fwrite_debug_sidecar(sidecar, labels_c, labels);
+    fclose(sidecar);
+    if (!written) {
+      fprintf(stderr, "Assembler Error: debug info does not fit in a debug file\n");
+      exit(1);
+    }
+  }
+
+  if (mem_stats != NULL) {
+    mem_stats_end_phase(mem_stats, "output");
+    mem_stats_report_peaks(mem_stats);
+  }
+
+  if (kFullTeardown) {
+    destroy_mem_stats(mem_stats);
+    destroy_program_descriptor(program);
+    destroy_label_list(labels);
+    if (labels_c != NULL) destroy_debug_info_list(labels_c);
     free(target_name_alloc);
+    free(sidecar_name_alloc);
   }
 
   return 0;
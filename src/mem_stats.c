@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "mem_stats.h"
+
+/*
+  --mem-stats report.
+  Sizes are what each subsystem holds (capacity, not just what is in use),
+  in KiB. The high-water mark is the resident set peak reported by the
+  kernel, which also covers the mapped input and allocator overhead.
+*/
+
+static const char* const kSubsystemNames[MEM_SUBSYSTEM_COUNT] = {
+  "preproc", "tokens", "symbols", "instrs", "debug", "labels",
+};
+
+static size_t to_kib(size_t bytes){
+  return (bytes + 1023) / 1024;
+}
+
+// peak resident set size in KiB, 0 when unknown
+static size_t max_rss_kib(void){
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return (size_t)usage.ru_maxrss;
+}
+
+struct MemStats* create_mem_stats(FILE* out){
+  struct MemStats* stats = calloc(1, sizeof(struct MemStats));
+  if (stats == NULL) return NULL;
+  stats->out = out;
+  return stats;
+}
+
+void mem_stats_record(struct MemStats* stats, enum MemSubsystem subsystem, size_t bytes){
+  stats->bytes[subsystem] = bytes;
+  if (bytes > stats->peak[subsystem]) stats->peak[subsystem] = bytes;
+}
+
+static void print_header(struct MemStats* stats){
+  fprintf(stats->out, "mem-stats: mapped input %zu KiB\n", to_kib(stats->mapped_input));
+  fprintf(stats->out, "%-12s", "KiB");
+  for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i) fprintf(stats->out, " %9s", kSubsystemNames[i]);
+  fprintf(stats->out, " %9s %9s\n", "total", "max rss");
+}
+
+static void print_row(struct MemStats* stats, const char* name, const size_t* bytes, size_t total){
+  fprintf(stats->out, "%-12s", name);
+  for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i) fprintf(stats->out, " %9zu", to_kib(bytes[i]));
+  fprintf(stats->out, " %9zu %9zu\n", to_kib(total), max_rss_kib());
+}
+
+void mem_stats_end_phase(struct MemStats* stats, const char* phase){
+  if (stats->phases++ == 0) print_header(stats);
+
+  size_t total = 0;
+  for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i) total += stats->bytes[i];
+  if (total > stats->peak_total) stats->peak_total = total;
+  print_row(stats, phase, stats->bytes, total);
+}
+
+void mem_stats_report_peaks(struct MemStats* stats){
+  if (stats->phases == 0) print_header(stats);
+  print_row(stats, "peak", stats->peak, stats->peak_total);
+}
+
+void destroy_mem_stats(struct MemStats* stats){
+  free(stats);
+}
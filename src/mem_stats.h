@@ -0,0 +1,46 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+enum MemSubsystem {
+  MEM_PREPROCESSOR,       // preprocessed text of every file
+  MEM_TOKENS,             // token arrays
+  MEM_SYMBOLS,            // interned names and the label/define tables
+  MEM_INSTRUCTIONS,       // section arrays and single-pass fixups
+  MEM_DEBUG_INFO,         // .line/.local records
+  MEM_LABELS,             // -g label list
+  MEM_SUBSYSTEM_COUNT,
+};
+
+// Purpose: Bytes held by each subsystem for --mem-stats.
+// Invariants/Assumptions: Subsystems report their footprint at the end of each
+//                         phase, so nothing is counted per allocation and the
+//                         run pays only a NULL check when stats are off.
+//                         peak is the largest footprint any phase reported.
+struct MemStats {
+  FILE* out;
+  size_t mapped_input;    // bytes of source mapped from disk
+  size_t bytes[MEM_SUBSYSTEM_COUNT];
+  size_t peak[MEM_SUBSYSTEM_COUNT];
+  size_t peak_total;
+  int phases;             // rows written so far
+};
+
+// Purpose: Start collecting; the report is written to out.
+struct MemStats* create_mem_stats(FILE* out);
+
+// Purpose: Set the current footprint of one subsystem.
+void mem_stats_record(struct MemStats* stats, enum MemSubsystem subsystem, size_t bytes);
+
+// Purpose: Write one row with every subsystem's footprint, their total and the
+//          process high-water mark at the end of the named phase.
+void mem_stats_end_phase(struct MemStats* stats, const char* phase);
+
+// Purpose: Write the per-subsystem peaks and the final high-water mark.
+void mem_stats_report_peaks(struct MemStats* stats);
+
+void destroy_mem_stats(struct MemStats* stats);
+
+#endif  // MEM_STATS_H
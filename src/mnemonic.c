@@ -0,0 +1,78 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fixup_array.h"
+#include "mnemonic.h"
+
+/*
+  Mnemonic dispatch table, expanded from ISA_INSTRUCTIONS in isa.h.
+  Every mnemonic fits in 4 bytes, so the token text packed into a 32-bit key is
+  the mnemonic itself. A multiplicative hash with a fixed multiplier maps the
+  keys of this table into distinct slots (a perfect hash), so a lookup is one
+  multiply, one slot read and one key compare.
+*/
+
+static const struct MnemonicDescriptor kMnemonics[] = {
+#define X(name, format, opcode, alt_opcode, sub_op, imm, alt_imm, flags) \
+  {name, FORMAT_##format, opcode, alt_opcode, sub_op, FIXUP_##imm, FIXUP_##alt_imm, flags},
+  ISA_INSTRUCTIONS(X)
+#undef X
+};
+
+enum {
+  kMnemonicCount = sizeof(kMnemonics) / sizeof(kMnemonics[0]),
+  kMnemonicSlotBits = 9,
+  kMnemonicSlots = 1 << kMnemonicSlotBits,
+};
+
+// Multiplier found by searching odd 32-bit constants until every key above
+// lands in its own slot. Adding a mnemonic may require picking a new one; the
+// assert in build_mnemonic_slots fires if two keys collide.
+static const uint32_t kMnemonicHashMultiplier = 0x284AE135u;
+
+// slot -> descriptor index + 1, 0 marks an empty slot
+static uint8_t mnemonic_slots[kMnemonicSlots];
+// built on first lookup; pthread_once keeps concurrent assemblies from racing
+static pthread_once_t mnemonic_slots_once = PTHREAD_ONCE_INIT;
+
+// Pack up to kMnemonicMaxLen bytes of a token into a little-endian key.
+static uint32_t pack_mnemonic_key(const char* start, size_t len){
+  uint32_t key = 0;
+  for (size_t i = 0; i < len; ++i){
+    key |= (uint32_t)(unsigned char)start[i] << (8 * i);
+  }
+  return key;
+}
+
+static uint32_t mnemonic_slot(uint32_t key){
+  return (key * kMnemonicHashMultiplier) >> (32 - kMnemonicSlotBits);
+}
+
+static void build_mnemonic_slots(void){
+  for (size_t i = 0; i < kMnemonicCount; ++i){
+    const char* name = kMnemonics[i].name;
+    uint32_t slot = mnemonic_slot(pack_mnemonic_key(name, strlen(name)));
+    assert(mnemonic_slots[slot] == 0); // hash must stay perfect for this table
+    mnemonic_slots[slot] = (uint8_t)(i + 1);
+  }
+}
+
+const struct MnemonicDescriptor* lookup_mnemonic(const char* start, size_t len){
+  if (len == 0 || len > kMnemonicMaxLen) return NULL;
+  pthread_once(&mnemonic_slots_once, build_mnemonic_slots);
+
+  uint32_t key = pack_mnemonic_key(start, len);
+  uint8_t index = mnemonic_slots[mnemonic_slot(key)];
+  if (index == 0) return NULL;
+
+  const struct MnemonicDescriptor* desc = &kMnemonics[index - 1];
+  if (strncmp(desc->name, start, len) != 0 || desc->name[len] != '\0') return NULL;
+  return desc;
+}
+
+const struct MnemonicDescriptor* mnemonic_table(size_t* count){
+  *count = kMnemonicCount;
+  return kMnemonics;
+}
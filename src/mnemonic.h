@@ -0,0 +1,37 @@
+#ifndef MNEMONIC_H
+#define MNEMONIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "isa.h"
+
+// Purpose: Describe how one mnemonic is parsed and encoded.
+// Invariants/Assumptions: Expanded from one ISA_INSTRUCTIONS row in isa.h; see
+//                         there for what each column means per format.
+struct MnemonicDescriptor {
+  const char* name;
+  enum IsaFormat format;
+  int8_t opcode;      // ISA_NO_OPCODE if the main form does not exist
+  int8_t alt_opcode;  // ISA_NO_OPCODE if the alternate form does not exist
+  uint8_t sub_op;
+  uint8_t imm;        // enum FixupKind
+  uint8_t alt_imm;    // enum FixupKind
+  uint8_t flags;      // ISA_* flags
+};
+
+// Longest mnemonic in the table; longer tokens are never mnemonics.
+enum { kMnemonicMaxLen = 4 };
+
+// Purpose: Map a mnemonic token to its descriptor.
+// Inputs: start/len describe the token text (not NUL terminated).
+// Outputs: Returns the descriptor, or NULL when the token is not a mnemonic.
+// Invariants/Assumptions: O(1); one hash and one key compare per lookup.
+const struct MnemonicDescriptor* lookup_mnemonic(const char* start, size_t len);
+
+// Purpose: Expose the descriptor table in declaration order (for benchmarks).
+// Outputs: Returns the table and stores its length in count.
+const struct MnemonicDescriptor* mnemonic_table(size_t* count);
+
+#endif  // MNEMONIC_H
@@ -2,272 +2,316 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "char_class.h"
+#include "context.h"
 #include "slice.h"
 #include "preprocessor.h"
+#include "scan.h"
 #include "assembler.h"
-
-static size_t result_index;
-
-static char* result;
-static size_t capacity; // using a dynamic array here
-
-// expand dynamic array
-bool expand_capacity(void){
-  // resize
-  result = realloc(result, 2 * capacity);
+#include "mem_stats.h"
+#include "mnemonic.h"
+
+/*
+  The output buffer is sized from the source up front and kept with room for
+  every source byte not yet consumed (plus the null terminator), so bytes
+  copied through unchanged never need a capacity check. Only macro expansions,
+  which may write more than they consume, reserve extra room.
+*/
+
+// Purpose: Make room for extra output bytes on top of the unconsumed source.
+// Outputs: Returns false (after reporting) if the buffer cannot grow.
+static bool reserve_result(struct AssemblerContext* ctx, size_t extra){
+  size_t needed = ctx->result_index + extra + (size_t)(ctx->source_end - ctx->current) + 2;
+  if (needed <= ctx->capacity) return true;
+
+  size_t capacity = 2 * ctx->capacity;
+  if (capacity < needed) capacity = needed;
+  char* result = realloc(ctx->result, capacity);
   if (result == NULL) {
-    fprintf(stderr, "Preprocesser memory error\n");
+    error_printf(ctx, "Preprocesser memory error\n");
     return false;
   }
-  capacity = 2 * capacity;
+  ctx->result = result;
+  ctx->capacity = capacity;
   return true;
 }
 
-// expand dynamic array if necessary
-bool check_capacity(void){
-  // leave room for null terminator
-  if (result_index >= capacity - 2) return expand_capacity();
-  return true;
+// Purpose: Copy len unchanged source bytes to the output.
+// Invariants/Assumptions: Room is guaranteed by the reserve_result invariant.
+static void copy_span(struct AssemblerContext* ctx, size_t len){
+  memcpy(ctx->result + ctx->result_index, ctx->current, len);
+  ctx->result_index += len;
+  ctx->current += len;
 }
 
-// remove single line # comments
-bool skip_comments(void){
-  if (*current == '#'){
-    while (*current != '\n') {
-      if (*current == '\0') return false;
-      current++;
-    }
-  }
-  return true;
-}
-
-void expand_nop(void){
+void expand_nop(struct AssemblerContext* ctx, bool* success){
   #define NOP_EXPANSION "and  r0, r0, r0"
 
   size_t expansion_len = strlen(NOP_EXPANSION) + 1; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, NOP_EXPANSION);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, NOP_EXPANSION);
 }
 
-void expand_ret(void){
+void expand_ret(struct AssemblerContext* ctx, bool* success){
   #define RET_EXPANSION "jmp  r29"
 
   size_t expansion_len = strlen(RET_EXPANSION) + 1; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, RET_EXPANSION);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, RET_EXPANSION);
 }
 
-void expand_push(bool* success){
+void expand_push(struct AssemblerContext* ctx, bool* success){
   #define PUSH_EXPANSION "swa  r%d [sp, -4]!"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   size_t expansion_len = strlen(PUSH_EXPANSION) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, PUSH_EXPANSION, ra);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, PUSH_EXPANSION, ra);
 }
 
-void expand_pop(bool* success){
+void expand_pop(struct AssemblerContext* ctx, bool* success){
   #define POP_EXPANSION "lwa  r%d, [sp], 4"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   size_t expansion_len = strlen(POP_EXPANSION) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, POP_EXPANSION, ra);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, POP_EXPANSION, ra);
 }
 
-void expand_pshd(bool* success){
+void expand_pshd(struct AssemblerContext* ctx, bool* success){
   #define PSHD_EXPANSION "sda  r%d [sp, -2]!"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   size_t expansion_len = strlen(PSHD_EXPANSION) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, PSHD_EXPANSION, ra);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, PSHD_EXPANSION, ra);
 }
 
-void expand_popd(bool* success){
+void expand_popd(struct AssemblerContext* ctx, bool* success){
   #define POPD_EXPANSION "lda  r%d, [sp], 2"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   size_t expansion_len = strlen(POPD_EXPANSION) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, POPD_EXPANSION, ra);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, POPD_EXPANSION, ra);
 }
 
-void expand_pshb(bool* success){
+void expand_pshb(struct AssemblerContext* ctx, bool* success){
   #define PSHB_EXPANSION "sba  r%d [sp, -1]!"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   size_t expansion_len = strlen(PSHB_EXPANSION) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, PSHB_EXPANSION, ra);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, PSHB_EXPANSION, ra);
 }
 
-void expand_popb(bool* success){
+void expand_popb(struct AssemblerContext* ctx, bool* success){
   #define POPB_EXPANSION "lba  r%d, [sp], 1"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   size_t expansion_len = strlen(POPB_EXPANSION) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, POPB_EXPANSION, ra);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, POPB_EXPANSION, ra);
 }
 
-void expand_movi(bool* success){
+void expand_movi(struct AssemblerContext* ctx, bool* success){
   #define MOVI_EXPANSION_LIT "movu r%d, 0x%X; movl r%d, 0x%X"
   #define MOVI_EXPANSION_LBL_1 "movu r%d, "
   #define MOVI_EXPANSION_LBL_2 "; movl r%d, "
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    print_error();
-    fprintf(stderr, "Invalid register\n");
-    fprintf(stderr, "Valid registers are r0 - r31\n");
+    print_error(ctx);
+    error_printf(ctx, "Invalid register\n");
+    error_printf(ctx, "Valid registers are r0 - r31\n");
     *success = false;
     return;
   }
 
   enum ConsumeResult c_result;
-  long imm = consume_literal(&c_result);
+  long imm = consume_literal(ctx, &c_result);
   if (c_result == FOUND){
     // was a number
     size_t expansion_len = strlen(MOVI_EXPANSION_LIT) + 40; // could be a big number
-    while (result_index + expansion_len >= capacity - 2) expand_capacity();
-    result_index += sprintf(result + result_index, MOVI_EXPANSION_LIT, 
+    if (!reserve_result(ctx, expansion_len)) {
+      *success = false;
+      return;
+    }
+    ctx->result_index += sprintf(ctx->result + ctx->result_index, MOVI_EXPANSION_LIT, 
       ra, (unsigned)imm, ra, (unsigned)imm);
   } else {
     // check if its a string/label
-    struct Slice* label = consume_identifier();
-    if (label != NULL){
+    struct Slice label = consume_identifier(ctx);
+    if (label.start != NULL){
 
       size_t expansion_len = 
-        strlen(MOVI_EXPANSION_LBL_1) + strlen(MOVI_EXPANSION_LBL_2) + 2 * label->len + 2;
-      while (result_index + expansion_len >= capacity - 2) expand_capacity();
-      result_index += sprintf(result + result_index, MOVI_EXPANSION_LBL_1, ra);
-      strncpy(result + result_index, label->start, label->len);
-      result_index += label->len;
-      result_index += sprintf(result + result_index, MOVI_EXPANSION_LBL_2, ra);
-      strncpy(result + result_index, label->start, label->len);
-      result_index += label->len;
-
-      free(label);
+        strlen(MOVI_EXPANSION_LBL_1) + strlen(MOVI_EXPANSION_LBL_2) + 2 * label.len + 2;
+      if (!reserve_result(ctx, expansion_len)) {
+        *success = false;
+        return;
+      }
+      ctx->result_index += sprintf(ctx->result + ctx->result_index, MOVI_EXPANSION_LBL_1, ra);
+      strncpy(ctx->result + ctx->result_index, label.start, label.len);
+      ctx->result_index += label.len;
+      ctx->result_index += sprintf(ctx->result + ctx->result_index, MOVI_EXPANSION_LBL_2, ra);
+      strncpy(ctx->result + ctx->result_index, label.start, label.len);
+      ctx->result_index += label.len;
+
     } else {
       // error
-      print_error();
-      fprintf(stderr, "Expected immediate\n");
+      print_error(ctx);
+      error_printf(ctx, "Expected immediate\n");
       *success = false;
       return;
     }
   }
 }
 
-void expand_mov(bool* success){
+void expand_mov(struct AssemblerContext* ctx, bool* success){
   #define MOV_EXPANSION_USR "add  r%d, r%d, r0"
   #define MOV_EXPANSION_CR_1 "crmv r%d, cr%d"
   #define MOV_EXPANSION_CR_2 "crmv cr%d, r%d"
   #define MOV_EXPANSION_CR_3 "crmv cr%d, cr%d"
 
-  int ra = consume_register();
+  int ra = consume_register(ctx);
   if (ra == -1){
-    ra = consume_control_register();
+    ra = consume_control_register(ctx);
     if (ra == -1){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return;
     }
-    int rb = consume_register();
+    int rb = consume_register(ctx);
     if (rb == -1){
-      rb = consume_control_register();
+      rb = consume_control_register(ctx);
       if (rb == -1){
-        print_error();
-        fprintf(stderr, "Invalid register\n");
-        fprintf(stderr, "Valid registers are r0 - r31\n");
+        print_error(ctx);
+        error_printf(ctx, "Invalid register\n");
+        error_printf(ctx, "Valid registers are r0 - r31\n");
         *success = false;
         return;
       }
       size_t expansion_len = strlen(MOV_EXPANSION_CR_3) + 2; // account for null
-      while (result_index + expansion_len >= capacity - 2) expand_capacity();
-      result_index += sprintf(result + result_index, MOV_EXPANSION_CR_3, ra, rb);
+      if (!reserve_result(ctx, expansion_len)) {
+        *success = false;
+        return;
+      }
+      ctx->result_index += sprintf(ctx->result + ctx->result_index, MOV_EXPANSION_CR_3, ra, rb);
       return;
     }
     size_t expansion_len = strlen(MOV_EXPANSION_CR_2) + 2; // account for null
-    while (result_index + expansion_len >= capacity - 2) expand_capacity();
-    result_index += sprintf(result + result_index, MOV_EXPANSION_CR_2, ra, rb);
+    if (!reserve_result(ctx, expansion_len)) {
+      *success = false;
+      return;
+    }
+    ctx->result_index += sprintf(ctx->result + ctx->result_index, MOV_EXPANSION_CR_2, ra, rb);
     return;
   }
 
-  int rb = consume_register();
+  int rb = consume_register(ctx);
   if (rb == -1){
-    rb = consume_control_register();
+    rb = consume_control_register(ctx);
     if (rb == -1){
-      print_error();
-      fprintf(stderr, "Invalid register\n");
-      fprintf(stderr, "Valid registers are r0 - r31\n");
+      print_error(ctx);
+      error_printf(ctx, "Invalid register\n");
+      error_printf(ctx, "Valid registers are r0 - r31\n");
       *success = false;
       return;
     }
 
     size_t expansion_len = strlen(MOV_EXPANSION_CR_1) + 2; // account for null
-    while (result_index + expansion_len >= capacity - 2) expand_capacity();
-    result_index += sprintf(result + result_index, MOV_EXPANSION_CR_1, ra, rb);
+    if (!reserve_result(ctx, expansion_len)) {
+      *success = false;
+      return;
+    }
+    ctx->result_index += sprintf(ctx->result + ctx->result_index, MOV_EXPANSION_CR_1, ra, rb);
     return;
   }
 
   size_t expansion_len = strlen(MOV_EXPANSION_USR) + 2; // account for null
-  while (result_index + expansion_len >= capacity - 2) expand_capacity();
-  result_index += sprintf(result + result_index, MOV_EXPANSION_USR, ra, rb);
+  if (!reserve_result(ctx, expansion_len)) {
+    *success = false;
+    return;
+  }
+  ctx->result_index += sprintf(ctx->result + ctx->result_index, MOV_EXPANSION_USR, ra, rb);
   return;
 }
 
-void expand_call(bool* success){
+void expand_call(struct AssemblerContext* ctx, bool* success){
   // immediates can be numbers or labels
 
   #define CALL_EXPANSION_LIT "movu r29, 0x%X; movl r29, 0x%X; br r29, r29"
@@ -277,115 +321,199 @@ void expand_call(bool* success){
   #define CALL_EXPANSION_LBL_3 "; br r29, r29"
 
   enum ConsumeResult c_result;
-  long imm = consume_literal(&c_result);
+  long imm = consume_literal(ctx, &c_result);
   if (c_result == FOUND){
     // was a number
     size_t expansion_len = strlen(CALL_EXPANSION_LIT) + 20; // could be a big number
-    while (result_index + expansion_len >= capacity - 2) expand_capacity();
-    result_index += sprintf(result + result_index, CALL_EXPANSION_LIT, (unsigned)imm, (unsigned)imm);
+    if (!reserve_result(ctx, expansion_len)) {
+      *success = false;
+      return;
+    }
+    ctx->result_index += sprintf(ctx->result + ctx->result_index, CALL_EXPANSION_LIT, (unsigned)imm, (unsigned)imm);
   } else {
     // check if its a string/label
-    struct Slice* label = consume_identifier();
-    if (label != NULL){
+    struct Slice label = consume_identifier(ctx);
+    if (label.start != NULL){
 
       size_t expansion_len = strlen(CALL_EXPANSION_LBL_1) + strlen(CALL_EXPANSION_LBL_2) + 
-        strlen(CALL_EXPANSION_LBL_3) + label->len * 2 + 2;
-      while (result_index + expansion_len >= capacity - 2) expand_capacity();
-      result_index += sprintf(result + result_index, CALL_EXPANSION_LBL_1);
-      strncpy(result + result_index, label->start, label->len);
-      result_index += label->len;
-      result_index += sprintf(result + result_index, CALL_EXPANSION_LBL_2);
-      strncpy(result + result_index, label->start, label->len);
-      result_index += label->len;
-      result_index += sprintf(result + result_index, CALL_EXPANSION_LBL_3);
-
-      free(label);
+        strlen(CALL_EXPANSION_LBL_3) + label.len * 2 + 2;
+      if (!reserve_result(ctx, expansion_len)) {
+        *success = false;
+        return;
+      }
+      ctx->result_index += sprintf(ctx->result + ctx->result_index, CALL_EXPANSION_LBL_1);
+      strncpy(ctx->result + ctx->result_index, label.start, label.len);
+      ctx->result_index += label.len;
+      ctx->result_index += sprintf(ctx->result + ctx->result_index, CALL_EXPANSION_LBL_2);
+      strncpy(ctx->result + ctx->result_index, label.start, label.len);
+      ctx->result_index += label.len;
+      ctx->result_index += sprintf(ctx->result + ctx->result_index, CALL_EXPANSION_LBL_3);
+
     } else {
       // error
-      print_error();
-      fprintf(stderr, "Expected immediate\n");
+      print_error(ctx);
+      error_printf(ctx, "Expected immediate\n");
       *success = false;
       return;
     }
   }
 }
 
-bool expand_macros(void){
+bool expand_macros(struct AssemblerContext* ctx){
   bool success = true;
-  if (consume_keyword("nop")) expand_nop();
-  else if (consume_keyword("ret")) expand_ret();
-  else if (consume_keyword("push")) expand_push(&success);
-  else if (consume_keyword("pop")) expand_pop(&success);
-  else if (consume_keyword("pshw")) expand_push(&success);
-  else if (consume_keyword("popw")) expand_pop(&success);
-  else if (consume_keyword("pshd")) expand_pshd(&success);
-  else if (consume_keyword("popd")) expand_popd(&success);
-  else if (consume_keyword("pshb")) expand_pshb(&success);
-  else if (consume_keyword("popb")) expand_popb(&success);
-  else if (consume_keyword("movi")) expand_movi(&success);
-  else if (consume_keyword("mov")) expand_mov(&success);
-  else if (consume_keyword("call")) expand_call(&success);
-
-  if (!success) fprintf(stderr, "Preprocesser macro error\n");
+  if (consume_keyword(ctx, "nop")) expand_nop(ctx, &success);
+  else if (consume_keyword(ctx, "ret")) expand_ret(ctx, &success);
+  else if (consume_keyword(ctx, "push")) expand_push(ctx, &success);
+  else if (consume_keyword(ctx, "pop")) expand_pop(ctx, &success);
+  else if (consume_keyword(ctx, "pshw")) expand_push(ctx, &success);
+  else if (consume_keyword(ctx, "popw")) expand_pop(ctx, &success);
+  else if (consume_keyword(ctx, "pshd")) expand_pshd(ctx, &success);
+  else if (consume_keyword(ctx, "popd")) expand_popd(ctx, &success);
+  else if (consume_keyword(ctx, "pshb")) expand_pshb(ctx, &success);
+  else if (consume_keyword(ctx, "popb")) expand_popb(ctx, &success);
+  else if (consume_keyword(ctx, "movi")) expand_movi(ctx, &success);
+  else if (consume_keyword(ctx, "mov")) expand_mov(ctx, &success);
+  else if (consume_keyword(ctx, "call")) expand_call(ctx, &success);
+
+  if (!success) error_printf(ctx, "Preprocesser macro error\n");
 
   return success;
 }
 
+// Purpose: Copy source up to stop, expanding built-in macros where a word starts.
+// Outputs: Returns false once the error limit is reached; a malformed macro is
+//          reported and the rest of its line dropped.
+// Invariants/Assumptions: stop is a comment or the end of the source, so no word
+//                         runs past it. Only words that name a macro are matched.
+static bool copy_expanding(struct AssemblerContext* ctx, char const* stop){
+  while (ctx->current < stop){
+    char const* word = ctx->current;
+    while (word < stop && !char_is(*word, CHAR_IDENT_BODY)) word++;
+    copy_span(ctx, (size_t)(word - ctx->current));
+    if (word == stop) break;
+
+    size_t len = 1;
+    while (char_is(word[len], CHAR_IDENT_BODY)) len++;
+    const struct MnemonicDescriptor* op = lookup_mnemonic(word, len);
+    if (op != NULL && op->format >= FORMAT_NOP){
+      if (!expand_macros(ctx)){
+        if (!finish_error(ctx)) return false;
+        ctx->current = scan_kernels()->find_line_end(ctx->current);
+        continue;
+      }
+      if (ctx->current != word) continue;
+    }
+    copy_span(ctx, len);
+  }
+  return true;
+}
+
+void set_expand_macros(struct AssemblerContext* ctx, bool enabled){
+  ctx->expand_builtin_macros = enabled;
+}
+
+// Purpose: Give back the source of file index once preprocess is done with it.
+static void release_loaded_source(struct AssemblerContext* ctx, const struct SourceLoader* loader, int index){
+  // the line index of a diagnostic points into the released text
+  set_current_buffer(ctx, NULL);
+  if (loader->release != NULL) loader->release(loader->arg, index);
+}
+
 // copy the program into a new string, but without the comments
-// expand macros into real instructions
-char** preprocess(int num_files, int* file_names, bool is_kernel,
-  const char *const *const argv, const char * const * const files){
+// expand macros into real instructions when asked to
+char** preprocess_sources(struct AssemblerContext* ctx, int num_files, int* file_names,
+  const char *const *const argv, const struct SourceLoader* loader){
 
   char ** result_list = malloc(num_files * sizeof(char**));
+  size_t retained = 0;    // bytes of the finished files, for --mem-stats
 
   for (int i = 0; i < num_files; ++i){
+    const char* source = loader->load(loader->arg, i);
+    if (source == NULL) {
+      for (int j = 0; j < i; ++j) free(result_list[j]);
+      free(result_list);
+      flush_diagnostics(ctx);
+      return NULL;
+    }
 
     // initialize parser
-    current = files[i];
-    current_buffer_start = current;
-    line_count = 1;
-    pc = is_kernel ? 0 : 0x80000000;
-    result_index = 0;
-    capacity = 60;
-    current_file = argv[file_names[i]];
-
-    result = malloc(sizeof(char) * capacity);
-    if (result == NULL) return NULL;
+    ctx->current = source;
+    set_current_buffer(ctx, ctx->current);
+    ctx->result_index = 0;
+    ctx->current_file = argv[file_names[i]];
+    ctx->current_file_index = i;
+
+    // size the output from the source (the loaded text is null terminated);
+    // the slack covers typical macro growth so most files never realloc
+    size_t source_len = strlen(source);
+    ctx->source_end = source + source_len;
+    ctx->capacity = source_len + source_len / 8 + 64;
+
+    ctx->result = malloc(sizeof(char) * ctx->capacity);
+    if (ctx->result == NULL) {
+      release_loaded_source(ctx, loader, i);
+      for (int j = 0; j < i; ++j) free(result_list[j]);
+      free(result_list);
+      flush_diagnostics(ctx);
+      return NULL;
+    }
 
     // initial null used to detect start of program
     // used when printing errors
-    result[result_index] = '\0';
-    result_index++; 
-
-    while (*current != '\0'){
-      // expand dynamic array if necessary, exit if realloc fails 
-      if (!check_capacity()) {
-        for (int j = 0; j < i; ++j) free(result_list[j]);
-        free(result_list);
-        return NULL;
-      }
-
-      // skip comments, exit if EOF is reached
-      if (!skip_comments()) goto end;
-
-      if (!expand_macros()) {
+    ctx->result[ctx->result_index] = '\0';
+    ctx->result_index++; 
+
+    // copy everything up to the next comment in one step, then drop the
+    // comment up to (not including) its newline
+    while (ctx->current < ctx->source_end){
+      char const* stop = memchr(ctx->current, '#', (size_t)(ctx->source_end - ctx->current));
+      if (stop == NULL) stop = ctx->source_end;
+
+      if (!ctx->expand_builtin_macros) {
+        copy_span(ctx, (size_t)(stop - ctx->current));
+      } else if (!copy_expanding(ctx, stop)) {
+        release_loaded_source(ctx, loader, i);
         for (int j = 0; j < i; ++j) free(result_list[j]);
-        free(result);
+        free(ctx->result);
         free(result_list);
+        flush_diagnostics(ctx);
         return NULL;
       }
 
-      // write one character, then repeat loop
-      result[result_index] = *current;
-      if (*current == '\n') line_count++;
-      result_index++;
-      current++;
+      if (*ctx->current == '#') ctx->current = scan_kernels()->find_line_end(ctx->current);
     }
 
-    // include null terminator, realloc should ensure there's always room
-    end:  result[result_index] = 0;
-    result_list[i] = result;
+    // include null terminator, reserve_result ensures there's always room;
+    // then give back the slack, since the text lives until assembly ends
+    ctx->result[ctx->result_index] = 0;
+    release_loaded_source(ctx, loader, i);
+    if (ctx->mem_stats != NULL) mem_stats_record(ctx->mem_stats, MEM_PREPROCESSOR, retained + ctx->capacity);
+    retained += ctx->result_index + 1;
+    char* trimmed = realloc(ctx->result, ctx->result_index + 1);
+    result_list[i] = trimmed != NULL ? trimmed : ctx->result;
+    ctx->result = NULL;
   }
 
+  if (ctx->mem_stats != NULL){
+    mem_stats_record(ctx->mem_stats, MEM_PREPROCESSOR, retained);
+    mem_stats_end_phase(ctx->mem_stats, "preprocess");
+  }
+
+  flush_diagnostics(ctx);
+  if (ctx->error_count > 0){
+    for (int i = 0; i < num_files; ++i) free(result_list[i]);
+    free(result_list);
+    return NULL;
+  }
   return result_list;
 }
+
+static const char* load_from_array(void* arg, int index){
+  return ((const char* const*)arg)[index];
+}
+
+char** preprocess(struct AssemblerContext* ctx, int num_files, int* file_names,
+  const char *const *const argv, const char * const * const files){
+  struct SourceLoader loader = {load_from_array, NULL, (void*)files};
+  return preprocess_sources(ctx, num_files, file_names, argv, &loader);
+}
@@ -3,7 +3,30 @@
 
 #include <stdbool.h>
 
-char** preprocess(int num_files, int* file_names, bool has_start,
+struct AssemblerContext;
+
+// Purpose: Choose whether preprocess expands built-in macros (nop, push, call, ...)
+//          into text. Only -pre output needs it; assemble reads the macros itself.
+void set_expand_macros(struct AssemblerContext* ctx, bool enabled);
+
+// Purpose: Hands preprocess_sources the text of each file in turn.
+// Invariants/Assumptions: load returns NUL-terminated text, or NULL after reporting
+//                         why the file could not be read. release (if set) is called
+//                         on each loaded file as soon as it has been preprocessed,
+//                         before the next one is loaded.
+struct SourceLoader {
+  const char* (*load)(void* arg, int index);
+  void (*release)(void* arg, int index);
+  void* arg;
+};
+
+// Purpose: Preprocess every file, loading each one only while it is being read.
+// Outputs: Returns one string per file, or NULL after printing the diagnostics.
+char** preprocess_sources(struct AssemblerContext* ctx, int num_files, int* file_names,
+  const char *const *const argv, const struct SourceLoader* loader);
+
+// Purpose: preprocess_sources over texts that are already in memory.
+char** preprocess(struct AssemblerContext* ctx, int num_files, int* file_names,
   const char *const *const argv, const char * const * const files);
 
 #endif  // PREPROCESSOR_H
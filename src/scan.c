@@ -0,0 +1,233 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "char_class.h"
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+  Whitespace scanning kernels.
+  The scalar versions define the behaviour; the SSE2 and AVX2 versions test
+  16 or 32 bytes per step and must agree with them byte for byte.
+  Each vector scan starts from the aligned block containing p and masks off
+  the bytes before p, so loads never cross into a page the scalar loop would
+  not read.
+*/
+
+static const char* skip_blanks_scalar(const char* p){
+  while (char_is(*p, CHAR_SEPARATOR)) p++;
+  return p;
+}
+
+static const char* skip_whitespace_scalar(const char* p, unsigned* newlines){
+  while (char_is(*p, CHAR_SPACE)){
+    if (*p == '\n') *newlines += 1;
+    p++;
+  }
+  return p;
+}
+
+static const char* find_line_end_scalar(const char* p){
+  while (*p != '\n' && *p != '\0') p++;
+  return p;
+}
+
+static const struct ScanKernels kScalarKernels = {
+  "scalar",
+  skip_blanks_scalar,
+  skip_whitespace_scalar,
+  find_line_end_scalar,
+};
+
+#ifdef SCAN_HAVE_X86
+
+// bytes in \t..\r, tested as (b - '\t') <= 4 unsigned
+__attribute__((target("sse2")))
+static inline __m128i control_space_sse2(__m128i b){
+  __m128i t = _mm_sub_epi8(b, _mm_set1_epi8('\t'));
+  return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')), t);
+}
+
+__attribute__((target("sse2")))
+static inline unsigned blank_bits_sse2(const char* block){
+  __m128i b = _mm_load_si128((const __m128i*)block);
+  __m128i blank = _mm_andnot_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\n')), control_space_sse2(b));
+  blank = _mm_or_si128(blank, _mm_cmpeq_epi8(b, _mm_set1_epi8(' ')));
+  blank = _mm_or_si128(blank, _mm_cmpeq_epi8(b, _mm_set1_epi8(',')));
+  blank = _mm_or_si128(blank, _mm_cmpeq_epi8(b, _mm_set1_epi8(';')));
+  return (unsigned)_mm_movemask_epi8(blank);
+}
+
+__attribute__((target("sse2")))
+static const char* skip_blanks_sse2(const char* p){
+  unsigned misalign = (unsigned)((uintptr_t)p & 15);
+  const char* block = p - misalign;
+  unsigned stop = ~blank_bits_sse2(block) & (0xFFFFu << misalign) & 0xFFFFu;
+  while (stop == 0){
+    block += 16;
+    stop = ~blank_bits_sse2(block) & 0xFFFFu;
+  }
+  return block + __builtin_ctz(stop);
+}
+
+__attribute__((target("sse2")))
+static const char* skip_whitespace_sse2(const char* p, unsigned* newlines){
+  unsigned misalign = (unsigned)((uintptr_t)p & 15);
+  const char* block = p - misalign;
+  unsigned valid = (0xFFFFu << misalign) & 0xFFFFu;
+  while (true){
+    __m128i b = _mm_load_si128((const __m128i*)block);
+    __m128i nl = _mm_cmpeq_epi8(b, _mm_set1_epi8('\n'));
+    __m128i space = _mm_or_si128(control_space_sse2(b), _mm_cmpeq_epi8(b, _mm_set1_epi8(' ')));
+    unsigned nl_bits = (unsigned)_mm_movemask_epi8(nl) & valid;
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(space) & valid;
+    if (stop != 0){
+      unsigned before = (1u << __builtin_ctz(stop)) - 1;
+      *newlines += (unsigned)__builtin_popcount(nl_bits & before);
+      return block + __builtin_ctz(stop);
+    }
+    *newlines += (unsigned)__builtin_popcount(nl_bits);
+    block += 16;
+    valid = 0xFFFFu;
+  }
+}
+
+__attribute__((target("sse2")))
+static const char* find_line_end_sse2(const char* p){
+  unsigned misalign = (unsigned)((uintptr_t)p & 15);
+  const char* block = p - misalign;
+  unsigned valid = (0xFFFFu << misalign) & 0xFFFFu;
+  while (true){
+    __m128i b = _mm_load_si128((const __m128i*)block);
+    __m128i end = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\n')),
+                               _mm_cmpeq_epi8(b, _mm_setzero_si128()));
+    unsigned stop = (unsigned)_mm_movemask_epi8(end) & valid;
+    if (stop != 0) return block + __builtin_ctz(stop);
+    block += 16;
+    valid = 0xFFFFu;
+  }
+}
+
+static const struct ScanKernels kSse2Kernels = {
+  "sse2",
+  skip_blanks_sse2,
+  skip_whitespace_sse2,
+  find_line_end_sse2,
+};
+
+__attribute__((target("avx2")))
+static inline __m256i control_space_avx2(__m256i b){
+  __m256i t = _mm256_sub_epi8(b, _mm256_set1_epi8('\t'));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')), t);
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t blank_bits_avx2(const char* block){
+  __m256i b = _mm256_load_si256((const __m256i*)block);
+  __m256i blank = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')),
+                                      control_space_avx2(b));
+  blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(b, _mm256_set1_epi8(' ')));
+  blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(b, _mm256_set1_epi8(',')));
+  blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(b, _mm256_set1_epi8(';')));
+  return (uint32_t)_mm256_movemask_epi8(blank);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_blanks_avx2(const char* p){
+  unsigned misalign = (unsigned)((uintptr_t)p & 31);
+  const char* block = p - misalign;
+  uint32_t stop = ~blank_bits_avx2(block) & (UINT32_MAX << misalign);
+  while (stop == 0){
+    block += 32;
+    stop = ~blank_bits_avx2(block);
+  }
+  return block + __builtin_ctz(stop);
+}
+
+__attribute__((target("avx2,popcnt")))
+static const char* skip_whitespace_avx2(const char* p, unsigned* newlines){
+  unsigned misalign = (unsigned)((uintptr_t)p & 31);
+  const char* block = p - misalign;
+  uint32_t valid = UINT32_MAX << misalign;
+  while (true){
+    __m256i b = _mm256_load_si256((const __m256i*)block);
+    __m256i nl = _mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n'));
+    __m256i space = _mm256_or_si256(control_space_avx2(b),
+                                    _mm256_cmpeq_epi8(b, _mm256_set1_epi8(' ')));
+    uint32_t nl_bits = (uint32_t)_mm256_movemask_epi8(nl) & valid;
+    uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(space) & valid;
+    if (stop != 0){
+      uint32_t before = (UINT32_C(1) << __builtin_ctz(stop)) - 1;
+      *newlines += (unsigned)__builtin_popcount(nl_bits & before);
+      return block + __builtin_ctz(stop);
+    }
+    *newlines += (unsigned)__builtin_popcount(nl_bits);
+    block += 32;
+    valid = UINT32_MAX;
+  }
+}
+
+__attribute__((target("avx2")))
+static const char* find_line_end_avx2(const char* p){
+  unsigned misalign = (unsigned)((uintptr_t)p & 31);
+  const char* block = p - misalign;
+  uint32_t valid = UINT32_MAX << misalign;
+  while (true){
+    __m256i b = _mm256_load_si256((const __m256i*)block);
+    __m256i end = _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')),
+                                  _mm256_cmpeq_epi8(b, _mm256_setzero_si256()));
+    uint32_t stop = (uint32_t)_mm256_movemask_epi8(end) & valid;
+    if (stop != 0) return block + __builtin_ctz(stop);
+    block += 32;
+    valid = UINT32_MAX;
+  }
+}
+
+static const struct ScanKernels kAvx2Kernels = {
+  "avx2",
+  skip_blanks_avx2,
+  skip_whitespace_avx2,
+  find_line_end_avx2,
+};
+
+#endif  // SCAN_HAVE_X86
+
+const struct ScanKernels* scan_kernels_for(enum ScanIsa isa){
+  switch (isa){
+    case SCAN_ISA_SCALAR:
+      return &kScalarKernels;
+#ifdef SCAN_HAVE_X86
+    case SCAN_ISA_SSE2:
+      return __builtin_cpu_supports("sse2") ? &kSse2Kernels : NULL;
+    case SCAN_ISA_AVX2:
+      return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : NULL;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+static const struct ScanKernels* selected_kernels = NULL;
+static pthread_once_t select_kernels_once = PTHREAD_ONCE_INIT;
+
+static void select_kernels(void){
+  // prefer the widest kernel the host can run
+  const struct ScanKernels* kernels = NULL;
+  for (int isa = SCAN_ISA_COUNT - 1; isa >= 0 && kernels == NULL; --isa){
+    kernels = scan_kernels_for((enum ScanIsa)isa);
+  }
+  __atomic_store_n(&selected_kernels, kernels, __ATOMIC_RELEASE);
+}
+
+const struct ScanKernels* scan_kernels(void){
+  // called per token, so skip pthread_once once a choice has been published
+  const struct ScanKernels* kernels = __atomic_load_n(&selected_kernels, __ATOMIC_ACQUIRE);
+  if (kernels != NULL) return kernels;
+  pthread_once(&select_kernels_once, select_kernels);
+  return selected_kernels;
+}
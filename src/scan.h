@@ -0,0 +1,41 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Instruction sets with a scanning kernel; scalar works on every host.
+enum ScanIsa {
+  SCAN_ISA_SCALAR,
+  SCAN_ISA_SSE2,
+  SCAN_ISA_AVX2,
+  SCAN_ISA_COUNT,
+};
+
+// Purpose: Byte-scanning loops used by the lexer and preprocessor.
+// Invariants/Assumptions: Inputs are NUL terminated; NUL never counts as
+//                         whitespace, so every scan stops at the terminator.
+//                         Vector kernels only read aligned blocks that hold a
+//                         byte the scalar loop would read, so they never touch
+//                         a page the scalar loop would not.
+struct ScanKernels {
+  const char* name;
+
+  // first byte that is not a blank (space, \t, \v, \f, \r), ',' or ';'
+  const char* (*skip_blanks)(const char* p);
+
+  // first byte that is not whitespace; adds the newlines skipped to *newlines
+  const char* (*skip_whitespace)(const char* p, unsigned* newlines);
+
+  // first '\n' or NUL at or after p
+  const char* (*find_line_end)(const char* p);
+};
+
+// Purpose: Return the fastest kernels the host supports.
+// Outputs: Returns a static table; chosen once on first use.
+const struct ScanKernels* scan_kernels(void);
+
+// Purpose: Return the kernels for one instruction set.
+// Outputs: Returns NULL when this build or host cannot run them.
+const struct ScanKernels* scan_kernels_for(enum ScanIsa isa);
+
+#endif  // SCAN_H
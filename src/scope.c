@@ -0,0 +1,64 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "hashmap.h"
+#include "scope.h"
+
+struct Scope* create_scope(uint32_t symbol_count, struct HashMap* const* local_labels,
+  struct HashMap* const* local_defines, struct HashMap* const* local_globals,
+  const struct HashMap* global_labels){
+  struct Scope* scope = malloc(sizeof(struct Scope));
+  scope->local_labels = local_labels;
+  scope->local_defines = local_defines;
+  scope->local_globals = local_globals;
+  scope->global_labels = global_labels;
+  scope->count = symbol_count;
+  scope->bindings = malloc((symbol_count > 0 ? symbol_count : 1) * sizeof(struct SymbolBinding));
+  for (uint32_t i = 0; i < symbol_count; ++i) scope->bindings[i].file = -1;
+  scope->scratch.file = -1;
+  return scope;
+}
+
+// Purpose: Probe each table of the file's scope once and fill binding.
+static void resolve(const struct Scope* scope, int file, uint32_t symbol, struct SymbolBinding* binding){
+  const struct HashEntry* local = hash_map_find(scope->local_labels[file], symbol);
+  const struct HashEntry* global = hash_map_find(scope->global_labels, symbol);
+  const struct HashEntry* define = hash_map_find(scope->local_defines[file], symbol);
+
+  binding->file = file;
+  binding->is_define = define != NULL;
+  binding->define_value = define != NULL ? define->value : 0;
+  if (local != NULL && local->is_defined){
+    // a label exported from this file has one address in both tables
+    assert(global == NULL || !global->is_defined ||
+           !hash_map_contains(scope->local_globals[file], symbol) || global->value == local->value);
+    binding->kind = SYMBOL_LOCAL_LABEL;
+    binding->value = local->value;
+  } else if (global != NULL && global->is_defined){
+    binding->kind = SYMBOL_GLOBAL_LABEL;
+    binding->value = global->value;
+  } else if (define != NULL){
+    binding->kind = SYMBOL_DEFINE;
+    binding->value = define->value;
+  } else {
+    binding->kind = SYMBOL_UNDEFINED;
+    binding->value = 0;
+  }
+}
+
+const struct SymbolBinding* scope_resolve(struct Scope* scope, int file, uint32_t symbol){
+  struct SymbolBinding* binding = symbol < scope->count ? &scope->bindings[symbol] : &scope->scratch;
+  if (binding->file != file || binding == &scope->scratch) resolve(scope, file, symbol, binding);
+  return binding;
+}
+
+size_t scope_footprint(const struct Scope* scope){
+  if (scope == NULL) return 0;
+  return sizeof(struct Scope) + (scope->count > 0 ? scope->count : 1) * sizeof(struct SymbolBinding);
+}
+
+void destroy_scope(struct Scope* scope){
+  if (scope == NULL) return;
+  free(scope->bindings);
+  free(scope);
+}
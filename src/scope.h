@@ -0,0 +1,61 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct HashMap;
+
+/*
+  Scoped symbol resolution for pass 2.
+  A name is resolved in the scope of one file layered over the global scope:
+  a defined label of the file, then a defined global label, then a .define of
+  the file. The binding of each symbol id is cached with the file it was
+  resolved for, so later references from the same file read one array slot.
+*/
+
+enum SymbolKind {
+  SYMBOL_UNDEFINED,
+  SYMBOL_LOCAL_LABEL,
+  SYMBOL_GLOBAL_LABEL,
+  SYMBOL_DEFINE,
+};
+
+struct SymbolBinding {
+  int32_t file;         // file the binding was resolved for; -1 when empty
+  uint8_t kind;         // enum SymbolKind; a label shadows a define of the same name
+  bool is_define;       // the file defines the name, even if a label shadows it
+  long value;           // label address, or the define value for SYMBOL_DEFINE
+  long define_value;    // valid when is_define
+};
+
+struct Scope {
+  struct HashMap* const* local_labels;   // per file
+  struct HashMap* const* local_defines;  // per file
+  struct HashMap* const* local_globals;  // per file, names declared .global there
+  const struct HashMap* global_labels;
+  struct SymbolBinding* bindings;        // indexed by symbol id
+  uint32_t count;
+  struct SymbolBinding scratch;          // binding of an id interned after creation
+};
+
+// Purpose: Create a resolver over the label and define tables of an assembly.
+// Inputs: symbol_count is the number of interned ids; the tables are borrowed
+//         and must not change while the scope is in use.
+struct Scope* create_scope(uint32_t symbol_count, struct HashMap* const* local_labels,
+  struct HashMap* const* local_defines, struct HashMap* const* local_globals,
+  const struct HashMap* global_labels);
+
+// Purpose: Tell what symbol means in file.
+// Outputs: The binding stays valid until the next call.
+// Invariants/Assumptions: A label both local and global in one file must have
+//                         the same address in both tables.
+const struct SymbolBinding* scope_resolve(struct Scope* scope, int file, uint32_t symbol);
+
+// Purpose: Bytes held by the scope (for --mem-stats).
+size_t scope_footprint(const struct Scope* scope);
+
+void destroy_scope(struct Scope* scope);
+
+#endif  // SCOPE_H
@@ -1,7 +1,7 @@
-#include <ctype.h>
 #include <stdio.h>
 #include <stdbool.h>
 
+#include "char_class.h"
 #include "slice.h"
 
 bool compare_slice_to_pointer(const struct Slice* s, char const *p) {
@@ -25,21 +25,21 @@ bool compare_slice_to_slice(const struct Slice* self, const struct Slice* other)
 bool is_identifier(const struct Slice* slice) {
   if (slice->len == 0)
     return false;
-  if (!isalpha(slice->start[0]))
+  if (!char_is(slice->start[0], CHAR_ALPHA))
     return false;
   for (size_t i = 1; i < slice->len; i++)
-    if (!isalnum(slice->start[i]))
+    if (!char_is(slice->start[i], CHAR_ALPHA | CHAR_DIGIT))
       return false;
   return true;
 }
 
-void print_slice(struct Slice* slice) {
+void print_slice(const struct Slice* slice) {
   for (size_t i = 0; i < slice->len; i++) {
     printf("%c", slice->start[i]);
   }
 }
 
-void print_slice_err(struct Slice* slice) {
+void print_slice_err(const struct Slice* slice) {
   for (size_t i = 0; i < slice->len; i++) {
     fprintf(stderr, "%c", slice->start[i]);
   }
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+
+#include "symbol.h"
+
+/*
+  Identifier interning.
+  Slots are probed linearly from the name's hash and hold ids; the names and
+  their hashes are stored densely by id, so a probe only compares text when
+  the full hashes match. Name text is copied into an arena rather than
+  allocated per symbol, and never moves.
+*/
+
+enum {
+  kMinSymbolCapacity = 64,
+  kNameBlockSize = 4096,
+};
+
+struct SymbolTable* create_symbol_table(void){
+  struct SymbolTable* table = malloc(sizeof(struct SymbolTable));
+  table->capacity = kMinSymbolCapacity;
+  table->count = 0;
+  table->names = malloc(table->capacity / 2 * sizeof(struct Slice));
+  table->hashes = malloc(table->capacity / 2 * sizeof(uint32_t));
+  table->slots = calloc(table->capacity, sizeof(uint32_t));
+  table->name_text = create_arena(kNameBlockSize);
+  return table;
+}
+
+// double the slot array; the name arrays always hold capacity / 2 ids
+static void grow(struct SymbolTable* table){
+  table->capacity *= 2;
+  table->names = realloc(table->names, table->capacity / 2 * sizeof(struct Slice));
+  table->hashes = realloc(table->hashes, table->capacity / 2 * sizeof(uint32_t));
+  free(table->slots);
+  table->slots = calloc(table->capacity, sizeof(uint32_t));
+
+  size_t mask = table->capacity - 1;
+  for (uint32_t id = 0; id < table->count; ++id){
+    size_t i = table->hashes[id] & mask;
+    while (table->slots[i] != 0) i = (i + 1) & mask;
+    table->slots[i] = id + 1;
+  }
+}
+
+uint32_t intern_symbol(struct SymbolTable* table, char const* start, size_t len){
+  struct Slice name = {start, len};
+  uint32_t hash = (uint32_t)hash_slice(&name);
+
+  size_t mask = table->capacity - 1;
+  size_t i = hash & mask;
+  while (table->slots[i] != 0){
+    uint32_t id = table->slots[i] - 1;
+    if (table->hashes[id] == hash && compare_slice_to_slice(&table->names[id], &name)) return id;
+    i = (i + 1) & mask;
+  }
+
+  // keep the slots at most half full so probe sequences stay short
+  if (2 * (table->count + 1) > table->capacity){
+    grow(table);
+    mask = table->capacity - 1;
+    i = hash & mask;
+    while (table->slots[i] != 0) i = (i + 1) & mask;
+  }
+
+  uint32_t id = table->count++;
+  table->names[id].start = arena_strndup(table->name_text, start, len);
+  table->names[id].len = len;
+  table->hashes[id] = hash;
+  table->slots[i] = id + 1;
+  return id;
+}
+
+size_t symbol_table_footprint(const struct SymbolTable* table){
+  if (table == NULL) return 0;
+  return sizeof(struct SymbolTable) + table->capacity * sizeof(uint32_t) +
+    table->capacity / 2 * (sizeof(struct Slice) + sizeof(uint32_t)) + arena_footprint(table->name_text);
+}
+
+void destroy_symbol_table(struct SymbolTable* table){
+  if (table == NULL) return;
+  destroy_arena(table->name_text);
+  free(table->names);
+  free(table->hashes);
+  free(table->slots);
+  free(table);
+}
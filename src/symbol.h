@@ -0,0 +1,42 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "slice.h"
+
+// id of no symbol; never returned by intern_symbol
+#define NO_SYMBOL UINT32_MAX
+
+// Interning table: gives each distinct identifier a dense id (0, 1, 2, ...)
+// the first time it is seen. Label and define tables are keyed by these ids.
+struct SymbolTable {
+  struct Slice* names;    // names[id], NUL-terminated copies in name_text
+  uint32_t* hashes;       // hashes[id], so growing never rehashes text
+  uint32_t count;
+  uint32_t* slots;        // id + 1 of the name hashed here, 0 when empty
+  size_t capacity;        // power of two, at least twice count
+  struct Arena* name_text;
+};
+
+struct SymbolTable* create_symbol_table(void);
+
+// Purpose: Look up the id of a name, giving it the next id if it is new.
+// Inputs: start/len is the name; it is copied, so it may be transient.
+// Outputs: Returns the id of the name.
+uint32_t intern_symbol(struct SymbolTable* table, char const* start, size_t len);
+
+// Purpose: View the name of an interned id.
+// Outputs: The text is NUL terminated and lives as long as the table.
+// Invariants/Assumptions: id was returned by intern_symbol on this table.
+static inline struct Slice symbol_name(const struct SymbolTable* table, uint32_t id){
+  return table->names[id];
+}
+
+// Purpose: Bytes held by the table and its name text (for --mem-stats).
+size_t symbol_table_footprint(const struct SymbolTable* table);
+
+void destroy_symbol_table(struct SymbolTable* table);
+
+#endif  // SYMBOL_H
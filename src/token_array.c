@@ -0,0 +1,45 @@
+#include <stdlib.h>
+
+#include "token_array.h"
+
+/*
+  Dynamic array of tokens for one preprocessed source buffer
+*/
+
+struct TokenArray* create_token_array(char const* source, size_t capacity){
+  struct TokenArray* arr = malloc(sizeof(struct TokenArray));
+  if (capacity == 0) capacity = 16;
+
+  arr->source = source;
+  arr->tokens = malloc(sizeof(struct Token) * capacity);
+  arr->size = 0;
+  arr->capacity = capacity;
+
+  return arr;
+}
+
+void token_array_append(struct TokenArray* arr, enum TokenKind kind,
+  uint32_t offset, uint32_t len, long value){
+  if (arr->size == arr->capacity){
+    arr->tokens = realloc(arr->tokens, arr->capacity * sizeof(struct Token) * 2);
+    arr->capacity = arr->capacity * 2;
+  }
+
+  struct Token* token = &arr->tokens[arr->size];
+  token->kind = (uint8_t)kind;
+  token->offset = offset;
+  token->len = len;
+  token->value = value;
+  arr->size++;
+}
+
+size_t token_array_footprint(const struct TokenArray* arr){
+  if (arr == NULL) return 0;
+  return sizeof(struct TokenArray) + arr->capacity * sizeof(struct Token);
+}
+
+void destroy_token_array(struct TokenArray* arr){
+  if (arr == NULL) return;
+  free(arr->tokens);
+  free(arr);
+}
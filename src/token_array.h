@@ -0,0 +1,42 @@
+#ifndef TOKEN_ARRAY_H
+#define TOKEN_ARRAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum TokenKind {
+  TOKEN_IDENTIFIER, // labels, mnemonics, registers, and other names
+  TOKEN_DIRECTIVE,  // names starting with '.', such as .text; value holds the enum DirectiveId
+  TOKEN_INTEGER,    // integer literal, value holds the parsed number
+  TOKEN_BAD_LITERAL, // malformed integer literal, reported when parsed
+  TOKEN_FILENAME,   // raw operand of a .line directive
+  TOKEN_PUNCT,      // any other single character, such as '[' or ':'
+  TOKEN_NEWLINE,    // run of line breaks
+  TOKEN_EOF,
+};
+
+struct Token {
+  uint8_t kind;     // enum TokenKind
+  uint32_t offset;  // byte offset of the token text in the source buffer
+  uint32_t len;     // length of the token text
+  long value;       // integer value, symbol id of an identifier, or directive id
+};
+
+struct TokenArray {
+  char const * source; // buffer the token offsets index into
+  struct Token* tokens;
+  size_t size;
+  size_t capacity;
+};
+
+struct TokenArray* create_token_array(char const* source, size_t capacity);
+
+void token_array_append(struct TokenArray* arr, enum TokenKind kind,
+  uint32_t offset, uint32_t len, long value);
+
+// Purpose: Bytes held by the array (for --mem-stats).
+size_t token_array_footprint(const struct TokenArray* arr);
+
+void destroy_token_array(struct TokenArray* arr);
+
+#endif  // TOKEN_ARRAY_H
@@ -0,0 +1,12 @@
+  .text
+
+  .global _start
+_start:
+  add r1, r2, 99999
+  add r40, r1, r2
+  add r1, r1, 1
+  lw r1, r2
+  push r99
+  frob r1
+  sub r3, r3, 0x1G
+  call
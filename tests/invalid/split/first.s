@@ -0,0 +1,10 @@
+    .text
+
+    .global _start
+    .global message
+_start:
+    add r1, r1
+    .data
+    .space 3
+message:
+    .fill 7
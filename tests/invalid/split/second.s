@@ -0,0 +1,10 @@
+    .text
+
+    # pass 2 still checks this file, after the error in first.s
+    br nowhere
+    lw r1, [count]
+    movi r2, message
+    .data
+    .space 1
+count:
+    .fill message
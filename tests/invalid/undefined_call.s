@@ -0,0 +1,6 @@
+    .text
+
+    .global _start
+_start:
+    movi r1, nowhere
+    call nowhere
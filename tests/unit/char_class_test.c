@@ -0,0 +1,43 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "char_class.h"
+
+/*
+  Checks the character class table against the C library's ctype functions
+  in the "C" locale, plus the punctuation each class adds on top.
+*/
+
+static bool in(int c, const char* set){
+  for (; *set != '\0'; ++set){
+    if (*set == c) return true;
+  }
+  return false;
+}
+
+int main(void){
+  int failures = 0;
+
+  for (int c = 0; c < 256; ++c){
+    bool space = isspace(c) != 0;
+    bool expected[8] = {
+      space,
+      (space && c != '\n') || in(c, ",;"),
+      space || c == '\0' || in(c, ",;:"),
+      isalpha(c) || c == '_',
+      isalnum(c) || in(c, "_."),
+      isdigit(c) != 0,
+      isxdigit(c) != 0,
+      isalpha(c) != 0,
+    };
+    for (int bit = 0; bit < 8; ++bit){
+      if (char_is((char)c, 1u << bit) != expected[bit]){
+        fprintf(stderr, "byte 0x%02X: class bit %d is wrong\n", c, bit);
+        failures++;
+      }
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "context.h"
+#include "elf.h"
+#include "instruction_array.h"
+#include "preprocessor.h"
+
+/*
+  Runs several assemblies at once, each on its own thread with its own
+  AssemblerContext, and checks every result against the same program
+  assembled alone. Each thread gets a different program (and half of them
+  single-pass mode), so state leaking between contexts changes the output.
+*/
+
+#define PROGRAMS 8
+#define ROUNDS 25
+
+static char sources[PROGRAMS][512];
+
+struct Output {
+  int words[64];
+  size_t count;
+  bool ok;
+};
+
+static struct Output reference[PROGRAMS];
+
+static void write_program(int k){
+  snprintf(sources[k], sizeof(sources[k]),
+    ".text\n"
+    ".global _start\n"
+    "_start:\n"
+    "  add r1, r0, %d\n"
+    "  movi r2, value\n"
+    "  push r1\n"
+    "loop:\n"
+    "  br loop\n"
+    ".data\n"
+    "value:\n"
+    "  .fill %d\n"
+    "  .fill loop\n",
+    k + 1, 1000 * k);
+}
+
+static void assemble_program(int k, struct Output* out){
+  const char* argv[] = {"context_test", "program.s"};
+  int file_names[] = {1};
+  const char* files[] = {sources[k]};
+  out->count = 0;
+  out->ok = false;
+
+  struct AssemblerContext* ctx = create_assembler_context();
+  set_single_pass(ctx, k % 2 == 1);
+  char** preprocessed = preprocess(ctx, 1, file_names, argv, files);
+  if (preprocessed == NULL){
+    destroy_assembler_context(ctx);
+    return;
+  }
+  struct ProgramDescriptor* program =
+    assemble(ctx, 1, file_names, false, argv, preprocessed, NULL, NULL);
+  free(preprocessed[0]);
+  free(preprocessed);
+  destroy_assembler_context(ctx);
+  if (program == NULL) return;
+
+  for (struct InstructionArray* arr = program->sections->head; arr != NULL; arr = arr->next){
+    for (size_t i = 0; i < arr->size && out->count < 64; ++i){
+      out->words[out->count++] = instruction_array_get(arr, i);
+    }
+  }
+  out->ok = true;
+  destroy_program_descriptor(program);
+}
+
+static void* worker(void* arg){
+  int k = (int)(size_t)arg;
+  for (int round = 0; round < ROUNDS; ++round){
+    struct Output out;
+    assemble_program(k, &out);
+    if (!out.ok || out.count != reference[k].count ||
+        memcmp(out.words, reference[k].words, out.count * sizeof(int)) != 0){
+      return (void*)1;
+    }
+  }
+  return NULL;
+}
+
+int main(void){
+  int failures = 0;
+
+  for (int k = 0; k < PROGRAMS; ++k){
+    write_program(k);
+    assemble_program(k, &reference[k]);
+    if (!reference[k].ok){
+      fprintf(stderr, "program %d failed to assemble\n", k);
+      return 1;
+    }
+  }
+
+  pthread_t threads[PROGRAMS];
+  for (int k = 0; k < PROGRAMS; ++k){
+    pthread_create(&threads[k], NULL, worker, (void*)(size_t)k);
+  }
+  for (int k = 0; k < PROGRAMS; ++k){
+    void* result;
+    pthread_join(threads[k], &result);
+    if (result != NULL){
+      fprintf(stderr, "program %d differs when assembled concurrently\n", k);
+      failures++;
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
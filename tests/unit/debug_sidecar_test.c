@@ -0,0 +1,176 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "debug_sidecar.h"
+#include "label_list.h"
+
+/*
+  Round trip through the binary debug sidecar.
+  Random .line/.local records (a few files, addresses out of order, lines
+  going backwards, several records at one address) and labels are printed
+  in the -g text form and written as a sidecar. Decoding the sidecar and
+  printing it the same way must give the same records, and line lookups
+  must agree with a scan of the text records.
+*/
+
+#define RECORDS 5000
+#define LABELS 300
+#define LOOKUPS 2000
+
+static unsigned long rng_state = 4242;
+
+static unsigned next_random(void){
+  rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+  return (unsigned)(rng_state >> 33);
+}
+
+static const char* const kFiles[] = {"main.c", "lib/util.c", "/abs/path/io.c", "a.s"};
+
+static int compare_strings(const void* a, const void* b){
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Purpose: Read the lines of a stream, sorted, so record order does not matter.
+static char** sorted_lines(FILE* f, size_t* count){
+  size_t capacity = 1024;
+  char** lines = malloc(capacity * sizeof(char*));
+  char buffer[256];
+  *count = 0;
+  rewind(f);
+  while (fgets(buffer, sizeof(buffer), f) != NULL){
+    if (*count == capacity){
+      capacity *= 2;
+      lines = realloc(lines, capacity * sizeof(char*));
+    }
+    lines[(*count)++] = strdup(buffer);
+  }
+  qsort(lines, *count, sizeof(char*), compare_strings);
+  return lines;
+}
+
+static void free_lines(char** lines, size_t count){
+  for (size_t i = 0; i < count; ++i) free(lines[i]);
+  free(lines);
+}
+
+int main(void){
+  struct DebugInfoList* debug = create_debug_info_list();
+  struct LabelList* labels = create_label_list(16);
+  char name[32];
+  int failures = 0;
+
+  uint32_t addr = 0x80000000u;
+  for (int i = 0; i < RECORDS; ++i){
+    // mostly increasing, sometimes repeated or moved backwards
+    unsigned step = next_random() % 8;
+    if (step == 0 && addr > 0x80000100u) addr -= 4 * (next_random() % 64);
+    else if (step > 1) addr += 4 * (next_random() % 3);
+    if (next_random() % 4 == 0){
+      int len = sprintf(name, "var%u", next_random() % 50);
+      struct Slice var = {name, (size_t)len};
+      add_debug_local(debug, &var, -(int)(next_random() % 128), 1 + next_random() % 16, addr);
+    } else {
+      const char* file = kFiles[next_random() % 4];
+      struct Slice file_name = {file, strlen(file)};
+      add_debug_line(debug, &file_name, (int)(next_random() % 3000) - 5, addr);
+    }
+  }
+  for (int i = 0; i < LABELS; ++i){
+    int len = sprintf(name, "label_%d", i);
+    label_list_append(labels, name, (size_t)len, 0x80000000u + 4 * (next_random() % 4096), i % 5 == 0);
+  }
+
+  FILE* text = tmpfile();
+  fprint_label_list(text, labels);
+  fprint_debug_info_list(text, debug);
+
+  FILE* binary = tmpfile();
+  if (!fwrite_debug_sidecar(binary, debug, labels)){
+    fprintf(stderr, "sidecar did not fit\n");
+    return 1;
+  }
+  size_t size = (size_t)ftell(binary);
+  uint8_t* bytes = malloc(size);
+  rewind(binary);
+  if (fread(bytes, 1, size, binary) != size){
+    fprintf(stderr, "short read\n");
+    return 1;
+  }
+
+  struct DebugSidecar sidecar;
+  if (!open_debug_sidecar(bytes, size, &sidecar)){
+    fprintf(stderr, "sidecar rejected\n");
+    return 1;
+  }
+
+  // print the decoded sidecar in the text form
+  FILE* decoded = tmpfile();
+  for (uint32_t i = 0; i < sidecar.label_count; ++i){
+    struct DebugSidecarLabel label = debug_sidecar_label(&sidecar, i);
+    fprintf(decoded, "#%s %s %08X\n", label.is_data ? "data" : "label", label.name, label.addr);
+  }
+  struct DebugSidecarLine* lines = malloc((sidecar.line_count + 1) * sizeof(struct DebugSidecarLine));
+  if (!debug_sidecar_read_lines(&sidecar, lines)){
+    fprintf(stderr, "line table malformed\n");
+    return 1;
+  }
+  for (uint32_t i = 0; i < sidecar.line_count; ++i){
+    if (i > 0 && lines[i].addr < lines[i - 1].addr){
+      fprintf(stderr, "line table not sorted at %u\n", i);
+      failures++;
+    }
+    fprintf(decoded, "#line %s %d %08X\n", debug_sidecar_file_name(&sidecar, lines[i].file),
+      lines[i].line, lines[i].addr);
+  }
+  for (uint32_t i = 0; i < sidecar.local_count; ++i){
+    struct DebugSidecarLocal local = debug_sidecar_local(&sidecar, i);
+    fprintf(decoded, "#local %s %d %zu %08X\n", local.name, local.offset, (size_t)local.size, local.addr);
+  }
+
+  size_t text_count, decoded_count;
+  char** text_lines = sorted_lines(text, &text_count);
+  char** decoded_lines = sorted_lines(decoded, &decoded_count);
+  if (text_count != decoded_count){
+    fprintf(stderr, "%zu text records, %zu decoded\n", text_count, decoded_count);
+    failures++;
+  }
+  for (size_t i = 0; i < text_count && i < decoded_count && failures == 0; ++i){
+    if (strcmp(text_lines[i], decoded_lines[i]) != 0){
+      fprintf(stderr, "text \"%s\" decoded as \"%s\"\n", text_lines[i], decoded_lines[i]);
+      failures++;
+    }
+  }
+
+  // lookups return the last line record (in address order) at or below the address
+  for (int i = 0; i < LOOKUPS && failures == 0; ++i){
+    uint32_t query = 0x80000000u - 64 + (next_random() % 0x4000);
+    const struct DebugSidecarLine* expected = NULL;
+    for (uint32_t j = 0; j < sidecar.line_count && lines[j].addr <= query; ++j) expected = &lines[j];
+    struct DebugSidecarLine found;
+    bool ok = debug_sidecar_find_line(&sidecar, query, &found);
+    if (ok != (expected != NULL) ||
+        (ok && memcmp(&found, expected, sizeof(found)) != 0)){
+      fprintf(stderr, "lookup of %08X disagrees with a scan\n", query);
+      failures++;
+    }
+  }
+
+  if (open_debug_sidecar(bytes, size - 1, &sidecar)){
+    fprintf(stderr, "truncated sidecar accepted\n");
+    failures++;
+  }
+
+  free_lines(text_lines, text_count);
+  free_lines(decoded_lines, decoded_count);
+  free(lines);
+  free(bytes);
+  fclose(text);
+  fclose(binary);
+  fclose(decoded);
+  destroy_label_list(labels);
+  destroy_debug_info_list(debug);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diagnostic.h"
+
+/*
+  Reports random diagnostics out of order, some in several pieces and some
+  longer than the initial text buffer, and checks that printing them gives
+  every text in (file, line, report order) order.
+*/
+
+#define DIAGNOSTICS 3000
+
+static unsigned long rng_state = 99;
+
+static unsigned next_random(void){
+  rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+  return (unsigned)(rng_state >> 33);
+}
+
+struct Expected {
+  int file;
+  unsigned line;
+  size_t order;
+  size_t pieces;
+};
+
+static int compare_expected(const void* a, const void* b){
+  const struct Expected* x = a;
+  const struct Expected* y = b;
+  if (x->file != y->file) return x->file < y->file ? -1 : 1;
+  if (x->line != y->line) return x->line < y->line ? -1 : 1;
+  return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+// the text of diagnostic order, split into pieces appends
+static void write_expected(FILE* f, const struct Expected* e){
+  fprintf(f, "%d:%u #%zu", e->file, e->line, e->order);
+  for (size_t p = 0; p < e->pieces; ++p) fprintf(f, " piece%zu-%s", p, p % 7 == 6 ? "................................" : "");
+  fprintf(f, "\n");
+}
+
+int main(void){
+  struct DiagnosticList* list = create_diagnostic_list(4);
+  struct Expected* expected = malloc(DIAGNOSTICS * sizeof(struct Expected));
+  int failures = 0;
+
+  for (size_t i = 0; i < DIAGNOSTICS; ++i){
+    struct Expected* e = &expected[i];
+    e->file = next_random() % 8 == 0 ? kDiagnosticNoFile : (int)(next_random() % 5);
+    e->line = e->file == kDiagnosticNoFile ? 0 : next_random() % 200;
+    e->order = i;
+    e->pieces = next_random() % 20;
+
+    size_t index = diagnostic_begin(list, e->file, e->line);
+    diagnostic_printf(list, index, "%d:%u #%zu", e->file, e->line, e->order);
+    for (size_t p = 0; p < e->pieces; ++p){
+      diagnostic_printf(list, index, " piece%zu-%s", p, p % 7 == 6 ? "................................" : "");
+    }
+    diagnostic_printf(list, index, "\n");
+  }
+
+  FILE* printed = tmpfile();
+  fprint_diagnostic_list(printed, list);
+  if (list->size != 0){
+    fprintf(stderr, "list not emptied after printing\n");
+    failures++;
+  }
+
+  qsort(expected, DIAGNOSTICS, sizeof(struct Expected), compare_expected);
+  FILE* wanted = tmpfile();
+  for (size_t i = 0; i < DIAGNOSTICS; ++i) write_expected(wanted, &expected[i]);
+
+  rewind(printed);
+  rewind(wanted);
+  char a[1024];
+  char b[1024];
+  size_t line = 0;
+  while (failures == 0 && fgets(b, sizeof(b), wanted) != NULL){
+    line++;
+    if (fgets(a, sizeof(a), printed) == NULL || strcmp(a, b) != 0){
+      fprintf(stderr, "line %zu: expected %s", line, b);
+      failures++;
+    }
+  }
+  if (failures == 0 && fgets(a, sizeof(a), printed) != NULL){
+    fprintf(stderr, "extra output: %s", a);
+    failures++;
+  }
+
+  fclose(printed);
+  fclose(wanted);
+  free(expected);
+  destroy_diagnostic_list(list);
+  return failures == 0 ? 0 : 1;
+}
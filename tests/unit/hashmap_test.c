@@ -0,0 +1,75 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashmap.h"
+#include "symbol.h"
+
+/*
+  Interns names well past the symbol table's initial size, fills a label
+  table keyed by their ids, and checks insert, lookup, definition state and
+  iteration against the values each name should hold. Names are written to
+  a scratch buffer that is reused, so the interner must keep its own copies.
+*/
+
+#define KEYS 60000
+
+static int check(bool condition, const char* what, int i){
+  if (condition) return 0;
+  fprintf(stderr, "key %d: %s\n", i, what);
+  return 1;
+}
+
+int main(void){
+  struct SymbolTable* symbols = create_symbol_table();
+  struct HashMap* map = create_hash_map(4);
+  char scratch[32];
+  int failures = 0;
+
+  // even keys start defined, odd keys are only referenced
+  for (int i = 0; i < KEYS; ++i){
+    uint32_t key = intern_symbol(symbols, scratch, (size_t)sprintf(scratch, "label_%d", i));
+    hash_map_insert(map, key, i, i % 2 == 0, i % 3 == 0);
+  }
+  // re-inserting only replaces the value, not the definition state
+  for (int i = 0; i < KEYS; i += 5){
+    uint32_t key = intern_symbol(symbols, scratch, (size_t)sprintf(scratch, "label_%d", i));
+    hash_map_insert(map, key, -i, true, false);
+  }
+  for (int i = 1; i < KEYS; i += 2){
+    uint32_t key = intern_symbol(symbols, scratch, (size_t)sprintf(scratch, "label_%d", i));
+    if (i % 4 == 1) make_defined(map, key, 2 * i);
+  }
+
+  for (int i = 0; i < KEYS && failures == 0; ++i){
+    uint32_t key = intern_symbol(symbols, scratch, (size_t)sprintf(scratch, "label_%d", i));
+    long expected = i % 4 == 1 ? 2 * i : (i % 5 == 0 ? -i : i);
+    bool defined = i % 2 == 0 || i % 4 == 1;
+    failures += check(hash_map_contains(map, key), "missing", i);
+    failures += check(hash_map_get(map, key) == expected, "wrong value", i);
+    failures += check(label_has_definition(map, key) == defined, "wrong definition state", i);
+  }
+
+  failures += check(symbols->count == KEYS, "interned twice", (int)symbols->count);
+  uint32_t absent = intern_symbol(symbols, "label_x", 7);
+  failures += check(!hash_map_contains(map, absent), "absent key found", -1);
+  failures += check(hash_map_get(map, absent) == 0, "absent key has a value", -1);
+  failures += check(!label_has_definition(map, absent), "absent key defined", -1);
+
+  size_t cursor = 0;
+  size_t seen = 0;
+  struct HashEntry* entry;
+  while ((entry = hash_map_next(map, &cursor)) != NULL){
+    struct Slice name = symbol_name(symbols, entry->symbol);
+    int i = atoi(name.start + strlen("label_"));
+    failures += check(entry->symbol == (uint32_t)i, "ids not dense", i);
+    failures += check(entry->is_data == (i % 3 == 0), "wrong data flag", i);
+    seen++;
+  }
+  failures += check(seen == KEYS, "iteration count", (int)seen);
+
+  destroy_hash_map(map);
+  destroy_symbol_table(symbols);
+  return failures == 0 ? 0 : 1;
+}
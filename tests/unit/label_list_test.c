@@ -0,0 +1,61 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "label_list.h"
+
+/*
+  Appends labels with many repeats (same name and address, same name at a
+  different address, same name as data) and checks that only distinct
+  records are kept and that they print in address order.
+*/
+
+#define LABELS 20000
+
+int main(void){
+  struct LabelList* list = create_label_list(4);
+  char name[32];
+  int failures = 0;
+
+  for (int round = 0; round < 3; ++round){
+    for (int i = LABELS - 1; i >= 0; --i){
+      int len = sprintf(name, "label_%d", i % (LABELS / 2));
+      uint32_t addr = 0x80000000u + 4 * (uint32_t)i;
+      label_list_append(list, name, (size_t)len, addr, false);
+      if (i % 7 == 0) label_list_append(list, name, (size_t)len, addr, true);
+    }
+  }
+
+  size_t expected = LABELS + (LABELS + 6) / 7;
+  if (list->size != expected){
+    fprintf(stderr, "expected %zu records, got %zu\n", expected, list->size);
+    failures++;
+  }
+
+  FILE* out = tmpfile();
+  fprint_label_list(out, list);
+  rewind(out);
+
+  char kind[8];
+  unsigned addr;
+  unsigned last = 0;
+  size_t lines = 0;
+  while (fscanf(out, "#%7s %31s %X\n", kind, name, &addr) == 3){
+    if (addr < last){
+      fprintf(stderr, "%s %08X printed after %08X\n", name, addr, last);
+      failures++;
+      break;
+    }
+    last = addr;
+    lines++;
+  }
+  if (lines != list->size){
+    fprintf(stderr, "printed %zu of %zu records\n", lines, list->size);
+    failures++;
+  }
+
+  fclose(out);
+  destroy_label_list(list);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "line_index.h"
+
+/*
+  Checks line_index_lookup against counting newlines by hand, for buffers
+  with and without the preprocessor's leading NUL sentinel.
+*/
+
+#define BUFFER_SIZE 300
+#define ROUNDS 200
+
+static unsigned long rng_state = 777;
+
+static unsigned next_random(void){
+  rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+  return (unsigned)(rng_state >> 33);
+}
+
+static int check_buffer(const char* buffer, size_t len){
+  struct LineIndex* index = create_line_index(buffer);
+  size_t first = buffer[0] == '\0' ? 1 : 0;
+  int failures = 0;
+
+  unsigned line = 1;
+  const char* line_start = buffer + first;
+  for (size_t i = first; i <= len; ++i){
+    const char* found_start;
+    unsigned found = line_index_lookup(index, buffer + i, &found_start);
+    if (found != line || found_start != line_start){
+      fprintf(stderr, "offset %zu: expected line %u, got %u\n", i, line, found);
+      failures++;
+      break;
+    }
+    if (buffer[i] == '\n'){
+      line++;
+      line_start = buffer + i + 1;
+    }
+  }
+
+  destroy_line_index(index);
+  return failures;
+}
+
+int main(void){
+  char* buffer = malloc(BUFFER_SIZE + 2);
+  int failures = 0;
+
+  for (int round = 0; round < ROUNDS && failures == 0; ++round){
+    size_t len = next_random() % BUFFER_SIZE + 1;
+    bool sentinel = round % 2 == 0;
+    for (size_t i = 0; i < len; ++i){
+      buffer[i] = next_random() % 5 == 0 ? '\n' : 'a';
+    }
+    buffer[len] = '\0';
+    if (sentinel) buffer[0] = '\0';
+    failures += check_buffer(buffer, len);
+  }
+
+  free(buffer);
+  return failures == 0 ? 0 : 1;
+}
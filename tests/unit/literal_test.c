@@ -0,0 +1,112 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "literal.h"
+
+/*
+  Differential fuzz test for the SWAR literal parser.
+  Random literals (every prefix, valid and invalid digits, runs longer than
+  one 8-byte chunk, overflowing values) are placed at every offset around a
+  page boundary and parsed by both parse_literal and parse_literal_scalar,
+  which must agree on result, value, end and message.
+*/
+
+#define ROUNDS 20000
+#define MAX_LEN 40
+
+static unsigned long rng_state = 2024;
+
+static unsigned next_random(void){
+  rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+  return (unsigned)(rng_state >> 33);
+}
+
+static const char* const kPrefixes[] = {
+  "", "", "", "0", "0x", "0X", "0b", "0B", "0o", "0O", "-",
+};
+
+static const char kDigits[] = "0123456789";
+static const char kHexDigits[] = "0123456789abcdefABCDEF";
+static const char kOther[] = "gGxz_ ]#,\n\t;:.";
+
+static void random_literal(char* out){
+  size_t len = 0;
+  const char* prefix = kPrefixes[next_random() % (sizeof(kPrefixes) / sizeof(kPrefixes[0]))];
+  len += (size_t)sprintf(out, "%s", prefix);
+
+  size_t digits = next_random() % 24;
+  bool hex = prefix[0] == '0' && (prefix[1] == 'x' || prefix[1] == 'X');
+  for (size_t i = 0; i < digits; ++i){
+    if (next_random() % 16 == 0){
+      out[len++] = kOther[next_random() % (sizeof(kOther) - 1)];
+    } else if (hex){
+      out[len++] = kHexDigits[next_random() % (sizeof(kHexDigits) - 1)];
+    } else {
+      out[len++] = kDigits[next_random() % (sizeof(kDigits) - 1)];
+    }
+  }
+  out[len] = '\0';
+}
+
+static int compare(const char* p){
+  enum ConsumeResult fast_result, slow_result;
+  const char* fast_end = NULL;
+  const char* slow_end = NULL;
+  const char* fast_message = NULL;
+  const char* slow_message = NULL;
+  long fast = parse_literal(p, &fast_end, &fast_result, &fast_message);
+  long slow = parse_literal_scalar(p, &slow_end, &slow_result, &slow_message);
+
+  if (fast_result != slow_result || fast_end != slow_end ||
+      (fast_result == FOUND && fast != slow) ||
+      (fast_result == ERROR && strcmp(fast_message, slow_message) != 0)){
+    fprintf(stderr, "mismatch on \"%s\": %ld/%d vs %ld/%d\n", p, fast, fast_result, slow, slow_result);
+    return 1;
+  }
+  return 0;
+}
+
+static int check_known(const char* text, enum ConsumeResult expected_result, long expected){
+  enum ConsumeResult result;
+  const char* end;
+  const char* message;
+  long value = parse_literal(text, &end, &result, &message);
+  if (result != expected_result || (result == FOUND && value != expected)){
+    fprintf(stderr, "\"%s\": expected %ld, got %ld\n", text, expected, value);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void){
+  int failures = 0;
+
+  failures += check_known("0", FOUND, 0);
+  failures += check_known("1234567890123", FOUND, 1234567890123L);
+  failures += check_known("0xDEADbeef12", FOUND, 0xDEADBEEF12L);
+  failures += check_known("0xffffffffffffffff", FOUND, -1);
+  failures += check_known("0b1012", ERROR, 0);
+  failures += check_known("0o778", ERROR, 0);
+  failures += check_known("0x12g", ERROR, 0);
+  failures += check_known("0x", ERROR, 0);
+  failures += check_known("012", NOT_FOUND, 0);
+
+  // two pages, so literals can straddle the boundary between them
+  const size_t page = 4096;
+  char* storage = aligned_alloc(page, 2 * page);
+  char literal[MAX_LEN + 1];
+
+  for (int round = 0; round < ROUNDS && failures == 0; ++round){
+    random_literal(literal);
+    size_t len = strlen(literal) + 1;
+    size_t offset = page - 16 + next_random() % 32;
+    if (offset + len > 2 * page) offset = 2 * page - len;
+    memcpy(storage + offset, literal, len);
+    failures += compare(storage + offset);
+  }
+
+  free(storage);
+  return failures == 0 ? 0 : 1;
+}
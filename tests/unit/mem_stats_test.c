@@ -0,0 +1,132 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "context.h"
+#include "elf.h"
+#include "instruction_array.h"
+#include "label_list.h"
+#include "mem_stats.h"
+#include "preprocessor.h"
+
+/*
+  Assembles one program with --mem-stats collection on and checks that every
+  phase wrote a row, that each subsystem the program uses reported memory,
+  and that collecting stats does not change the assembled words.
+*/
+
+static const char* const kSource =
+  ".text\n"
+  ".global _start\n"
+  "_start:\n"
+  "  movi r2, value\n"
+  "  push r2\n"
+  ".line main.c 7\n"
+  "loop:\n"
+  "  br loop\n"
+  ".data\n"
+  "value:\n"
+  "  .fill 5\n";
+
+// Purpose: Assemble kSource, with stats going to stats when it is non-NULL.
+// Outputs: Returns the words of every section, or NULL on failure.
+static struct InstructionArrayList* assemble_source(struct MemStats* stats, struct LabelList** labels){
+  const char* argv[] = {"mem_stats_test", "program.s"};
+  int file_names[] = {1};
+  const char* files[] = {kSource};
+
+  struct AssemblerContext* ctx = create_assembler_context();
+  set_mem_stats(ctx, stats);
+  char** preprocessed = preprocess(ctx, 1, file_names, argv, files);
+  if (preprocessed == NULL) return NULL;
+  struct DebugInfoList* debug = NULL;
+  struct ProgramDescriptor* program =
+    assemble(ctx, 1, file_names, false, argv, preprocessed, labels, &debug);
+  free(preprocessed[0]);
+  free(preprocessed);
+  destroy_assembler_context(ctx);
+  destroy_debug_info_list(debug);
+  if (program == NULL) return NULL;
+
+  struct InstructionArrayList* sections = program->sections;
+  free(program);
+  return sections;
+}
+
+static bool same_words(struct InstructionArrayList* a, struct InstructionArrayList* b){
+  struct InstructionArray* x = a->head;
+  struct InstructionArray* y = b->head;
+  for (; x != NULL && y != NULL; x = x->next, y = y->next){
+    if (x->size != y->size) return false;
+    for (size_t i = 0; i < x->size; ++i){
+      if (instruction_array_get(x, i) != instruction_array_get(y, i)) return false;
+    }
+  }
+  return x == NULL && y == NULL;
+}
+
+int main(void){
+  int failures = 0;
+
+  FILE* report = tmpfile();
+  struct MemStats* stats = create_mem_stats(report);
+  struct LabelList* labels = NULL;
+  struct InstructionArrayList* with_stats = assemble_source(stats, &labels);
+  struct InstructionArrayList* without_stats = assemble_source(NULL, NULL);
+  if (with_stats == NULL || without_stats == NULL){
+    fprintf(stderr, "program failed to assemble\n");
+    return 1;
+  }
+
+  if (!same_words(with_stats, without_stats)){
+    fprintf(stderr, "collecting stats changed the output\n");
+    failures++;
+  }
+
+  // preprocess, tokenize, pass 1 and pass 2
+  if (stats->phases != 4){
+    fprintf(stderr, "%d phases reported, expected 4\n", stats->phases);
+    failures++;
+  }
+
+  static const char* const kNames[MEM_SUBSYSTEM_COUNT] = {
+    "preprocessor", "tokens", "symbols", "instructions", "debug info", "labels",
+  };
+  size_t total = 0;
+  for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i){
+    if (stats->peak[i] == 0){
+      fprintf(stderr, "%s reported no memory\n", kNames[i]);
+      failures++;
+    }
+    if (stats->bytes[i] > stats->peak[i]){
+      fprintf(stderr, "%s holds more than its peak\n", kNames[i]);
+      failures++;
+    }
+    total += stats->bytes[i];
+  }
+  if (total > stats->peak_total){
+    fprintf(stderr, "total exceeds the peak total\n");
+    failures++;
+  }
+
+  // tokens and tables are gone once assemble returns
+  if (stats->bytes[MEM_TOKENS] != 0 || stats->bytes[MEM_SYMBOLS] != 0){
+    fprintf(stderr, "tokens or symbols still counted after assembly\n");
+    failures++;
+  }
+
+  mem_stats_report_peaks(stats);
+  if (ftell(report) <= 0){
+    fprintf(stderr, "no report written\n");
+    failures++;
+  }
+
+  fclose(report);
+  destroy_mem_stats(stats);
+  destroy_label_list(labels);
+  destroy_instruction_array_list(with_stats);
+  destroy_instruction_array_list(without_stats);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "hashmap.h"
+#include "scope.h"
+#include "symbol.h"
+
+/*
+  Resolves names through the scopes of two files over one global table and
+  checks the precedence a label operand sees (local label, global label,
+  define), that a define shadowed by a label is still reported, and that a
+  binding cached for one file is not reused for the other.
+*/
+
+#define FILES 2
+
+static int check(bool condition, const char* what){
+  if (condition) return 0;
+  fprintf(stderr, "%s\n", what);
+  return 1;
+}
+
+int main(void){
+  struct SymbolTable* symbols = create_symbol_table();
+  uint32_t shared = intern_symbol(symbols, "shared", 6);
+  uint32_t exported = intern_symbol(symbols, "exported", 8);
+  uint32_t constant = intern_symbol(symbols, "constant", 8);
+  uint32_t both = intern_symbol(symbols, "both", 4);
+  uint32_t missing = intern_symbol(symbols, "missing", 7);
+
+  struct HashMap* labels[FILES];
+  struct HashMap* defines[FILES];
+  struct HashMap* globals[FILES];
+  for (int i = 0; i < FILES; ++i){
+    labels[i] = create_hash_map(4);
+    defines[i] = create_hash_map(4);
+    globals[i] = create_hash_map(4);
+  }
+  struct HashMap* global_labels = create_hash_map(4);
+
+  // file 0 has its own "shared" label; file 1 sees the global one
+  hash_map_insert(labels[0], shared, 0x100, true, false);
+  hash_map_insert(global_labels, shared, 0x200, true, false);
+  hash_map_insert(labels[1], exported, 0x300, true, false);
+  hash_map_insert(globals[1], exported, 0, false, false);
+  hash_map_insert(global_labels, exported, 0x300, true, false);
+  hash_map_insert(defines[0], constant, 42, true, true);
+  hash_map_insert(defines[1], both, 7, true, true);
+  hash_map_insert(labels[1], both, 0x400, true, false);
+  // only declared, never defined
+  hash_map_insert(labels[0], missing, 0, false, false);
+
+  struct Scope* scope = create_scope(symbols->count, labels, defines, globals, global_labels);
+  int failures = 0;
+
+  for (int round = 0; round < 2; ++round){
+    const struct SymbolBinding* b = scope_resolve(scope, 0, shared);
+    failures += check(b->kind == SYMBOL_LOCAL_LABEL && b->value == 0x100, "local label should win");
+    b = scope_resolve(scope, 1, shared);
+    failures += check(b->kind == SYMBOL_GLOBAL_LABEL && b->value == 0x200, "other file should see the global");
+    b = scope_resolve(scope, 0, exported);
+    failures += check(b->kind == SYMBOL_GLOBAL_LABEL && b->value == 0x300, "global label not found");
+    b = scope_resolve(scope, 1, exported);
+    failures += check(b->kind == SYMBOL_LOCAL_LABEL && b->value == 0x300, "exported label not local");
+    b = scope_resolve(scope, 0, constant);
+    failures += check(b->kind == SYMBOL_DEFINE && b->value == 42 && b->is_define, "define not found");
+    b = scope_resolve(scope, 1, constant);
+    failures += check(b->kind == SYMBOL_UNDEFINED && !b->is_define, "define leaked to another file");
+    b = scope_resolve(scope, 1, both);
+    failures += check(b->kind == SYMBOL_LOCAL_LABEL && b->value == 0x400, "label should shadow define");
+    failures += check(b->is_define && b->define_value == 7, "shadowed define lost");
+    b = scope_resolve(scope, 0, missing);
+    failures += check(b->kind == SYMBOL_UNDEFINED, "declared label treated as defined");
+  }
+
+  // ids interned after the scope was created still resolve
+  uint32_t late = intern_symbol(symbols, "late", 4);
+  hash_map_insert(defines[1], late, 9, true, true);
+  const struct SymbolBinding* b = scope_resolve(scope, 1, late);
+  failures += check(b->kind == SYMBOL_DEFINE && b->value == 9, "late id not resolved");
+
+  destroy_scope(scope);
+  for (int i = 0; i < FILES; ++i){
+    destroy_hash_map(labels[i]);
+    destroy_hash_map(defines[i]);
+    destroy_hash_map(globals[i]);
+  }
+  destroy_hash_map(global_labels);
+  destroy_symbol_table(symbols);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+    .text
+
+    .define foo 8
+    .define bar 16
+
+    .global _start
+_start:
+    # foo is also a label defined below, which takes priority
+    br foo
+    add r1, r1, r1
+    movi r3, foo
+    movi r4, bar
+    add r5, r5, bar
+foo:
+    add r2, r2, r2